@@ -29,6 +29,7 @@
 #include <Logger.h>
 #include <MQTTKit.h>
 #include <NetworkController.h>
+#include <SchedulerDevice.h>
 #include <Singleton.h>
 #include <TopDevice.h>
 #include <unLisp.h>
@@ -63,8 +64,10 @@ class AppKit : public ICoreEventBusConnectionKit, public ISchedulerConnectionKit
     scheduler.push(mNetwork);
     scheduler.push(mMQTT);
     scheduler.push("lisp_task", getLisp().getTask());
+    scheduler.push("lisp_calendar", getLisp().getCalendarTask());
 
     mTopDevice.setScheduler(scheduler);
+    mSchedulerDevice.setScheduler(scheduler);
 
     if (mpNetworkDevice) {
       scheduler.push(*mpNetworkDevice);
@@ -88,6 +91,7 @@ class AppKit : public ICoreEventBusConnectionKit, public ISchedulerConnectionKit
     analogWriteResolution(10);
 #endif
     mLispDevice.runStoredCode();
+    mSchedulerDevice.applyStored();
   }
 
   virtual void registerWithBus(CoreEventBus &eventBus) override {
@@ -188,8 +192,10 @@ class AppKit : public ICoreEventBusConnectionKit, public ISchedulerConnectionKit
     // TODO: should I move configs to the Credentials class?
     mMQTT.setServer("mqtt.uniot.io", 1883);
     mMQTT.addDevice(mTopDevice);
+    mMQTT.addDevice(mSchedulerDevice);
     mMQTT.addDevice(mLispDevice);
     mTopDevice.syncSubscriptions();
+    mSchedulerDevice.syncSubscriptions();
     mLispDevice.syncSubscriptions();
   }
 
@@ -271,6 +277,7 @@ class AppKit : public ICoreEventBusConnectionKit, public ISchedulerConnectionKit
   NetworkScheduler mNetwork;
   MQTTKit mMQTT;
   TopDevice mTopDevice;
+  SchedulerDevice mSchedulerDevice;
   LispDevice mLispDevice;
 
   UniquePointer<NetworkController> mpNetworkDevice;
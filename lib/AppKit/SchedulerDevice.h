@@ -0,0 +1,181 @@
+/*
+ * This is a part of the Uniot project.
+ * Copyright (C) 2016-2024 Uniot <contact@uniot.io>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <CBORObject.h>
+#include <CBORStorage.h>
+#include <MQTTDevice.h>
+#include <TaskScheduler.h>
+
+namespace uniot {
+
+/**
+ * @brief Lets the periods of the tasks be tuned over MQTT at runtime, without a reflash.
+ *
+ * `debug/sched/ask` publishes the list of the tasks to `debug/sched`: name -> [attached, period, override, enabled].
+ * `debug/sched/set` takes a CBOR map: {"task": name, "period": ms} overrides the period of a repeating task,
+ * 0 gives it back to the code; {"task": name, "enabled": 0|1} detaches the task and keeps it detached, or lets it run again;
+ * {"reset": 1} drops all the changes. The changes are stored and applied again on the next boot.
+ * The tasks the device itself depends on cannot be disabled, otherwise it could never be enabled again.
+ * The changes are kept by name, so a task whose name is shared by another task cannot be changed.
+ */
+class SchedulerDevice : public MQTTDevice, public CBORStorage {
+ public:
+  SchedulerDevice()
+      : MQTTDevice(),
+        CBORStorage("sched.cbor"),
+        mpScheduler(nullptr) {}
+
+  virtual void syncSubscriptions() override {
+    mTopicAsk = MQTTDevice::subscribeDevice("debug/sched/ask");
+    mTopicSet = MQTTDevice::subscribeDevice("debug/sched/set");
+  }
+
+  void setScheduler(TaskScheduler &scheduler) {
+    mpScheduler = &scheduler;
+  }
+
+  /**
+   * @brief Applies the stored changes, must be called once all the tasks have been pushed to the scheduler.
+   */
+  void applyStored() {
+    if (mpScheduler && CBORStorage::restore()) {
+      auto periods = object().getMap("period");
+      auto disabled = object().getMap("off");
+      mpScheduler->exportTasksHandles([&](const char *name, TaskScheduler::TaskHandle handle) {
+        auto task = mpScheduler->get(handle);
+        task->setPeriodOverride(periods.getInt(name));
+        task->setEnabled(!disabled.getInt(name));
+      });
+    }
+  }
+
+  virtual bool store() override {
+    if (!mpScheduler) {
+      return false;
+    }
+    // NOTE: the maps are rebuilt from the tasks, so a task that is gone leaves nothing behind
+    object().clean();
+    auto periods = object().putMap("period");
+    auto disabled = object().putMap("off");
+    mpScheduler->exportTasksStats([&](const char *name, const SchedulerTask &task) {
+      if (task.getPeriodOverride()) {
+        periods.put(name, static_cast<uint64_t>(task.getPeriodOverride()));
+      }
+      if (!task.isEnabled()) {
+        disabled.put(name, 1);
+      }
+    });
+    return CBORStorage::store();
+  }
+
+  virtual void handle(const String &topic, const Bytes &payload) override {
+    if (MQTTDevice::isTopicMatch(mTopicAsk, topic)) {
+      handleAsk();
+      return;
+    }
+    if (MQTTDevice::isTopicMatch(mTopicSet, topic)) {
+      handleSet(payload);
+      return;
+    }
+  }
+
+  void handleAsk() {
+    if (mpScheduler) {
+      CBORObject packet;
+      auto tasksObj = packet.putMap("tasks");
+      mpScheduler->exportTasksStats([&](const char *name, const SchedulerTask &task) {
+        tasksObj.putArray(name)
+            .append(task.isAttached())
+            .append(static_cast<int>(task.getPeriodMs()))
+            .append(static_cast<int>(task.getPeriodOverride()))
+            .append(task.isEnabled());
+      });
+      MQTTDevice::publishDevice("debug/sched", packet.build());
+    }
+  }
+
+  void handleSet(const Bytes &payload) {
+    if (!mpScheduler) {
+      return;
+    }
+    CBORObject request(payload);
+    if (request.getInt("reset")) {
+      mpScheduler->exportTasksHandles([this](const char *, TaskScheduler::TaskHandle handle) {
+        auto task = mpScheduler->get(handle);
+        task->setPeriodOverride(0);
+        task->setEnabled(true);
+      });
+    } else {
+      auto name = request.getString("task");
+      auto task = mpScheduler->get(name.c_str());
+      if (!task) {
+        UNIOT_LOG_WARN("sched: the task '%s' is not found", name.c_str());
+        return;
+      }
+      // NOTE: the changes are stored by name, so they must not be ambiguous
+      if (_countTasks(name.c_str()) > 1) {
+        UNIOT_LOG_WARN("sched: the task name '%s' is not unique", name.c_str());
+        return;
+      }
+      auto period = request.getValueAsString("period");
+      if (period.length()) {
+        auto periodMs = request.getInt("period");
+        task->setPeriodOverride(periodMs > 0 ? periodMs : 0);
+      }
+      auto enabled = request.getValueAsString("enabled");
+      if (enabled.length()) {
+        auto enable = request.getInt("enabled") || request.getBool("enabled");
+        if (!enable && _isEssential(name.c_str())) {
+          UNIOT_LOG_WARN("sched: the task '%s' cannot be disabled", name.c_str());
+        } else {
+          task->setEnabled(enable);
+        }
+      }
+    }
+    store();
+    handleAsk();
+  }
+
+ private:
+  size_t _countTasks(const char *name) const {
+    size_t count = 0;
+    mpScheduler->exportTasksHandles([&](const char *taskName, TaskScheduler::TaskHandle) {
+      count += !strcmp(name, taskName);
+    });
+    return count;
+  }
+
+  // NOTE: the commands arrive over MQTT, whose connection is made on the network worker
+  static bool _isEssential(const char *name) {
+    static const char *const essential[] = {"mqtt", "network", "event_bus", "net_worker"};
+    for (auto essentialName : essential) {
+      if (!strcmp(name, essentialName)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  TaskScheduler *mpScheduler;
+  String mTopicAsk;
+  String mTopicSet;
+};
+
+}  // namespace uniot
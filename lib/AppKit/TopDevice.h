@@ -21,7 +21,9 @@
 #include <CBORObject.h>
 #include <Date.h>
 #include <MQTTDevice.h>
+#include <MemoryProfiler.h>
 #include <TaskScheduler.h>
+#include <Tracer.h>
 
 namespace uniot {
 
@@ -34,6 +36,7 @@ class TopDevice : public MQTTDevice {
   virtual void syncSubscriptions() override {
     mTopicTopAsk = MQTTDevice::subscribeDevice("debug/top/ask");
     mTopicMemAsk = MQTTDevice::subscribeDevice("debug/mem/ask");
+    mTopicTraceAsk = MQTTDevice::subscribeDevice("debug/trace/ask");
   }
 
   void setScheduler(const TaskScheduler& scheduler) {
@@ -49,6 +52,10 @@ class TopDevice : public MQTTDevice {
       handleMem();
       return;
     }
+    if (MQTTDevice::isTopicMatch(mTopicTraceAsk, topic)) {
+      handleTrace();
+      return;
+    }
   }
 
   void handleTop() {
@@ -56,14 +63,25 @@ class TopDevice : public MQTTDevice {
       CBORObject packet;
       auto tasksObj = packet.putMap("tasks");
       uint64_t tasksElapsedMs = 0;
-      mpScheduler->exportTasksInfo([&](const char* name, bool isAttached, uint64_t elapsedMs) {
+      mpScheduler->exportTasksStats([&](const char* name, const SchedulerTask& task) {
+        auto elapsedMs = task.getTotalElapsedMs();
         tasksElapsedMs += elapsedMs;
         tasksObj.putArray(name)
-            .append(isAttached)
-            .append(elapsedMs);
+            .append(task.isAttached())
+            .append(elapsedMs)
+            .append(task.getMaxElapsedMs())
+            .append(task.getTotalOverruns());
       });
       auto idleMs = mpScheduler->getTotalElapsedMs() - tasksElapsedMs;
       packet.put("idle", idleMs);
+      packet.put("runaways", static_cast<uint64_t>(mpScheduler->getRunawayCount()));
+      packet.put("wakeups", static_cast<uint64_t>(mpScheduler->getWakeupsCount()));
+      packet.put("shed", static_cast<uint64_t>(mpScheduler->getShedCount()));
+      auto loopStats = mpScheduler->getLoopStats();
+      packet.putArray("loop_us")
+          .append(static_cast<int>(loopStats.meanUs))
+          .append(static_cast<int>(loopStats.stdDevUs))
+          .append(static_cast<int>(loopStats.maxUs));
       packet.put("timestamp", static_cast<int64_t>(Date::now()));
       packet.put("uptime", static_cast<uint64_t>(millis()));
 
@@ -71,16 +89,73 @@ class TopDevice : public MQTTDevice {
     }
   }
 
+  // NOTE: the fragmentation is the share of the free heap that cannot be allocated in one piece, in percent,
+  // each subsystem is reported as [live bytes, peak bytes, live allocations, allocations]
   void handleMem() {
     CBORObject packet;
-    packet.put("available", static_cast<uint64_t>(ESP.getFreeHeap()));
+    uint32_t available = ESP.getFreeHeap();
+#if defined(ESP8266)
+    uint32_t largest = ESP.getMaxFreeBlockSize();
+#elif defined(ESP32)
+    uint32_t largest = ESP.getMaxAllocHeap();
+#endif
+    packet.put("available", static_cast<uint64_t>(available));
+    packet.put("largest", static_cast<uint64_t>(largest));
+    packet.put("fragmentation", available ? static_cast<int>(100 - static_cast<uint64_t>(largest) * 100 / available) : 0);
+#if UNIOT_BYTES_USE_GLOBAL_BUFFER
+    packet.putArray("buffer")
+        .append(static_cast<int>(GlobalBufferMemoryManager::getUsedMemory()))
+        .append(static_cast<int>(GlobalBufferMemoryManager::getPeakUsedMemory()))
+        .append(static_cast<int>(GlobalBufferMemoryManager::getLargestFreeBlock()))
+        .append(GlobalBufferMemoryManager::getFragmentation());
+#endif
+#if UNIOT_MEM_PROFILER_ENABLED
+    auto tagsObj = packet.putMap("tags");
+    MemoryProfiler::exportStats([&](const char* name, const MemoryProfiler::Stats& stats) {
+      tagsObj.putArray(name)
+          .append(static_cast<int>(stats.liveBytes))
+          .append(static_cast<int>(stats.peakBytes))
+          .append(static_cast<int>(stats.liveCount))
+          .append(static_cast<int>(stats.allocationsCount));
+    });
+#endif
     MQTTDevice::publishDevice("debug/mem", packet.build());
   }
 
+  // NOTE: the trace does not fit into a single MQTT packet, so it is sent in parts,
+  // the concatenation of the "json" fields of all the parts is a Chrome trace JSON
+  void handleTrace() {
+#if UNIOT_TRACE_ENABLED
+    auto& tracer = Tracer::getInstance();
+    auto lost = tracer.getOverwrittenCount();
+    auto part = 0;
+    String json;
+    auto flush = [&](bool last) {
+      CBORObject packet;
+      packet.put("part", part++);
+      packet.put("last", last ? 1 : 0);
+      packet.put("lost", static_cast<uint64_t>(lost));
+      packet.put("json", json.c_str());
+      MQTTDevice::publishDevice("debug/trace", packet.build());
+      json = "";
+    };
+    tracer.exportChromeTrace([&](const char* piece) {
+      json += piece;
+      if (json.length() >= TRACE_PART_SIZE) {
+        flush(false);
+      }
+    });
+    flush(true);
+#endif
+  }
+
  private:
+  static constexpr size_t TRACE_PART_SIZE = 1024;
+
   const TaskScheduler* mpScheduler;
   String mTopicTopAsk;
   String mTopicMemAsk;
+  String mTopicTraceAsk;
 };
 
 }  // namespace uniot
\ No newline at end of file
@@ -21,6 +21,7 @@
 #include <Arduino.h>
 #include <Bytes.h>
 #include <Logger.h>
+#include <MemoryProfiler.h>
 #include <cn-cbor.h>
 
 #include <memory>
@@ -42,7 +43,7 @@ class CBORObject {
     return *this;
   }
 
-  CBORObject(Bytes buf)
+  CBORObject(const Bytes &buf)
       : mpParentObject(nullptr),
         mpMapNode(nullptr),
         mDirty(false) {
@@ -274,8 +275,9 @@ class CBORObject {
       return;
     }
 
+    UNIOT_MEM_SCOPE(CBOR);
     _clean();
-    mBuf = buf;
+    mBuf = buf;  // NOTE: shares a large buffer, the decoded nodes point into it
     mpMapNode = cn_cbor_decode(mBuf.raw(), mBuf.size(), _errback());
     if (!mpMapNode) {
       _create();
@@ -283,6 +285,7 @@ class CBORObject {
   }
 
   Bytes build() const {
+    UNIOT_MEM_SCOPE(CBOR);
     auto visitSiblings = mpParentObject == nullptr;
     return _build(mpMapNode, visitSiblings);
   }
@@ -470,11 +473,24 @@ class CBORObject {
   Bytes _getBytes(cn_cbor *cb) const {
     // if(!cb) throw "error"; // TODO: ???
     if (cb && CN_CBOR_BYTES == cb->type) {
-      return Bytes(cb->v.bytes, cb->length);
+      return _sliceOrCopy(cb->v.bytes, cb->length);
     }
     return {};
   }
 
+  // the decoded byte strings are sliced out of the buffer that was read, the others are copied
+  Bytes _sliceOrCopy(const uint8_t *data, size_t size) const {
+    auto root = this;
+    while (root->mpParentObject) {
+      root = root->mpParentObject;
+    }
+    auto begin = root->mBuf.raw();
+    if (begin && data >= begin && data + size <= begin + root->mBuf.size()) {
+      return root->mBuf.slice(data - begin, size);
+    }
+    return Bytes(data, size);
+  }
+
   String _getValueAsString(cn_cbor *cb) const {
     // if(!cb) throw "error"; // TODO: ???
     if (cb) {
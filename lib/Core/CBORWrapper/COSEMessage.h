@@ -42,7 +42,7 @@ class COSEMessage {
     _create();
   }
 
-  COSEMessage(Bytes buf)
+  COSEMessage(const Bytes &buf)
       : mpProtectedHeader(nullptr),
         mpUnprotectedHeader(nullptr),
         mpPayload(nullptr),
@@ -92,7 +92,7 @@ class COSEMessage {
     return alg != 0 && signature.size() > 0;
   }
 
-  void setUnprotectedKid(const Bytes& kid) {
+  void setUnprotectedKid(const BytesView &kid) {
     getUnprotectedHeader().put(COSEHeaderLabel::KeyIdentifier, kid.raw(), kid.size());
   }
 
@@ -101,7 +101,7 @@ class COSEMessage {
     return cn_cbor_data_update(mpPayload, mRawPayload.raw(), mRawPayload.size());
   }
 
-  void sign(const ICOSESigner &signer, const Bytes &external = Bytes()) {
+  void sign(const ICOSESigner &signer, const BytesView &external = {}) {
     auto alg = signer.signerAlgorithm();
     if (alg != COSEAlgorithm::EdDSA) {
       UNIOT_LOG_ERROR("sign failed: alg '%d' is not supported", alg);
@@ -247,7 +247,7 @@ class COSEMessage {
     return cn_cbor_data_update(mpSignature, mRawSignature.raw(), mRawSignature.size());
   }
 
-  Bytes _toBeSigned(const Bytes &external = Bytes()) {
+  Bytes _toBeSigned(const BytesView &external = {}) {
     auto protectedHeader = getProtectedHeader();
     auto payload = getPayload();
 
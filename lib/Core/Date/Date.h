@@ -25,6 +25,7 @@
 #include <esp_sntp.h>
 #endif
 
+#include <BackgroundWorker.h>
 #include <CBORStorage.h>
 #include <EventEmitter.h>
 #include <IExecutor.h>
@@ -69,16 +70,30 @@ class Date : public IExecutor, public CBORStorage, public Singleton<Date>, publi
     }
   }
 
+  /**
+   * @brief Requests the time from an NTP server. The request waits for the reply,
+   * so it is sent from the network worker and the time is set on the main loop once it arrives.
+   */
   void forceSync() {
     _reconfigure();
-    auto epoch = mSNTP.getNtpTime();
-    if (epoch) {
-      _setTime(epoch);
+    if (mSyncing) {
+      return;
+    }
+    mSyncing = true;
+    auto posted = NetworkWorker::getInstance().post([this] { mSyncedEpoch = mSNTP.getNtpTime(); }, [this] {
+      mSyncing = false;
+      if (mSyncedEpoch && _setTime(mSyncedEpoch)) {
+        _timeSyncCallback();
+        UNIOT_LOG_INFO("Time is forced to synchronize with SNTP");
+      }
+    });
+    if (!posted) {
+      mSyncing = false;
     }
   }
 
  private:
-  Date() : CBORStorage("date.cbor") {
+  Date() : CBORStorage("date.cbor"), mSyncing(false), mSyncedEpoch(0) {
 #if defined(ESP8266)
     settimeofday_cb([this](bool from_sntp) {
       Date::getInstance()._timeSyncCallback();
@@ -91,11 +106,6 @@ class Date : public IExecutor, public CBORStorage, public Singleton<Date>, publi
       UNIOT_LOG_INFO("Time is set from SNTP");
     });
 #endif
-    mSNTP.setSyncTimeCallback([](time_t epoch) {
-      Date::getInstance()._timeSyncCallback();
-      UNIOT_LOG_INFO("Time is forced to synchronize with SNTP");
-    });
-
     _reconfigure();
 
     this->restore();
@@ -141,5 +151,7 @@ class Date : public IExecutor, public CBORStorage, public Singleton<Date>, publi
   }
 
   SimpleNTP mSNTP;
+  bool mSyncing;
+  time_t mSyncedEpoch;
 };
 }  // namespace uniot
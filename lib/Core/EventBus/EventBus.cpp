@@ -19,6 +19,7 @@
 #include "EventBus.h"
 
 #include <Arduino.h>
+#include <Tracer.h>
 
 #include "EventEmitter.h"
 #include "EventEntity.h"
@@ -91,6 +92,7 @@ template <class T_topic, class T_msg, class T_data>
 void EventBus<T_topic, T_msg, T_data>::execute(short _) {
   while (!mEvents.isEmpty()) {
     auto event = mEvents.hardPop();
+    UNIOT_TRACE_SCOPE(EVENT, "dispatch", event.first);
     // NOTE: Is it worth making a separate list for listeners to reduce the number of iterations?
     // Which is better - saving RAM or CPU time?
     mEntities.forEach([&](EventEntity<T_topic, T_msg, T_data> *entity) {
@@ -107,6 +109,18 @@ void EventBus<T_topic, T_msg, T_data>::execute(short _) {
     });
   }
 }
+
+template <class T_topic, class T_msg, class T_data>
+bool EventBus<T_topic, T_msg, T_data>::process(short times) {
+  auto busy = !mEvents.isEmpty();
+  execute(times);
+  if (mWasBusy && !busy) {
+    // NOTE: the burst is over, the nodes it took go back to the heap, one chunk is kept for the next events
+    mEvents.trimNodes(1);
+  }
+  mWasBusy = busy;
+  return busy;
+}
 }  // namespace uniot
 
 template class uniot::EventBus<unsigned int, int, Bytes>;
@@ -40,7 +40,7 @@ class EventBus : public uniot::IExecutor {
   friend class EventEntity<T_topic, T_msg, T_data>;
 
  public:
-  EventBus(unsigned int id) : mId(id) {}
+  EventBus(unsigned int id) : mId(id), mWasBusy(false) {}
   virtual ~EventBus();
 
   unsigned int getId() { return mId; }
@@ -59,6 +59,7 @@ class EventBus : public uniot::IExecutor {
 
   void emitEvent(T_topic topic, T_msg msg);
   virtual void execute(short _) override;
+  virtual bool process(short times) override;
 
  private:
   ClearQueue<EventEntity<T_topic, T_msg, T_data> *> mEntities; // TODO: need real set; std::set is broken into esp xtensa sdk
@@ -67,6 +68,7 @@ class EventBus : public uniot::IExecutor {
   DataChannels<T_topic, T_data> mDataChannels;
 
   unsigned int mId;
+  bool mWasBusy;
 };
 
 using CoreEventBus = EventBus<unsigned int, int, Bytes>;
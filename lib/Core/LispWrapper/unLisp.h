@@ -20,11 +20,14 @@
 
 #include <Bytes.h>
 #include <CBORObject.h>
+#include <Calendar.h>
 #include <Common.h>
+#include <Date.h>
 #include <EventListener.h>
 #include <LimitedQueue.h>
 #include <LispHelper.h>
 #include <Logger.h>
+#include <MemoryProfiler.h>
 #include <PrimitiveExpeditor.h>
 #include <Singleton.h>
 #include <TaskScheduler.h>
@@ -34,6 +37,11 @@
 #define UNIOT_LISP_HEAP 8000
 #endif
 
+// the number of (at ...) rules a script may declare
+#ifndef UNIOT_LISP_AT_MAX_RULES
+#define UNIOT_LISP_AT_MAX_RULES 8
+#endif
+
 namespace uniot {
 using namespace lisp;
 
@@ -67,12 +75,16 @@ class unLisp : public CoreEventListener, public Singleton<unLisp> {
     return mTaskLispEval;
   }
 
+  SchedulerTask &getCalendarTask() {
+    return mCalendar.task();
+  }
+
   bool isCreated() {
     return lisp_is_created();
   }
 
   bool taskIsRunning() {
-    return mTaskLispEval->isAttached();
+    return mTaskLispEval->isAttached() || !mCalendar.isEmpty();
   }
 
   size_t memoryUsed() {
@@ -83,9 +95,11 @@ class unLisp : public CoreEventListener, public Singleton<unLisp> {
     if (!data.size())
       return;
 
+    UNIOT_MEM_SCOPE(LISP);
     mLastCode = data;
 
     mTaskLispEval->detach();
+    _clearCalendar();
     _destroyMachine();
     _createMachine();
 
@@ -94,7 +108,7 @@ class unLisp : public CoreEventListener, public Singleton<unLisp> {
 
     _refreshIncomingEvents();
     lisp_eval(mLispRoot, mLispEnv, code);
-    if (!mTaskLispEval->isAttached()) {
+    if (!taskIsRunning()) {
       _destroyMachine();
     }
   }
@@ -140,11 +154,18 @@ class unLisp : public CoreEventListener, public Singleton<unLisp> {
       }
       return;
     }
+    if (topic == Date::Topic::TIME) {
+      if (msg == Date::Msg::SYNCED) {
+        mCalendar.replan();
+      }
+      return;
+    }
   }
 
  private:
-  unLisp() {
+  unLisp() : mCalendar(Date::now), mAtRulesCount(0) {
     CoreEventListener::listenToEvent(unLisp::Topic::IN_LISP_EVENT);
+    CoreEventListener::listenToEvent(Date::Topic::TIME);
 
     auto fnPrintOut = [](const char *msg, int size) {
       if (size > 0) {
@@ -170,6 +191,7 @@ class unLisp : public CoreEventListener, public Singleton<unLisp> {
       instance.emitEvent(Topic::OUT_LISP_MSG, OUT_MSG_ERROR);
 
       instance.mTaskLispEval->detach();
+      instance._clearCalendar();
       instance._destroyMachine();
     };
 
@@ -188,7 +210,7 @@ class unLisp : public CoreEventListener, public Singleton<unLisp> {
       *t_obj = get_variable(root, env, "#t_obj")->cdr;
       safe_eval(root, env, t_obj);
 
-      if (!t) {
+      if (!t && mCalendar.isEmpty()) {
         _destroyMachine();
       }
 
@@ -206,6 +228,9 @@ class unLisp : public CoreEventListener, public Singleton<unLisp> {
 
   void _createMachine() {
     lisp_create(UNIOT_LISP_HEAP);
+    if (isCreated()) {
+      UNIOT_MEM_ACCOUNT(LISP, UNIOT_LISP_HEAP);
+    }
 
     *mLispEnv = make_env(mLispRoot, &Nil, &Nil);
     define_constants(mLispRoot, mLispEnv);
@@ -213,7 +238,12 @@ class unLisp : public CoreEventListener, public Singleton<unLisp> {
 
     add_constant(mLispRoot, mLispEnv, "#t_obj", &Nil);
     add_constant_int(mLispRoot, mLispEnv, "#t_pass", 0);
+    for (auto i = 0; i < UNIOT_LISP_AT_MAX_RULES; i++) {
+      char name[16];
+      add_constant(mLispRoot, mLispEnv, _atBodyName(name, i), &Nil);
+    }
     add_primitive(mLispRoot, mLispEnv, "task", mPrimitiveTask);
+    add_primitive(mLispRoot, mLispEnv, "at", mPrimitiveAt);
     add_primitive(mLispRoot, mLispEnv, "is_event", mPrimitiveIsEventAvailable);
     add_primitive(mLispRoot, mLispEnv, "pop_event", mPrimitivePopEvent);
     add_primitive(mLispRoot, mLispEnv, "push_event", mPrimitivePushEvent);
@@ -226,6 +256,9 @@ class unLisp : public CoreEventListener, public Singleton<unLisp> {
   }
 
   void _destroyMachine() {
+    if (isCreated()) {
+      UNIOT_MEM_RELEASE(LISP, UNIOT_LISP_HEAP);
+    }
     lisp_destroy();
   }
 
@@ -291,6 +324,59 @@ class unLisp : public CoreEventListener, public Singleton<unLisp> {
     return expeditor.makeBool(true);
   }
 
+  // NOTE: (at hour minute obj) evaluates obj every day at hour:minute UTC, -1 stands for any hour or minute,
+  // e.g. (at 7 0 ...) runs at 07:00 and (at -1 0 ...) every hour on the hour; every call adds a rule of its own
+  inline Object _primAt(Root root, VarObject env, VarObject list) {
+    auto expeditor = PrimitiveExpeditor::describe("at", Lisp::Bool, 3, Lisp::Int, Lisp::Int, Lisp::Cell)
+                         .init(root, env, list);
+    expeditor.assertDescribedArgs();
+
+    auto hour = expeditor.getArgInt(0);
+    auto minute = expeditor.getArgInt(1);
+    auto obj = expeditor.getArg(2);
+
+    if (hour < -1 || hour > 23 || minute < -1 || minute > 59) {
+      expeditor.terminate("time is out of range");
+    }
+    Calendar::Rule rule = {static_cast<int8_t>(minute), static_cast<int8_t>(hour), Calendar::EVERY_WEEKDAY};
+
+    if (mAtRulesCount >= UNIOT_LISP_AT_MAX_RULES) {
+      expeditor.terminate("too many at rules");
+    }
+    auto index = mAtRulesCount;
+    char name[16];
+    DEFINE1(c_obj);
+    *c_obj = get_variable(root, env, _atBodyName(name, index));
+    (*c_obj)->cdr = obj;
+
+    auto added = mCalendar.add(rule, [this, index](time_t planned) {
+      auto root = mLispRoot;
+      auto env = mLispEnv;
+
+      char name[16];
+      DEFINE1(c_obj);
+      *c_obj = get_variable(root, env, _atBodyName(name, index))->cdr;
+      safe_eval(root, env, c_obj);
+    });
+    if (added == Calendar::INVALID_ENTRY) {
+      return expeditor.makeBool(false);
+    }
+    mAtRulesCount++;
+
+    return expeditor.makeBool(true);
+  }
+
+  static const char *_atBodyName(char (&name)[16], int index) {
+    snprintf(name, sizeof(name), "#c_obj%d", index);
+    return name;
+  }
+
+  // NOTE: the rules belong to the script, they are dropped together with it
+  void _clearCalendar() {
+    mCalendar.clear();
+    mAtRulesCount = 0;
+  }
+
   inline Object _primIsEventAvailable(Root root, VarObject env, VarObject list) {
     auto expeditor = PrimitiveExpeditor::describe("is_event", Lisp::Bool, 1, Lisp::Symbol)
                          .init(root, env, list);
@@ -335,9 +421,12 @@ class unLisp : public CoreEventListener, public Singleton<unLisp> {
 
   Bytes mLastCode;
   TaskScheduler::TaskPtr mTaskLispEval;
+  Calendar mCalendar;
+  int mAtRulesCount;
   ClearQueue<Pair<String, Primitive *>> mUserPrimitives;
 
   const Primitive *mPrimitiveTask = [](Root root, VarObject env, VarObject list) { return getInstance()._primTask(root, env, list); };
+  const Primitive *mPrimitiveAt = [](Root root, VarObject env, VarObject list) { return getInstance()._primAt(root, env, list); };
   const Primitive *mPrimitiveIsEventAvailable = [](Root root, VarObject env, VarObject list) { return getInstance()._primIsEventAvailable(root, env, list); };
   const Primitive *mPrimitivePopEvent = [](Root root, VarObject env, VarObject list) { return getInstance()._primPopEvent(root, env, list); };
   const Primitive *mPrimitivePushEvent = [](Root root, VarObject env, VarObject list) { return getInstance()._primPushEvent(root, env, list); };
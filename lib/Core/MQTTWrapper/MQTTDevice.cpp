@@ -20,6 +20,7 @@
 
 #include <Arduino.h>
 #include <Logger.h>
+#include <Tracer.h>
 
 #include "MQTTKit.h"
 
@@ -55,7 +56,7 @@ const String &MQTTDevice::getOwnerId() const {
 void MQTTDevice::unsubscribeFromAll() {
   while (!mTopics.isEmpty()) {
     auto topic = mTopics.hardPop();
-    if (mpKit) {
+    if (mpKit && mpKit->client()) {
       mpKit->client()->unsubscribe(topic.c_str());
     }
   }
@@ -63,7 +64,8 @@ void MQTTDevice::unsubscribeFromAll() {
 
 bool MQTTDevice::unsubscribe(const String &topic) {
   mTopics.removeOne(topic);
-  if (mpKit) {
+  // NOTE: there is no client while the kit is connecting, the topics are synchronized once it is connected
+  if (mpKit && mpKit->client()) {
     auto unsubscribed = mpKit->client()->unsubscribe(topic.c_str());
     UNIOT_LOG_TRACE_IF(!unsubscribed, "failed to unsubscribe from topic: %s", topic.c_str());
     return unsubscribed;
@@ -73,7 +75,7 @@ bool MQTTDevice::unsubscribe(const String &topic) {
 
 const String &MQTTDevice::subscribe(const String &topic) {
   mTopics.pushUnique(topic);
-  if (mpKit) {
+  if (mpKit && mpKit->client()) {
     auto subscribed = mpKit->client()->subscribe(topic.c_str());
     UNIOT_LOG_TRACE_IF(!subscribed, "failed to subscribe to topic: %s", topic.c_str());
   }
@@ -99,7 +101,8 @@ const String &MQTTDevice::subscribeGroup(const String &groupId, const String &su
 }
 
 void MQTTDevice::publish(const String &topic, const Bytes &payload, bool retained, bool sign) {
-  if (mpKit) {
+  if (mpKit && mpKit->client()) {
+    UNIOT_TRACE_SCOPE(MQTT, "publish", payload.size());
     auto msg = mpKit->_buildCOSEMessage(payload, sign);
     mpKit->client()->publish(topic.c_str(), msg.raw(), msg.size(), retained);
   }
@@ -118,7 +121,7 @@ void MQTTDevice::publishGroup(const String &groupId, const String &subTopic, con
 }
 
 void MQTTDevice::publishEmptyDevice(const String &subTopic) {
-  if (mpKit) {
+  if (mpKit && mpKit->client()) {
     mpKit->client()->publish(mpKit->getPath().buildDevicePath(subTopic).c_str(), nullptr, 0, true);
   }
 }
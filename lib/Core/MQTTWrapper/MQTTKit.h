@@ -24,6 +24,7 @@
 #include "WiFi.h"
 #endif
 
+#include <BackgroundWorker.h>
 #include <Bytes.h>
 #include <CBORObject.h>
 #include <COSEMessage.h>
@@ -31,6 +32,7 @@
 #include <Common.h>
 #include <Date.h>
 #include <EventListener.h>
+#include <MemoryProfiler.h>
 #include <NetworkScheduler.h>
 #include <PubSubClient.h>
 #include <TaskScheduler.h>
@@ -59,8 +61,15 @@ class MQTTKit : public ISchedulerConnectionKit, public CoreEventListener {
         mInfoExtender(infoExtender),
         mPubSubClient(mWiFiClient),
         mNetworkConnected(false),
+        mConnecting(false),
+        mConnected(false),
         mConnectionId(0) {
     mPubSubClient.setCallback([this](char *topic, uint8_t *payload, unsigned int length) {
+      // NOTE: the message is decoded once for all the devices, it is copied once out of the client buffer
+      // and the decoded payload is a slice of that copy
+      UNIOT_MEM_SCOPE(MQTT);
+      Bytes decoded;
+      auto decodeState = 0;  // 0 - not yet, 1 - decoded, -1 - failed
       mDevices.forEach([&](MQTTDevice *device) {
         if (device->isSubscribed(String(topic))) {
           if (!length) {
@@ -68,8 +77,10 @@ class MQTTKit : public ISchedulerConnectionKit, public CoreEventListener {
             return;
           }
 
-          Bytes decoded;
-          if (_readCOSEMessage(Bytes(payload, length), decoded)) {
+          if (!decodeState) {
+            decodeState = _readCOSEMessage(Bytes(payload, length), decoded) ? 1 : -1;
+          }
+          if (decodeState > 0) {
             device->handle(topic, decoded);
           } else {
             UNIOT_LOG_ERROR("Failed to decode message on topic: %s", topic);
@@ -98,18 +109,23 @@ class MQTTKit : public ISchedulerConnectionKit, public CoreEventListener {
   void addDevice(MQTTDevice &device) {
     if (mDevices.pushUnique(&device)) {
       device.kit(this);
-      device.topics()->forEach([this](String topic) {
-        mPubSubClient.subscribe(topic.c_str());
-      });
+      // NOTE: while connecting, the topics are subscribed to once the connection is up
+      if (client()) {
+        device.topics()->forEach([this](String topic) {
+          mPubSubClient.subscribe(topic.c_str());
+        });
+      }
     }
   }
 
   void removeDevice(MQTTDevice &device) {
     if (mDevices.removeOne(&device)) {
       device.kit(nullptr);
-      device.topics()->forEach([this](String topic) {
-        mPubSubClient.unsubscribe(topic.c_str());
-      });
+      if (client()) {
+        device.topics()->forEach([this](String topic) {
+          mPubSubClient.unsubscribe(topic.c_str());
+        });
+      }
     }
   }
 
@@ -163,8 +179,11 @@ class MQTTKit : public ISchedulerConnectionKit, public CoreEventListener {
   }
 
  protected:
+  /**
+   * @brief Returns the client or nullptr while the network worker is connecting it, it must not be touched meanwhile.
+   */
   PubSubClient *client() {
-    return &mPubSubClient;
+    return mConnecting ? nullptr : &mPubSubClient;
   }
 
  private:
@@ -174,50 +193,82 @@ class MQTTKit : public ISchedulerConnectionKit, public CoreEventListener {
         UNIOT_LOG_DEBUG("MQTT: Network is not connected");
         return;
       }
+      if (mConnecting) {
+        self.reportActivity(false);
+        return;  // the network worker owns the client until the connection attempt is over
+      }
       if (!mPubSubClient.connected()) {
-        UNIOT_LOG_DEBUG("Attempting MQTT connection #%d...", mConnectionId);
-        Bytes packetExtention;
-        if (mInfoExtender) {
-          CBORObject packet;
-          mInfoExtender(packet);
-          packetExtention = packet.build();
-        }
-
-        CBORObject offlineCBOR(packetExtention);
-        _prepareOfflinePacket(offlineCBOR);
-        auto offlinePacket = _buildCOSEMessage(offlineCBOR.build());
-        auto password = _getUserPassword();
-        if (mPubSubClient.connect(
-                _getClientId().c_str(),
-                _getUserLogin().c_str(),
-                (const char *)password.raw(),
-                password.size(),
-                mPath.buildDevicePath("status").c_str(),
-                0,
-                true,
-                (const char *)offlinePacket.raw(),
-                offlinePacket.size(),
-                true)) {
-          CBORObject onlineCBOR(packetExtention);
-          _prepareOnlinePacket(onlineCBOR);
-          auto onlinePacket = _buildCOSEMessage(onlineCBOR.build());
-          mPubSubClient.publish(
-              mPath.buildDevicePath("status").c_str(),
-              onlinePacket.raw(),
-              onlinePacket.size(),
-              true);  // publish an announcement
-          mDevices.forEach([this](MQTTDevice *device) {
-            device->topics()->forEach([this](String topic) {
-              mPubSubClient.subscribe(topic.c_str());
-            });
-          });
-          CoreEventEmitter::emitEvent(Topic::CONNECTION, Msg::SUCCESS);
-        } else {
-          CoreEventEmitter::emitEvent(Topic::CONNECTION, Msg::FAILED);
-        }
+        _connect();
+        return;
       }
+      // NOTE: a run for the keep-alive alone must not bring the period back down
+      self.reportActivity(mWiFiClient.available() > 0);
       mPubSubClient.loop();
     });
+    mTaskMQTT->setAdaptivePeriod(10, 100);
+  }
+
+  // NOTE: the packets are built on the main loop, only the blocking connect() runs on the network worker
+  void _connect() {
+    UNIOT_LOG_DEBUG("Attempting MQTT connection #%d...", mConnectionId);
+    Bytes packetExtention;
+    if (mInfoExtender) {
+      CBORObject packet;
+      mInfoExtender(packet);
+      packetExtention = packet.build();
+    }
+
+    CBORObject offlineCBOR(packetExtention);
+    _prepareOfflinePacket(offlineCBOR);
+    auto offlinePacket = _buildCOSEMessage(offlineCBOR.build());
+    auto password = _getUserPassword();
+    auto clientId = _getClientId();
+    auto login = _getUserLogin();
+    auto statusTopic = mPath.buildDevicePath("status");
+
+    mConnecting = true;
+    auto posted = NetworkWorker::getInstance().post(
+        [this, clientId, login, password, statusTopic, offlinePacket] {
+          mConnected = mPubSubClient.connect(
+              clientId.c_str(),
+              login.c_str(),
+              (const char *)password.raw(),
+              password.size(),
+              statusTopic.c_str(),
+              0,
+              true,
+              (const char *)offlinePacket.raw(),
+              offlinePacket.size(),
+              true);
+        },
+        [this, packetExtention] {
+          mConnecting = false;
+          _onConnectFinished(packetExtention);
+        });
+    if (!posted) {
+      mConnecting = false;
+    }
+  }
+
+  void _onConnectFinished(const Bytes &packetExtention) {
+    if (!mConnected) {
+      CoreEventEmitter::emitEvent(Topic::CONNECTION, Msg::FAILED);
+      return;
+    }
+    CBORObject onlineCBOR(packetExtention);
+    _prepareOnlinePacket(onlineCBOR);
+    auto onlinePacket = _buildCOSEMessage(onlineCBOR.build());
+    mPubSubClient.publish(
+        mPath.buildDevicePath("status").c_str(),
+        onlinePacket.raw(),
+        onlinePacket.size(),
+        true);  // publish an announcement
+    mDevices.forEach([this](MQTTDevice *device) {
+      device->topics()->forEach([this](String topic) {
+        mPubSubClient.subscribe(topic.c_str());
+      });
+    });
+    CoreEventEmitter::emitEvent(Topic::CONNECTION, Msg::SUCCESS);
   }
 
   Bytes _buildCOSEMessage(const Bytes &payload, bool sign = false) {
@@ -283,6 +334,8 @@ class MQTTKit : public ISchedulerConnectionKit, public CoreEventListener {
   PubSubClient mPubSubClient;
 
   bool mNetworkConnected;
+  bool mConnecting;
+  bool mConnected;
   int mConnectionId;
 
   WiFiClient mWiFiClient;
@@ -0,0 +1,44 @@
+/*
+ * This is a part of the Uniot project.
+ * Copyright (C) 2016-2024 Uniot <contact@uniot.io>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "MemoryProfiler.h"
+
+#include <string.h>
+
+void *uniot_profiled_malloc(size_t size) {
+  return uniot::MemoryProfiler::allocate(size);
+}
+
+void *uniot_profiled_calloc(size_t count, size_t size) {
+  if (size && count > SIZE_MAX / size) {
+    return nullptr;
+  }
+  auto ptr = uniot::MemoryProfiler::allocate(count * size);
+  if (ptr) {
+    memset(ptr, 0, count * size);
+  }
+  return ptr;
+}
+
+void *uniot_profiled_realloc(void *ptr, size_t size) {
+  return uniot::MemoryProfiler::reallocate(ptr, size);
+}
+
+void uniot_profiled_free(void *ptr) {
+  uniot::MemoryProfiler::deallocate(ptr);
+}
@@ -0,0 +1,253 @@
+/*
+ * This is a part of the Uniot project.
+ * Copyright (C) 2016-2024 Uniot <contact@uniot.io>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#ifndef UNIOT_MEM_PROFILER_ENABLED
+#define UNIOT_MEM_PROFILER_ENABLED 0
+#endif
+
+#if defined(ESP8266)
+#define UNIOT_MEM_THREAD_LOCAL
+#else
+#define UNIOT_MEM_THREAD_LOCAL thread_local
+#endif
+
+namespace uniot {
+
+/**
+ * @brief Accounts the heap memory by subsystem, to trace leaks and fragmentation to a module.
+ *
+ * An allocation made through the profiler carries a small header with its size and tag, so it is charged to
+ * the subsystem that made it and credited back on free, wherever that happens. The tag is taken from the innermost
+ * Scope of the calling thread, the allocations outside of any scope are UNTAGGED.
+ * The memory that the libraries allocate on their own is accounted explicitly (e.g. the Lisp heap).
+ *
+ * With UNIOT_MEM_PROFILER_ENABLED the payloads of Bytes and the chunks of the node pools go through the profiler,
+ * the C libraries can be built on the uniot_profiled_* functions. Other allocations are not seen.
+ */
+class MemoryProfiler {
+ public:
+  enum Tag : uint8_t { UNTAGGED = 0, CBOR, LISP, MQTT, QUEUE, USER, TAGS_COUNT };
+
+  struct Stats {
+    size_t liveBytes;
+    size_t peakBytes;
+    uint32_t liveCount;
+    uint32_t allocationsCount;  // since the start, the live ones included
+  };
+
+  /**
+   * @brief Tags the allocations made by the thread until its destruction.
+   */
+  class Scope {
+   public:
+    Scope(Tag tag) : mPrevious(sCurrent) {
+      sCurrent = tag;
+    }
+
+    ~Scope() {
+      sCurrent = mPrevious;
+    }
+
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+
+   private:
+    Tag mPrevious;
+  };
+
+  MemoryProfiler() = delete;
+
+  static void *allocate(size_t size) {
+    auto header = static_cast<Header *>(malloc(sizeof(Header) + size));
+    if (!header) {
+      return nullptr;
+    }
+    header->size = size;
+    header->tag = sCurrent;
+    account(sCurrent, size);
+    return header + 1;
+  }
+
+  static void *reallocate(void *ptr, size_t size) {
+    if (!ptr) {
+      return allocate(size);
+    }
+    if (!size) {
+      deallocate(ptr);
+      return nullptr;
+    }
+    auto header = static_cast<Header *>(ptr) - 1;
+    auto oldSize = header->size;
+    header = static_cast<Header *>(realloc(header, sizeof(Header) + size));
+    if (!header) {
+      return nullptr;
+    }
+    header->size = size;
+    // NOTE: the block stays with the subsystem that allocated it
+    auto &stats = sStats[header->tag];
+    if (size > oldSize) {
+      _updatePeak(stats, _add(stats.liveBytes, size - oldSize));
+    } else {
+      _sub(stats.liveBytes, oldSize - size);
+    }
+    return header + 1;
+  }
+
+  static void deallocate(void *ptr) {
+    if (!ptr) {
+      return;
+    }
+    auto header = static_cast<Header *>(ptr) - 1;
+    release(static_cast<Tag>(header->tag), header->size);
+    free(header);
+  }
+
+  /**
+   * @brief Charges the memory allocated outside of the profiler to the subsystem.
+   */
+  static void account(Tag tag, size_t size) {
+    auto &stats = sStats[tag < TAGS_COUNT ? tag : UNTAGGED];
+    _updatePeak(stats, _add(stats.liveBytes, size));
+    _add(stats.liveCount, 1U);
+    _add(stats.allocationsCount, 1U);
+  }
+
+  static void release(Tag tag, size_t size) {
+    auto &stats = sStats[tag < TAGS_COUNT ? tag : UNTAGGED];
+    _sub(stats.liveBytes, size);
+    _sub(stats.liveCount, 1U);
+  }
+
+  static Tag current() {
+    return sCurrent;
+  }
+
+  static Stats getStats(Tag tag) {
+    return sStats[tag < TAGS_COUNT ? tag : UNTAGGED];
+  }
+
+  static size_t getTotalLiveBytes() {
+    size_t total = 0;
+    for (auto &stats : sStats) {
+      total += stats.liveBytes;
+    }
+    return total;
+  }
+
+  static const char *getName(Tag tag) {
+    static const char *names[] = {"untagged", "cbor", "lisp", "mqtt", "queue", "user"};
+    return names[tag < TAGS_COUNT ? tag : UNTAGGED];
+  }
+
+  /**
+   * @brief Starts the peaks over from the current live bytes, e.g. to measure a single operation.
+   */
+  static void resetPeaks() {
+    for (auto &stats : sStats) {
+      stats.peakBytes = stats.liveBytes;
+    }
+  }
+
+  /**
+   * @brief Calls the callback with the name and the stats of each subsystem that has allocated anything.
+   */
+  template <typename Callback>
+  static void exportStats(Callback callback) {
+    for (uint8_t tag = 0; tag < TAGS_COUNT; tag++) {
+      auto stats = getStats(static_cast<Tag>(tag));
+      if (stats.allocationsCount) {
+        callback(getName(static_cast<Tag>(tag)), stats);
+      }
+    }
+  }
+
+ private:
+  // NOTE: the header keeps the payload aligned as malloc() would
+  struct alignas(max_align_t) Header {
+    size_t size;
+    uint8_t tag;
+  };
+
+  // NOTE: ESP8266 has no threads and no atomic read-modify-write instructions, the counters are plain there
+  template <typename T>
+  static inline T _add(T &counter, T value) {
+#if defined(ESP8266)
+    return counter += value;
+#else
+    return __atomic_add_fetch(&counter, value, __ATOMIC_RELAXED);
+#endif
+  }
+
+  template <typename T>
+  static inline T _sub(T &counter, T value) {
+#if defined(ESP8266)
+    return counter -= value;
+#else
+    return __atomic_sub_fetch(&counter, value, __ATOMIC_RELAXED);
+#endif
+  }
+
+  static inline void _updatePeak(Stats &stats, size_t liveBytes) {
+#if defined(ESP8266)
+    stats.peakBytes = liveBytes > stats.peakBytes ? liveBytes : stats.peakBytes;
+#else
+    auto peak = __atomic_load_n(&stats.peakBytes, __ATOMIC_RELAXED);
+    while (liveBytes > peak && !__atomic_compare_exchange_n(&stats.peakBytes, &peak, liveBytes, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+#endif
+  }
+
+  static inline Stats sStats[TAGS_COUNT] = {};
+  static inline UNIOT_MEM_THREAD_LOCAL Tag sCurrent = UNTAGGED;
+};
+
+}  // namespace uniot
+
+// NOTE: the C entry points let the C libraries (e.g. the CBOR nodes) be accounted, under the scope of the caller
+extern "C" {
+void *uniot_profiled_malloc(size_t size);
+void *uniot_profiled_calloc(size_t count, size_t size);
+void *uniot_profiled_realloc(void *ptr, size_t size);
+void uniot_profiled_free(void *ptr);
+}
+
+#define UNIOT_MEM_CONCAT_IMPL(a, b) a##b
+#define UNIOT_MEM_CONCAT(a, b) UNIOT_MEM_CONCAT_IMPL(a, b)
+
+#if UNIOT_MEM_PROFILER_ENABLED
+#define UNIOT_MEM_SCOPE(tag) \
+  uniot::MemoryProfiler::Scope UNIOT_MEM_CONCAT(_memScope, __LINE__)(uniot::MemoryProfiler::tag)
+#define UNIOT_MEM_ACCOUNT(tag, size) uniot::MemoryProfiler::account(uniot::MemoryProfiler::tag, size)
+#define UNIOT_MEM_RELEASE(tag, size) uniot::MemoryProfiler::release(uniot::MemoryProfiler::tag, size)
+#define UNIOT_MEM_MALLOC(size) uniot::MemoryProfiler::allocate(size)
+#define UNIOT_MEM_REALLOC(ptr, size) uniot::MemoryProfiler::reallocate(ptr, size)
+#define UNIOT_MEM_FREE(ptr) uniot::MemoryProfiler::deallocate(ptr)
+#else
+#define UNIOT_MEM_SCOPE(...) do {} while (0)
+#define UNIOT_MEM_ACCOUNT(...) do {} while (0)
+#define UNIOT_MEM_RELEASE(...) do {} while (0)
+#define UNIOT_MEM_MALLOC(size) malloc(size)
+#define UNIOT_MEM_REALLOC(ptr, size) realloc(ptr, size)
+#define UNIOT_MEM_FREE(ptr) free(ptr)
+#endif
@@ -71,6 +71,10 @@ namespace uniot {
       mIsStarted = false;
     }
 
+    bool isStarted() const {
+      return mIsStarted;
+    }
+
     WebServer* get() {
       return mpWebServer.get();
     }
@@ -86,6 +90,12 @@ namespace uniot {
       }
     }
 
+    // NOTE: the servers do not report the requests they handle, so only an open HTTP connection counts as work
+    virtual bool process(short times) override {
+      execute(times);
+      return mIsStarted && mpWebServer->client().connected();
+    }
+
   private:
     bool mIsStarted;
 
@@ -167,6 +167,8 @@ class NetworkController : public ISchedulerConnectionKit, public CoreEventListen
         digitalWrite(mPinLed, signalLevel ? mActiveLevelLed : !mActiveLevelLed);
       }
     });
+    mpTaskSignalLed->setSlack(100);
+    mpTaskSignalLed->setSheddable(true);
 
     if (_hasButton()) {
       mpTaskConfigBtn = TaskScheduler::make(*mpConfigBtn);
@@ -28,6 +28,7 @@
 #include <Common.h>
 #include <Credentials.h>
 #include <TaskScheduler.h>
+#include <StateMachine.h>
 #include <EventBus.h>
 #include <EventEmitter.h>
 #include <ConfigCaptivePortal.h>
@@ -49,7 +50,10 @@ namespace uniot {
     NetworkScheduler(Credentials &credentials)
         : mpCredentials(&credentials),
           mApSubnet(255, 255, 255, 0),
-          mConfigServer(IPAddress(1, 1, 1, 1))
+          mConfigServer(IPAddress(1, 1, 1, 1)),
+          mConnectTries(0),
+          mApStarted(false),
+          mStaStarted(false)
     {
       mApName = "UNIOT-" + String(mpCredentials->getShortDeviceId(), HEX);
       mApName.toUpperCase();
@@ -65,132 +69,131 @@ namespace uniot {
     }
 
     virtual void pushTo(TaskScheduler &scheduler) override {
-      scheduler.push("server_start", mTaskStart);
+      scheduler.push("network", mNetwork.task());
       scheduler.push("server_serve", mTaskServe);
-      scheduler.push("server_stop", mTaskStop);
-      scheduler.push("ap_config", mTaskConfigAp);
-      scheduler.push("sta_connect", mTaskConnectSta);
-      scheduler.push("sta_connecting", mTaskConnecting);
-      scheduler.push("wifi_monitor", mTaskMonitoring);
     }
 
     virtual void attach() override {
       mWifiStorage.restore();
-      if(mWifiStorage.isCredentialsValid()) {
-        mTaskConnectSta->attach(500, 1);
-      } else {
-        mTaskConfigAp->attach(500, 1);
-      }
+      mConnectTries = 0;
+      mNetwork.start(mWifiStorage.isCredentialsValid() ? STA_CONNECT : AP_CONFIG);
     }
 
     void forget() {
       mWifiStorage.clean();
-      mTaskConfigAp->attach(500, 1);
+      mNetwork.dispatch(FORGET);
     }
 
     bool reconnect() {
       if(mWifiStorage.isCredentialsValid()) {
-        mTaskConfigAp->detach();
-        mTaskConnectSta->attach(500, 1);
+        mNetwork.dispatch(RECONNECT);
         return true;
       }
       return false;
     }
 
   private:
+    enum State : StateMachine::State { AP_CONFIG = 0, AP_SERVE, STA_CONNECT, STA_CONNECTING, STA_CONNECTED, STA_LOST };
+    enum Event : StateMachine::Event { FORGET = 0, RECONNECT };
+
+    static constexpr int TRIES_BEFORE_GIVING_UP = 3;
+    static constexpr uint32_t CONNECTING_TIMEOUT_MS = 10000;
+    static constexpr uint32_t RETRY_DELAY_MS = 500;
+
     void _initTasks() {
-      mTaskStart = TaskScheduler::make([this](SchedulerTask &self, short t) {
-        if(mConfigServer.start()) {
-          mTaskServe->attach(10);
-        }
-      });
       mTaskServe = TaskScheduler::make(mConfigServer);
-      mTaskStop = TaskScheduler::make([this](SchedulerTask &self, short t) {
-        mTaskServe->detach();
-        mConfigServer.stop();
-      });
+      mTaskServe->setAdaptivePeriod(10, 100);
+
+      mNetwork
+          .state(AP_CONFIG, "ap_config", [this] { mApStarted = _startAccessPoint(); })
+          .state(AP_SERVE, "ap_serve", [this] {
+            if(mConfigServer.start()) {
+              mTaskServe->attach(10);
+            }
+          })
+          .state(STA_CONNECT, "sta_connect", [this] { mStaStarted = _beginStation(); })
+          .state(STA_CONNECTING, "sta_connecting", nullptr, 100)
+          .state(STA_CONNECTED, "sta_connected", [this] { _onConnected(); }, 2000, 1000)
+          .state(STA_LOST, "sta_lost", [this] {
+            CoreEventEmitter::emitEvent(Topic::CONNECTION, Msg::DISCONNECTED);
+          });
+
+      mNetwork
+          .on(StateMachine::ANY_STATE, FORGET, AP_CONFIG)
+          .on(StateMachine::ANY_STATE, RECONNECT, STA_CONNECT, nullptr, [this] { mConnectTries = 0; })
+          .when(AP_CONFIG, [this] { return mApStarted; }, AP_SERVE)
+          .after(AP_CONFIG, RETRY_DELAY_MS, AP_CONFIG)
+          .after(AP_SERVE, RETRY_DELAY_MS, AP_SERVE, nullptr, [this] { return !mConfigServer.isStarted(); })
+          .when(STA_CONNECT, [this] { return mStaStarted; }, STA_CONNECTING)
+          .after(STA_CONNECT, RETRY_DELAY_MS, STA_CONNECT)
+          .when(STA_CONNECTING, [] { return WiFi.status() == WL_CONNECTED; }, STA_CONNECTED)
+          .when(STA_CONNECTING, [this] { return _hasConnectionFailed() && _canRetry(); }, STA_CONNECT, [this] { _onRetry(); })
+          .when(STA_CONNECTING, [this] { return _hasConnectionFailed(); }, AP_CONFIG, [this] { _onGiveUp(); })
+          .after(STA_CONNECTING, CONNECTING_TIMEOUT_MS, STA_CONNECT, [this] { _onRetry(); }, [this] { return _canRetry(); })
+          .after(STA_CONNECTING, CONNECTING_TIMEOUT_MS, AP_CONFIG, [this] { _onGiveUp(); })
+          .when(STA_CONNECTED, [] { return WiFi.status() != WL_CONNECTED; }, STA_LOST);
+    }
 
-      mTaskConfigAp = TaskScheduler::make([this](SchedulerTask &self, short t) {
-        WiFi.disconnect(true);
-        WiFi.softAPdisconnect(true);
-        if( WiFi.softAPConfig(mConfigServer.ip(), mConfigServer.ip(),  mApSubnet)
-          && WiFi.softAP(mApName.c_str()))
-        {
+    bool _startAccessPoint() {
+      WiFi.disconnect(true);
+      WiFi.softAPdisconnect(true);
+      if( WiFi.softAPConfig(mConfigServer.ip(), mConfigServer.ip(),  mApSubnet)
+        && WiFi.softAP(mApName.c_str()))
+      {
 #if defined(ESP32) && defined(ENABLE_LOWER_WIFI_TX_POWER)
-          WiFi.setTxPower(WIFI_TX_POWER_LEVEL);
+        WiFi.setTxPower(WIFI_TX_POWER_LEVEL);
 #endif
-          mTaskStart->attach(500, 1);
-          CoreEventEmitter::sendDataToChannel(Channel::OUT_SSID, Bytes(mApName));
-          CoreEventEmitter::emitEvent(Topic::CONNECTION, Msg::ACCESS_POINT);
-        } else {
-          UNIOT_LOG_WARN("NetworkScheduler, mTaskConfigAp failed");
-          mTaskConfigAp->attach(500, 1);
-        }
-      });
-      mTaskConnectSta = TaskScheduler::make([this](SchedulerTask &self, short t) {
-        WiFi.disconnect(true, true);
-        bool disconect = true;
-        WiFi.softAPdisconnect(true); // !!!!!!!!!!!!
-        WiFi.setHostname(mApName.c_str());
-        bool connect = WiFi.begin(mWifiStorage.getSsid().c_str(), mWifiStorage.getPassword().c_str()) != WL_CONNECT_FAILED;
-        if (disconect && connect)
-        {
+        CoreEventEmitter::sendDataToChannel(Channel::OUT_SSID, Bytes(mApName));
+        CoreEventEmitter::emitEvent(Topic::CONNECTION, Msg::ACCESS_POINT);
+        return true;
+      }
+      UNIOT_LOG_WARN("NetworkScheduler, failed to start the access point");
+      return false;
+    }
+
+    bool _beginStation() {
+      WiFi.disconnect(true, true);
+      WiFi.softAPdisconnect(true); // !!!!!!!!!!!!
+      WiFi.setHostname(mApName.c_str());
+      if(WiFi.begin(mWifiStorage.getSsid().c_str(), mWifiStorage.getPassword().c_str()) != WL_CONNECT_FAILED)
+      {
 #if defined(ESP32) && defined(ENABLE_LOWER_WIFI_TX_POWER)
-          WiFi.setTxPower(WIFI_TX_POWER_LEVEL);
+        WiFi.setTxPower(WIFI_TX_POWER_LEVEL);
 #endif
-          mTaskServe->detach();
-          mTaskConnecting->attach(100, 100);
-          CoreEventEmitter::sendDataToChannel(Channel::OUT_SSID, Bytes(mWifiStorage.getSsid()));
-          CoreEventEmitter::emitEvent(Topic::CONNECTION, Msg::CONNECTING);
-        }
-      });
-      mTaskConnecting = TaskScheduler::make([this](SchedulerTask &self, short times) {
-        auto __processFailure = [this]() {
-          const int triesBeforeGivingUp = 3;
-          static int tries = 0;
-          if(++tries < triesBeforeGivingUp) {
-            UNIOT_LOG_INFO("Tries to connect until give up is %d", triesBeforeGivingUp - tries);
-            mTaskConnectSta->attach(500, 1);
-          } else {
-            tries = 0;
-            mTaskConfigAp->attach(500, 1);
-            CoreEventEmitter::emitEvent(Topic::CONNECTION, Msg::FAILED);
-          }
-        };
-
-        switch(WiFi.status()){
-          case WL_CONNECTED:
-          mTaskConnecting->detach();
-          mTaskStop->attach(500, 1);
-          mTaskMonitoring->attach(2000);
-          mWifiStorage.store();
-          mpCredentials->store(); // NOTE: it is stored each time it is connected to the network
-          CoreEventEmitter::emitEvent(Topic::CONNECTION, Msg::SUCCESS);
-          break;
-
-          case WL_NO_SSID_AVAIL:
-          case WL_CONNECT_FAILED:
-          mTaskConnecting->detach();
-          __processFailure();
-          break;
-
-          case WL_DISCONNECTED:
-          if(!times) {
-            __processFailure();
-          }
-          break;
-
-          case WL_IDLE_STATUS:
-          default:
-          break;
-        }
-      });
-      mTaskMonitoring = TaskScheduler::make([this](SchedulerTask &self, short times) {
-        if(WiFi.status() != WL_CONNECTED) {
-          mTaskMonitoring->detach();
-          CoreEventEmitter::emitEvent(Topic::CONNECTION, Msg::DISCONNECTED);
-        }
-      });
+        mTaskServe->detach();
+        CoreEventEmitter::sendDataToChannel(Channel::OUT_SSID, Bytes(mWifiStorage.getSsid()));
+        CoreEventEmitter::emitEvent(Topic::CONNECTION, Msg::CONNECTING);
+        return true;
+      }
+      return false;
+    }
+
+    bool _hasConnectionFailed() {
+      auto status = WiFi.status();
+      return status == WL_NO_SSID_AVAIL || status == WL_CONNECT_FAILED;
+    }
+
+    bool _canRetry() {
+      return mConnectTries + 1 < TRIES_BEFORE_GIVING_UP;
+    }
+
+    void _onRetry() {
+      mConnectTries++;
+      UNIOT_LOG_INFO("Tries to connect until give up is %d", TRIES_BEFORE_GIVING_UP - mConnectTries);
+    }
+
+    void _onGiveUp() {
+      mConnectTries = 0;
+      CoreEventEmitter::emitEvent(Topic::CONNECTION, Msg::FAILED);
+    }
+
+    void _onConnected() {
+      mConnectTries = 0;
+      mTaskServe->detach();
+      mConfigServer.stop();
+      mWifiStorage.store();
+      mpCredentials->store(); // NOTE: it is stored each time it is connected to the network
+      CoreEventEmitter::emitEvent(Topic::CONNECTION, Msg::SUCCESS);
     }
 
     void _initServerCallbacks() {
@@ -223,7 +226,7 @@ namespace uniot {
         mConfigServer.get()->sendHeader("Location", "/", true);
         mConfigServer.get()->send_P(307, text, text);
         if(mWifiStorage.isCredentialsValid()) {
-          mTaskConnectSta->attach(500, 1);
+          mNetwork.dispatch(RECONNECT);
           mpCredentials->setOwnerId(mConfigServer.get()->arg("acc"));
         }
       });
@@ -236,12 +239,10 @@ namespace uniot {
     IPAddress mApSubnet;
     ConfigCaptivePortal mConfigServer;
 
-    TaskScheduler::TaskPtr mTaskStart;
+    StateMachine mNetwork;
     TaskScheduler::TaskPtr mTaskServe;
-    TaskScheduler::TaskPtr mTaskStop;
-    TaskScheduler::TaskPtr mTaskConfigAp;
-    TaskScheduler::TaskPtr mTaskConnectSta;
-    TaskScheduler::TaskPtr mTaskConnecting;
-    TaskScheduler::TaskPtr mTaskMonitoring;
+    int mConnectTries;
+    bool mApStarted;
+    bool mStaStarted;
   };
 }
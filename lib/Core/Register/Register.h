@@ -152,11 +152,8 @@ class Register {
   void iterateRegisters(IteratorCallback callback) const {
     if (!callback) return;
 
-    mRegisterMap.begin();
-    while (!mRegisterMap.isEnd()) {
-      auto& item = mRegisterMap.current();
+    for (auto& item : mRegisterMap) {
       callback(item.first, item.second);
-      mRegisterMap.next();
     }
   }
 
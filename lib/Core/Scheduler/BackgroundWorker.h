@@ -0,0 +1,307 @@
+/*
+ * This is a part of the Uniot project.
+ * Copyright (C) 2016-2024 Uniot <contact@uniot.io>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <Arduino.h>
+#include <IExecutor.h>
+#include <LockFreeQueue.h>
+#include <Logger.h>
+#include <Singleton.h>
+#include <TaskScheduler.h>
+
+// NOTE: ESP8266 has a single core and no preemptive threads, so the jobs always run on the main loop there
+#if !defined(ESP8266)
+#if defined(ESP32)
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#else
+#include <thread>
+#endif
+#include <condition_variable>
+#include <mutex>
+#endif
+
+#include <atomic>
+#include <functional>
+
+// run the blocking network operations on a thread of their own instead of the main loop
+#ifndef UNIOT_NETWORK_WORKER_THREAD
+#define UNIOT_NETWORK_WORKER_THREAD 0
+#endif
+
+#ifndef UNIOT_NETWORK_WORKER_CORE
+#define UNIOT_NETWORK_WORKER_CORE 0
+#endif
+
+// a TLS handshake needs a large stack
+#ifndef UNIOT_NETWORK_WORKER_STACK_SIZE
+#define UNIOT_NETWORK_WORKER_STACK_SIZE 8192
+#endif
+
+#ifndef UNIOT_BACKGROUND_WORKER_QUEUE_SIZE
+#define UNIOT_BACKGROUND_WORKER_QUEUE_SIZE 4
+#endif
+
+// how often the main loop looks for the finished jobs while any is in flight
+#ifndef UNIOT_BACKGROUND_WORKER_POLL_MS
+#define UNIOT_BACKGROUND_WORKER_POLL_MS 10
+#endif
+
+namespace uniot {
+
+/**
+ * @brief Runs blocking jobs, e.g. a connection to a server, away from the cooperative main loop.
+ *
+ * A job is posted together with a completion. The job runs on the worker: a FreeRTOS task pinned to a core on ESP32
+ * or a std::thread on the host. The completion then runs on the main loop, from the task of the worker,
+ * so the results are handed over there and the control logic never waits on the network.
+ * The jobs and the completions travel through lock-free queues, the slots are only claimed and released by the main loop.
+ *
+ * Without a thread (ESP8266, or when it is not asked for) the jobs run on the main loop, one per run of the task,
+ * so the code that posts them does not have to care where they run.
+ */
+class BackgroundWorker : public IExecutor {
+ public:
+  using Job = std::function<void()>;
+  using Done = std::function<void()>;
+
+  BackgroundWorker(bool threaded)
+      : mTask(*this),
+#if !defined(ESP8266)
+        mThreaded(threaded),
+#else
+        mThreaded(false),
+#endif
+        mRunning(false),
+        mAlive(false),
+        mEpoch(0),
+        mInFlight(0),
+        mDoneCount(0) {
+  }
+
+  virtual ~BackgroundWorker() {
+    _stop();
+  }
+
+  SchedulerTask &task() {
+    return mTask;
+  }
+
+  /**
+   * @brief Queues a job. Must only be called from the main loop.
+   *
+   * @param job Runs on the worker, so it must not touch the state of the main loop (the event bus, the scheduler, the devices).
+   * @param done Runs on the main loop once the job has finished.
+   * @return false if all the slots are taken.
+   */
+  bool post(Job job, Done done = nullptr) {
+    if (!job) {
+      return false;
+    }
+    uint8_t slot = 0;
+    while (slot < UNIOT_BACKGROUND_WORKER_QUEUE_SIZE && mSlots[slot].used) {
+      slot++;
+    }
+    if (slot == UNIOT_BACKGROUND_WORKER_QUEUE_SIZE) {
+      UNIOT_LOG_WARN("background worker: the queue is full");
+      return false;
+    }
+    if (mThreaded && !_start()) {
+      UNIOT_LOG_ERROR("background worker: failed to start the thread, the jobs run on the main loop");
+      mThreaded = false;
+    }
+
+    auto &entry = mSlots[slot];
+    entry.job = job;
+    entry.done = done;
+    entry.used = true;
+    mInFlight++;
+    // NOTE: there are as many places in the queues as there are slots, so a claimed slot always fits
+    mRequests.push(slot);
+    _wake();
+    if (!mTask.isAttached()) {
+      mTask.attach(UNIOT_BACKGROUND_WORKER_POLL_MS);
+    }
+    return true;
+  }
+
+  bool isThreaded() const {
+    return mThreaded;
+  }
+
+  /**
+   * @brief Returns the number of jobs whose completions have not run yet.
+   */
+  size_t getInFlightCount() const {
+    return mInFlight;
+  }
+
+  uint32_t getDoneCount() const {
+    return mDoneCount;
+  }
+
+  virtual void execute(short _) override {
+    uint8_t slot;
+    if (!mThreaded && mRequests.pop(slot)) {
+      _run(slot);
+    }
+    while (mCompleted.pop(slot)) {
+      auto &entry = mSlots[slot];
+      auto done = entry.done;
+      // NOTE: the captures of the job are released here, on the main loop, where they were made
+      entry.job = nullptr;
+      entry.done = nullptr;
+      entry.used = false;
+      mInFlight--;
+      mDoneCount++;
+      if (done) {
+        done();
+      }
+    }
+    if (!mInFlight) {
+      mTask.detach();
+    }
+  }
+
+ private:
+  struct Slot {
+    Job job;
+    Done done;
+    bool used = false;
+  };
+
+  void _run(uint8_t slot) {
+    mSlots[slot].job();
+    mCompleted.push(slot);
+  }
+
+#if !defined(ESP8266)
+  bool _start() {
+    if (mRunning) {
+      return true;
+    }
+    mRunning = true;
+    mAlive = true;
+#if defined(ESP32)
+    auto spawned = xTaskCreatePinnedToCore(
+                       [](void *arg) {
+                         auto self = static_cast<BackgroundWorker *>(arg);
+                         self->_work();
+                         self->mAlive = false;
+                         vTaskDelete(nullptr);
+                       },
+                       "uniot_worker", UNIOT_NETWORK_WORKER_STACK_SIZE, this, tskIDLE_PRIORITY + 1,
+                       nullptr, UNIOT_NETWORK_WORKER_CORE) == pdPASS;
+    if (!spawned) {
+      mRunning = false;
+      mAlive = false;
+    }
+    return spawned;
+#else
+    mThread = std::thread([this] {
+      _work();
+      mAlive = false;
+    });
+    return true;
+#endif
+  }
+
+  void _stop() {
+    if (!mRunning) {
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> lock(mWakeMutex);
+      mRunning = false;
+    }
+    mWakeCondition.notify_all();
+#if defined(ESP32)
+    // NOTE: the FreeRTOS task deletes itself, a running job is waited for
+    while (mAlive) {
+      vTaskDelay(1);
+    }
+#else
+    if (mThread.joinable()) {
+      mThread.join();
+    }
+#endif
+  }
+
+  void _work() {
+    while (mRunning) {
+      // NOTE: the epoch is read before looking for a job, so a wake-up in between is not lost
+      auto epoch = mEpoch.load();
+      uint8_t slot;
+      if (mRequests.pop(slot)) {
+        _run(slot);
+        continue;
+      }
+      std::unique_lock<std::mutex> lock(mWakeMutex);
+      mWakeCondition.wait(lock, [&] { return !mRunning || mEpoch != epoch; });
+    }
+  }
+
+  void _wake() {
+    if (mThreaded) {
+      std::lock_guard<std::mutex> lock(mWakeMutex);
+      mEpoch++;
+      mWakeCondition.notify_one();
+    }
+  }
+
+  std::mutex mWakeMutex;
+  std::condition_variable mWakeCondition;
+#if !defined(ESP32)
+  std::thread mThread;
+#endif
+#else
+  bool _start() {
+    return false;
+  }
+
+  void _stop() {}
+
+  void _wake() {}
+#endif
+
+  SchedulerTask mTask;
+  bool mThreaded;
+  std::atomic<bool> mRunning;
+  std::atomic<bool> mAlive;
+  std::atomic<uint32_t> mEpoch;
+
+  Slot mSlots[UNIOT_BACKGROUND_WORKER_QUEUE_SIZE];
+  LockFreeQueue<uint8_t, UNIOT_BACKGROUND_WORKER_QUEUE_SIZE> mRequests;
+  LockFreeQueue<uint8_t, UNIOT_BACKGROUND_WORKER_QUEUE_SIZE> mCompleted;
+  size_t mInFlight;
+  uint32_t mDoneCount;
+};
+
+/**
+ * @brief The worker shared by the blocking network operations: the MQTT connection and the NTP request.
+ * Its task must be pushed to the scheduler, see UniotCore::begin().
+ */
+class NetworkWorker : public BackgroundWorker, public Singleton<NetworkWorker> {
+  friend class Singleton<NetworkWorker>;
+
+ private:
+  NetworkWorker() : BackgroundWorker(UNIOT_NETWORK_WORKER_THREAD) {}
+};
+
+}  // namespace uniot
@@ -0,0 +1,283 @@
+/*
+ * This is a part of the Uniot project.
+ * Copyright (C) 2016-2024 Uniot <contact@uniot.io>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <Arduino.h>
+#include <Array.h>
+#include <IExecutor.h>
+#include <TaskScheduler.h>
+#include <time.h>
+
+#include <functional>
+
+// the longest time the calendar sleeps without looking at the clock, so that a jump of the clock is noticed
+#ifndef UNIOT_CALENDAR_MAX_SLEEP_MS
+#define UNIOT_CALENDAR_MAX_SLEEP_MS (60 * 60 * 1000UL)
+#endif
+
+// a difference between the wall clock and the elapsed time larger than this is treated as a jump of the clock
+#ifndef UNIOT_CALENDAR_JUMP_TOLERANCE_S
+#define UNIOT_CALENDAR_JUMP_TOLERANCE_S 10
+#endif
+
+namespace uniot {
+
+/**
+ * @brief Runs callbacks at wall-clock times, e.g. every day at 07:00 or every hour on the hour.
+ *
+ * The next fire time of each entry is computed directly from the rule, and the task sleeps until the nearest one,
+ * so an entry costs a single wakeup per event instead of polling the clock.
+ * Nothing runs until the clock has been set (see MIN_VALID_EPOCH). The plan must be renewed with replan()
+ * when the clock is synchronized; a jump of the clock that goes unannounced is noticed on the next wakeup,
+ * the occurrences skipped by a jump forward are not run.
+ * The times are in UTC, as the clock of Date is.
+ */
+class Calendar : public IExecutor {
+ public:
+  using Clock = time_t (*)();
+  using Callback = std::function<void(time_t)>;
+  using EntryId = uint8_t;
+
+  static constexpr time_t MIN_VALID_EPOCH = 1577836800;  // 2020-01-01, an earlier clock has not been set yet
+  static constexpr EntryId INVALID_ENTRY = 0;
+  static constexpr uint8_t EVERY_WEEKDAY = 0x7F;
+
+  /**
+   * @brief A cron-like rule: the minute and the hour, -1 for any, and the days of the week, bit 0 is Sunday.
+   */
+  struct Rule {
+    int8_t minute;
+    int8_t hour;
+    uint8_t weekdays;
+
+    static Rule daily(int8_t hour, int8_t minute) {
+      return {minute, hour, EVERY_WEEKDAY};
+    }
+
+    static Rule hourly(int8_t minute = 0) {
+      return {minute, -1, EVERY_WEEKDAY};
+    }
+
+    bool isValid() const {
+      return minute >= -1 && minute < 60 && hour >= -1 && hour < 24 && (weekdays & EVERY_WEEKDAY);
+    }
+
+    /**
+     * @brief Returns the first time matching the rule strictly after the given one, or 0 if the rule never matches.
+     */
+    time_t next(time_t after) const {
+      if (!isValid()) {
+        return 0;
+      }
+      time_t first = after - after % 60 + 60;
+      time_t day = first / SECONDS_PER_DAY;
+      int fromMinute = (first % SECONDS_PER_DAY) / 60;
+      for (auto d = 0; d < 8; d++, day++, fromMinute = 0) {
+        // NOTE: 1970-01-01 was a Thursday
+        if (weekdays & (1 << ((day + 4) % 7))) {
+          auto minuteOfDay = _firstMinuteOfDay(fromMinute);
+          if (minuteOfDay >= 0) {
+            return day * SECONDS_PER_DAY + minuteOfDay * 60;
+          }
+        }
+      }
+      return 0;
+    }
+
+   private:
+    static constexpr time_t SECONDS_PER_DAY = 24 * 60 * 60;
+
+    int _firstMinuteOfDay(int fromMinute) const {
+      for (auto h = fromMinute / 60; h < 24; h++) {
+        if (hour >= 0 && hour != h) {
+          continue;
+        }
+        auto fromMinuteOfHour = h == fromMinute / 60 ? fromMinute % 60 : 0;
+        if (minute < 0) {
+          return h * 60 + fromMinuteOfHour;
+        }
+        if (minute >= fromMinuteOfHour) {
+          return h * 60 + minute;
+        }
+      }
+      return -1;
+    }
+  };
+
+  Calendar(Clock clock)
+      : mClock(clock),
+        mTask(*this),
+        mPlannedEpoch(0),
+        mPlannedMs(0),
+        mFiredCount(0),
+        mExecuting(false) {}
+
+  SchedulerTask &task() {
+    return mTask;
+  }
+
+  /**
+   * @brief Adds an entry, the callback gets the planned time of the occurrence.
+   *
+   * @return The identifier of the entry or INVALID_ENTRY if the rule is not valid.
+   */
+  EntryId add(const Rule &rule, Callback callback) {
+    if (!rule.isValid() || !callback) {
+      return INVALID_ENTRY;
+    }
+    size_t index = 0;
+    while (index < mEntries.size() && mEntries[index].callback) {
+      index++;
+    }
+    if (index >= UINT8_MAX || (index == mEntries.size() && !mEntries.push(Entry()))) {
+      return INVALID_ENTRY;
+    }
+    auto &entry = mEntries[index];
+    entry.rule = rule;
+    entry.callback = callback;
+    entry.nextEpoch = 0;
+    replan();
+    return index + 1;
+  }
+
+  bool remove(EntryId id) {
+    if (id == INVALID_ENTRY || id > mEntries.size() || !mEntries[id - 1].callback) {
+      return false;
+    }
+    // NOTE: the slot is only released, so that an entry can remove itself from its callback
+    mEntries[id - 1].callback = nullptr;
+    replan();
+    return true;
+  }
+
+  void clear() {
+    for (size_t i = 0; i < mEntries.size(); i++) {
+      mEntries[i].callback = nullptr;
+    }
+    mTask.detach();
+  }
+
+  bool isEmpty() const {
+    for (size_t i = 0; i < mEntries.size(); i++) {
+      if (mEntries[i].callback) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  /**
+   * @brief Computes the next occurrence of every entry from the current time, e.g. after the clock is synchronized.
+   */
+  void replan() {
+    if (!mExecuting) {
+      _plan(mClock());
+    }
+  }
+
+  /**
+   * @brief Returns the nearest planned occurrence or 0 if nothing is planned.
+   */
+  time_t getNextEpoch() const {
+    time_t nearest = 0;
+    for (size_t i = 0; i < mEntries.size(); i++) {
+      auto &entry = mEntries[i];
+      if (entry.callback && entry.nextEpoch && (!nearest || entry.nextEpoch < nearest)) {
+        nearest = entry.nextEpoch;
+      }
+    }
+    return nearest;
+  }
+
+  uint32_t getFiredCount() const {
+    return mFiredCount;
+  }
+
+  virtual void execute(short _) override {
+    auto now = mClock();
+    time_t expected = mPlannedEpoch + static_cast<uint32_t>(millis() - mPlannedMs) / 1000;
+    if (!mPlannedEpoch || now < expected - UNIOT_CALENDAR_JUMP_TOLERANCE_S || now > expected + UNIOT_CALENDAR_JUMP_TOLERANCE_S) {
+      _plan(now);
+      return;
+    }
+
+    mExecuting = true;
+    for (size_t i = 0; i < mEntries.size(); i++) {
+      auto &entry = mEntries[i];
+      if (entry.callback && entry.nextEpoch && entry.nextEpoch <= now) {
+        auto plannedEpoch = entry.nextEpoch;
+        entry.nextEpoch = entry.rule.next(now);
+        mFiredCount++;
+        // NOTE: a copy, the callback may add or remove entries
+        auto callback = entry.callback;
+        callback(plannedEpoch);
+      }
+    }
+    mExecuting = false;
+    _plan(now, false);
+  }
+
+ private:
+  struct Entry {
+    Rule rule = {0, 0, 0};
+    Callback callback;
+    time_t nextEpoch = 0;
+  };
+
+  void _plan(time_t now, bool renew = true) {
+    mPlannedEpoch = 0;
+    if (now < MIN_VALID_EPOCH) {
+      mTask.detach();  // wait until the clock is set
+      return;
+    }
+
+    time_t nearest = 0;
+    for (size_t i = 0; i < mEntries.size(); i++) {
+      auto &entry = mEntries[i];
+      if (!entry.callback) {
+        continue;
+      }
+      if (renew || !entry.nextEpoch) {
+        entry.nextEpoch = entry.rule.next(now);
+      }
+      if (entry.nextEpoch && (!nearest || entry.nextEpoch < nearest)) {
+        nearest = entry.nextEpoch;
+      }
+    }
+    if (!nearest) {
+      mTask.detach();
+      return;
+    }
+
+    mPlannedEpoch = now;
+    mPlannedMs = millis();
+    uint64_t sleepMs = static_cast<uint64_t>(nearest > now ? nearest - now : 0) * 1000;
+    mTask.once(sleepMs < UNIOT_CALENDAR_MAX_SLEEP_MS ? sleepMs : UNIOT_CALENDAR_MAX_SLEEP_MS);
+  }
+
+  Clock mClock;
+  SchedulerTask mTask;
+  time_t mPlannedEpoch;
+  uint32_t mPlannedMs;
+  uint32_t mFiredCount;
+  bool mExecuting;
+  Array<Entry> mEntries;
+};
+
+}  // namespace uniot
@@ -0,0 +1,207 @@
+/*
+ * This is a part of the Uniot project.
+ * Copyright (C) 2016-2024 Uniot <contact@uniot.io>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <Arduino.h>
+#include <IExecutor.h>
+#include <Logger.h>
+#include <TaskScheduler.h>
+
+#if defined(ESP8266)
+extern "C" {
+#include <user_interface.h>
+}
+#endif
+
+#include <functional>
+
+// how often the utilization is sampled
+#ifndef UNIOT_CPU_GOVERNOR_PERIOD_MS
+#define UNIOT_CPU_GOVERNOR_PERIOD_MS 1000
+#endif
+
+// a sample above it steps the frequency up at once
+#ifndef UNIOT_CPU_GOVERNOR_UP_PERCENT
+#define UNIOT_CPU_GOVERNOR_UP_PERCENT 70
+#endif
+
+// this many samples in a row below it step the frequency down
+#ifndef UNIOT_CPU_GOVERNOR_DOWN_PERCENT
+#define UNIOT_CPU_GOVERNOR_DOWN_PERCENT 30
+#endif
+
+#ifndef UNIOT_CPU_GOVERNOR_DOWN_SAMPLES
+#define UNIOT_CPU_GOVERNOR_DOWN_SAMPLES 5
+#endif
+
+namespace uniot {
+
+/**
+ * @brief Steps the CPU frequency up and down following the utilization of the scheduler,
+ * i.e. the share of the wall time the loop spends on the tasks.
+ *
+ * A busy sample steps the frequency up at once, so the latency does not suffer. Stepping down takes several quiet
+ * samples in a row and only happens if the same work would stay below the upper threshold at the lower frequency,
+ * so the governor does not flip between two levels. The frequency is set through a hook, the platform one by default,
+ * so the policy can be run on the host with a stub.
+ */
+class CpuGovernor : public IExecutor {
+ public:
+  using FrequencyHook = std::function<bool(uint32_t)>;
+
+  CpuGovernor(const TaskScheduler &scheduler, FrequencyHook hook = _setPlatformFrequency)
+      : mpScheduler(&scheduler),
+        mHook(hook),
+        mTask(*this),
+        mLevel(LEVELS_COUNT - 1),
+        mLastBusyUs(0),
+        mLastSampleUs(0),
+        mUtilizationPercent(0),
+        mQuietSamples(0),
+        mSwitchCount(0) {}
+
+  SchedulerTask &task() {
+    return mTask;
+  }
+
+  /**
+   * @brief Starts sampling from the given frequency, the current one of the CPU by default.
+   */
+  void start(uint32_t currentMhz = _getPlatformFrequency()) {
+    mLevel = LEVELS_COUNT - 1;
+    for (uint8_t i = 0; i < LEVELS_COUNT; i++) {
+      if (LEVELS_MHZ[i] >= currentMhz) {
+        mLevel = i;
+        break;
+      }
+    }
+    mQuietSamples = 0;
+    _resetSample();
+    mTask.attach(UNIOT_CPU_GOVERNOR_PERIOD_MS);
+  }
+
+  /**
+   * @brief Stops sampling, the frequency is left as it is.
+   */
+  void stop() {
+    mTask.detach();
+  }
+
+  uint32_t getFrequencyMhz() const {
+    return LEVELS_MHZ[mLevel];
+  }
+
+  uint8_t getUtilizationPercent() const {
+    return mUtilizationPercent;
+  }
+
+  uint32_t getSwitchCount() const {
+    return mSwitchCount;
+  }
+
+  virtual void execute(short _) override {
+    uint64_t busyUs = mpScheduler->getTotalBusyUs();
+    uint32_t nowUs = micros();
+    uint32_t wallUs = nowUs - mLastSampleUs;
+    if (!wallUs) {
+      return;
+    }
+    uint64_t percent = (busyUs - mLastBusyUs) * 100 / wallUs;
+    mUtilizationPercent = percent < 100 ? percent : 100;
+    mLastBusyUs = busyUs;
+    mLastSampleUs = nowUs;
+
+    if (mUtilizationPercent >= UNIOT_CPU_GOVERNOR_UP_PERCENT) {
+      mQuietSamples = 0;
+      if (mLevel + 1 < LEVELS_COUNT) {
+        _switchTo(mLevel + 1);
+      }
+      return;
+    }
+    if (mUtilizationPercent > UNIOT_CPU_GOVERNOR_DOWN_PERCENT || !mLevel) {
+      mQuietSamples = 0;
+      return;
+    }
+    if (++mQuietSamples < UNIOT_CPU_GOVERNOR_DOWN_SAMPLES) {
+      return;
+    }
+    mQuietSamples = 0;
+    // NOTE: the same work takes proportionally longer at the lower frequency
+    auto expectedPercent = mUtilizationPercent * LEVELS_MHZ[mLevel] / LEVELS_MHZ[mLevel - 1];
+    if (expectedPercent < UNIOT_CPU_GOVERNOR_UP_PERCENT) {
+      _switchTo(mLevel - 1);
+    }
+  }
+
+ private:
+  // NOTE: the RISC-V ESP32 targets run at 160 MHz at most
+#if defined(ESP8266) || defined(CONFIG_IDF_TARGET_ESP32C3) || defined(CONFIG_IDF_TARGET_ESP32C6)
+  static constexpr uint32_t LEVELS_MHZ[] = {80, 160};
+#else
+  static constexpr uint32_t LEVELS_MHZ[] = {80, 160, 240};
+#endif
+  static constexpr uint8_t LEVELS_COUNT = sizeof(LEVELS_MHZ) / sizeof(LEVELS_MHZ[0]);
+
+  void _switchTo(uint8_t level) {
+    if (mHook && mHook(LEVELS_MHZ[level])) {
+      UNIOT_LOG_DEBUG("cpu governor: %lu -> %lu MHz at %d%%", (unsigned long)LEVELS_MHZ[mLevel], (unsigned long)LEVELS_MHZ[level], mUtilizationPercent);
+      mLevel = level;
+      mSwitchCount++;
+    } else {
+      UNIOT_LOG_WARN("cpu governor: failed to set %lu MHz", (unsigned long)LEVELS_MHZ[level]);
+    }
+    // NOTE: the time measured around the switch belongs to the old frequency
+    _resetSample();
+  }
+
+  void _resetSample() {
+    mLastBusyUs = mpScheduler->getTotalBusyUs();
+    mLastSampleUs = micros();
+  }
+
+  static bool _setPlatformFrequency(uint32_t mhz) {
+#if defined(ESP8266)
+    return system_update_cpu_freq(mhz);
+#elif defined(ESP32)
+    return setCpuFrequencyMhz(mhz);
+#else
+    return false;
+#endif
+  }
+
+  static uint32_t _getPlatformFrequency() {
+#if defined(ESP8266) || defined(ESP32)
+    return ESP.getCpuFreqMHz();
+#else
+    return LEVELS_MHZ[LEVELS_COUNT - 1];
+#endif
+  }
+
+  const TaskScheduler *mpScheduler;
+  FrequencyHook mHook;
+  SchedulerTask mTask;
+  uint8_t mLevel;
+  uint64_t mLastBusyUs;
+  uint32_t mLastSampleUs;
+  uint8_t mUtilizationPercent;
+  uint8_t mQuietSamples;
+  uint32_t mSwitchCount;
+};
+
+}  // namespace uniot
@@ -30,7 +30,7 @@ class Task {
   using TaskTypeCallback = void (*)(volatile T);
 
   Task()
-      : mpTimer(nullptr) {}
+      : mpTimer(nullptr), mCallback(nullptr), mpArg(nullptr) {}
 
   virtual ~Task() {
     detach();
@@ -59,20 +59,30 @@ class Task {
 
  private:
   esp_timer_handle_t mpTimer;
+  TaskArgCallback mCallback;
+  volatile void *mpArg;
 
   void attach_arg(uint32_t ms, bool repeat, TaskArgCallback callback, volatile void *arg) {
-    esp_timer_create_args_t timerConfig;
-    timerConfig.callback = reinterpret_cast<esp_timer_cb_t>(callback);
-    timerConfig.arg = const_cast<void*>(arg);
-    timerConfig.dispatch_method = ESP_TIMER_TASK;
-    timerConfig.name = "Task";
-
     if (mpTimer) {
       esp_timer_stop(mpTimer);
-      esp_timer_delete(mpTimer);
+      // NOTE: the same timer is restarted rather than recreated, so a task may re-attach itself from its own callback
+      if (mCallback != callback || mpArg != arg) {
+        esp_timer_delete(mpTimer);
+        mpTimer = nullptr;
+      }
     }
 
-    esp_timer_create(&timerConfig, &mpTimer);
+    if (!mpTimer) {
+      esp_timer_create_args_t timerConfig;
+      timerConfig.callback = reinterpret_cast<esp_timer_cb_t>(callback);
+      timerConfig.arg = const_cast<void*>(arg);
+      timerConfig.dispatch_method = ESP_TIMER_TASK;
+      timerConfig.name = "Task";
+
+      esp_timer_create(&timerConfig, &mpTimer);
+      mCallback = callback;
+      mpArg = arg;
+    }
 
     if (repeat) {
       esp_timer_start_periodic(mpTimer, ms * 1000);
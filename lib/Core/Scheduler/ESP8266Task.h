@@ -62,7 +62,6 @@ class Task {
   void detach() {
     if (mpTimer) {
       os_timer_disarm(mpTimer);
-      delete mpTimer;
       mpTimer = nullptr;
     }
   }
@@ -72,13 +71,15 @@ class Task {
   }
 
  private:
+  // NOTE: the timer is stored inline, so attaching a task does not allocate
+  ETSTimer mTimer;
   ETSTimer *mpTimer;
 
   void attach_arg(uint32_t ms, bool repeat, TaskArgCallback callback, volatile void *arg) {
     if (mpTimer) {
       os_timer_disarm(mpTimer);
     } else {
-      mpTimer = new ETSTimer;
+      mpTimer = &mTimer;
     }
 
     os_timer_setfn(mpTimer, reinterpret_cast<ETSTimerFunc *>(callback), const_cast<void*>(arg));
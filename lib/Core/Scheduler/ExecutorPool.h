@@ -0,0 +1,424 @@
+/*
+ * This is a part of the Uniot project.
+ * Copyright (C) 2016-2024 Uniot <contact@uniot.io>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+// NOTE: ESP8266 has a single core and no preemptive threads, so the pool is not available there
+#if !defined(ESP8266)
+
+#if defined(ESP32)
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#else
+#include <thread>
+#endif
+
+#include <Common.h>
+#include <IExecutor.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+
+#ifndef UNIOT_EXECUTOR_POOL_QUEUE_SIZE
+#define UNIOT_EXECUTOR_POOL_QUEUE_SIZE 16
+#endif
+
+#ifndef UNIOT_EXECUTOR_POOL_STACK_SIZE
+#define UNIOT_EXECUTOR_POOL_STACK_SIZE 4096
+#endif
+
+namespace uniot {
+
+/**
+ * @brief A small pool of worker threads that runs independent executors in parallel.
+ *
+ * Every worker owns a bounded job queue. An idle worker steals jobs from the other workers,
+ * except the jobs that are pinned to a particular worker by affinity.
+ * Jobs that share an exclusive group never run at the same time, so the state shared by
+ * the executors of a group does not need its own locking. The main loop can join a group
+ * with GroupLock to touch that state safely.
+ *
+ * Workers are FreeRTOS tasks pinned to the cores on ESP32 and std::thread on the host.
+ */
+class ExecutorPool {
+ public:
+  using JobCallback = void (*)(void *, short);
+
+  static constexpr uint8_t ANY_WORKER = UINT8_MAX;
+  static constexpr uint8_t NO_GROUP = UINT8_MAX;
+  static constexpr uint8_t MAX_GROUPS = 32;
+
+  /**
+   * @brief Holds an exclusive group for the lifetime of the object.
+   */
+  class GroupLock {
+   public:
+    GroupLock(ExecutorPool &pool, uint8_t group) : mpPool(&pool), mGroup(group) {
+      while (!mpPool->_tryAcquireGroup(mGroup)) {
+        mpPool->_pause();
+      }
+    }
+
+    ~GroupLock() {
+      mpPool->_releaseGroup(mGroup);
+    }
+
+    GroupLock(const GroupLock &) = delete;
+    GroupLock &operator=(const GroupLock &) = delete;
+
+   private:
+    ExecutorPool *mpPool;
+    uint8_t mGroup;
+  };
+
+  ExecutorPool(uint8_t workersCount = 0)
+      : mWorkersCount(workersCount ? workersCount : _defaultWorkersCount()),
+        mpWorkers(new Worker[mWorkersCount]),
+        mRunning(false),
+        mAlive(0),
+        mPending(0),
+        mNextWorker(0),
+        mBusyGroups(0),
+        mStolen(0),
+        mExecuted(0),
+        mEpoch(0) {}
+
+  ~ExecutorPool() {
+    stop();
+  }
+
+  ExecutorPool(const ExecutorPool &) = delete;
+  ExecutorPool &operator=(const ExecutorPool &) = delete;
+
+  bool start() {
+    if (mRunning) {
+      return true;
+    }
+    mRunning = true;
+    for (uint8_t i = 0; i < mWorkersCount; i++) {
+      mpWorkers[i].pool = this;
+      mpWorkers[i].id = i;
+      if (!_spawn(mpWorkers[i])) {
+        stop();
+        return false;
+      }
+      mAlive++;
+    }
+    return true;
+  }
+
+  /**
+   * @brief Stops the workers. Queued jobs that have not started yet are run in the caller's context,
+   * so that no job is lost, e.g. a PooledExecutor that waits for its run to finish.
+   */
+  void stop() {
+    if (!mRunning) {
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> lock(mWakeMutex);
+      mRunning = false;
+    }
+    mWakeCondition.notify_all();
+    for (uint8_t i = 0; i < mWorkersCount; i++) {
+      _join(mpWorkers[i]);
+    }
+    while (mAlive) {
+      _pause();
+    }
+    // NOTE: the workers are gone, so the groups cannot be held by any of them
+    for (uint8_t i = 0; i < mWorkersCount; i++) {
+      auto &worker = mpWorkers[i];
+      for (size_t n = 0; n < worker.count; n++) {
+        auto &job = worker.jobs[n];
+        job.callback(job.arg, job.times);
+        mExecuted++;
+        mPending--;
+      }
+      worker.count = 0;
+    }
+    std::lock_guard<std::mutex> lock(mWakeMutex);
+    mIdleCondition.notify_all();
+  }
+
+  /**
+   * @brief Queues a job.
+   *
+   * @param group Jobs with the same group (0..MAX_GROUPS-1) never run concurrently, NO_GROUP opts out.
+   * @param affinity The worker the job is pinned to, ANY_WORKER lets any worker run it.
+   * @return true if the job was queued, false if the pool is stopped or the queues are full.
+   */
+  bool submit(JobCallback callback, void *arg, short times, uint8_t group = NO_GROUP, uint8_t affinity = ANY_WORKER) {
+    if (!mRunning || !callback || (group != NO_GROUP && group >= MAX_GROUPS)) {
+      return false;
+    }
+
+    Job job = {callback, arg, times, group, affinity};
+    auto first = affinity != ANY_WORKER ? affinity % mWorkersCount : mNextWorker++ % mWorkersCount;
+    auto tries = affinity != ANY_WORKER ? 1 : mWorkersCount;
+    for (uint8_t i = 0; i < tries; i++) {
+      auto &worker = mpWorkers[(first + i) % mWorkersCount];
+      std::lock_guard<std::mutex> lock(worker.mutex);
+      if (worker.count < UNIOT_EXECUTOR_POOL_QUEUE_SIZE) {
+        worker.jobs[worker.count++] = job;
+        mPending++;
+        _wake();
+        return true;
+      }
+    }
+    return false;
+  }
+
+  bool submit(IExecutor &executor, short times, uint8_t group = NO_GROUP, uint8_t affinity = ANY_WORKER) {
+    return submit([](void *arg, short times) { static_cast<IExecutor *>(arg)->execute(times); },
+                  &executor, times, group, affinity);
+  }
+
+  /**
+   * @brief Blocks until every queued and running job has finished.
+   */
+  void waitIdle() {
+    std::unique_lock<std::mutex> lock(mWakeMutex);
+    mIdleCondition.wait(lock, [this] { return !mPending; });
+  }
+
+  uint8_t getWorkersCount() const {
+    return mWorkersCount;
+  }
+
+  uint32_t getExecutedCount() const {
+    return mExecuted;
+  }
+
+  uint32_t getStolenCount() const {
+    return mStolen;
+  }
+
+ private:
+  struct Job {
+    JobCallback callback;
+    void *arg;
+    short times;
+    uint8_t group;
+    uint8_t affinity;
+  };
+
+  struct Worker {
+    ExecutorPool *pool = nullptr;
+    uint8_t id = 0;
+    std::mutex mutex;
+    Job jobs[UNIOT_EXECUTOR_POOL_QUEUE_SIZE];
+    size_t count = 0;
+#if defined(ESP32)
+    TaskHandle_t handle = nullptr;
+#else
+    std::thread thread;
+#endif
+  };
+
+  static uint8_t _defaultWorkersCount() {
+#if defined(ESP32)
+    return portNUM_PROCESSORS;
+#else
+    auto count = std::thread::hardware_concurrency();
+    return count ? (count < UINT8_MAX ? count : UINT8_MAX - 1) : 2;
+#endif
+  }
+
+  bool _spawn(Worker &worker) {
+#if defined(ESP32)
+    return xTaskCreatePinnedToCore(
+               [](void *arg) {
+                 auto worker = static_cast<Worker *>(arg);
+                 worker->pool->_work(*worker);
+                 worker->pool->mAlive--;
+                 vTaskDelete(nullptr);
+               },
+               "uniot_pool", UNIOT_EXECUTOR_POOL_STACK_SIZE, &worker, tskIDLE_PRIORITY + 1,
+               &worker.handle, worker.id % portNUM_PROCESSORS) == pdPASS;
+#else
+    worker.thread = std::thread([this, &worker] {
+      _work(worker);
+      mAlive--;
+    });
+    return true;
+#endif
+  }
+
+  void _join(Worker &worker) {
+#if defined(ESP32)
+    // NOTE: FreeRTOS tasks delete themselves, stop() waits for mAlive to drop
+    worker.handle = nullptr;
+#else
+    if (worker.thread.joinable()) {
+      worker.thread.join();
+    }
+#endif
+  }
+
+  void _work(Worker &self) {
+    Job job;
+    while (mRunning) {
+      // NOTE: the epoch is read before looking for a job, so a wake-up in between is not lost
+      auto epoch = mEpoch.load();
+      if (_take(self, job)) {
+        job.callback(job.arg, job.times);
+        if (job.group != NO_GROUP) {
+          _releaseGroup(job.group);
+        }
+        mExecuted++;
+        if (!--mPending) {
+          std::lock_guard<std::mutex> lock(mWakeMutex);
+          mIdleCondition.notify_all();
+        }
+        continue;
+      }
+      std::unique_lock<std::mutex> lock(mWakeMutex);
+      mWakeCondition.wait(lock, [&] { return !mRunning || mEpoch != epoch; });
+    }
+  }
+
+  bool _take(Worker &self, Job &outJob) {
+    if (_takeFrom(self, outJob, false)) {
+      return true;
+    }
+    for (uint8_t i = 1; i < mWorkersCount; i++) {
+      if (_takeFrom(mpWorkers[(self.id + i) % mWorkersCount], outJob, true)) {
+        mStolen++;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // The owner takes the oldest runnable job, a thief takes the newest one that is not pinned
+  bool _takeFrom(Worker &worker, Job &outJob, bool steal) {
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    for (size_t n = 0; n < worker.count; n++) {
+      auto offset = steal ? worker.count - 1 - n : n;
+      auto &job = worker.jobs[offset];
+      if (steal && job.affinity != ANY_WORKER) {
+        continue;
+      }
+      if (job.group != NO_GROUP && !_tryAcquireGroup(job.group)) {
+        continue;
+      }
+      outJob = job;
+      for (auto i = offset; i + 1 < worker.count; i++) {
+        worker.jobs[i] = worker.jobs[i + 1];
+      }
+      worker.count--;
+      return true;
+    }
+    return false;
+  }
+
+  bool _tryAcquireGroup(uint8_t group) {
+    uint32_t bit = 1UL << group;
+    auto busy = mBusyGroups.load();
+    do {
+      if (busy & bit) {
+        return false;
+      }
+    } while (!mBusyGroups.compare_exchange_weak(busy, busy | bit));
+    return true;
+  }
+
+  void _releaseGroup(uint8_t group) {
+    mBusyGroups &= ~(1UL << group);
+    _wake();
+  }
+
+  // Called when a job is queued or a group is released, i.e. whenever a skipped job may become runnable
+  void _wake() {
+    std::lock_guard<std::mutex> lock(mWakeMutex);
+    mEpoch++;
+    mWakeCondition.notify_all();
+  }
+
+  void _pause() {
+#if defined(ESP32)
+    vTaskDelay(1);
+#else
+    std::this_thread::yield();
+#endif
+  }
+
+  const uint8_t mWorkersCount;
+  UniquePointer<Worker[]> mpWorkers;
+
+  std::atomic<bool> mRunning;
+  std::atomic<uint8_t> mAlive;
+  std::atomic<size_t> mPending;
+  std::atomic<uint32_t> mNextWorker;
+  std::atomic<uint32_t> mBusyGroups;
+  std::atomic<uint32_t> mStolen;
+  std::atomic<uint32_t> mExecuted;
+  std::atomic<uint32_t> mEpoch;
+
+  std::mutex mWakeMutex;
+  std::condition_variable mWakeCondition;
+  std::condition_variable mIdleCondition;
+};
+
+/**
+ * @brief Runs an executor on the pool when the scheduler triggers it.
+ *
+ * A tick that arrives while the previous run is still in progress is merged into it,
+ * the same way TaskScheduler merges ticks of a late task. If the pool cannot take the job,
+ * the executor runs in the caller's context.
+ */
+class PooledExecutor : public IExecutor {
+ public:
+  PooledExecutor(ExecutorPool &pool, IExecutor &executor, uint8_t group = ExecutorPool::NO_GROUP, uint8_t affinity = ExecutorPool::ANY_WORKER)
+      : mpPool(&pool), mpExecutor(&executor), mGroup(group), mAffinity(affinity), mInFlight(false) {}
+
+  virtual void execute(short times) override {
+    if (mInFlight.exchange(true)) {
+      return;
+    }
+    if (!mpPool->submit(_run, this, times, mGroup, mAffinity)) {
+      mpExecutor->execute(times);
+      mInFlight = false;
+    }
+  }
+
+  bool isInFlight() const {
+    return mInFlight;
+  }
+
+ private:
+  static void _run(void *arg, short times) {
+    auto self = static_cast<PooledExecutor *>(arg);
+    self->mpExecutor->execute(times);
+    self->mInFlight = false;
+  }
+
+  ExecutorPool *mpPool;
+  IExecutor *mpExecutor;
+  uint8_t mGroup;
+  uint8_t mAffinity;
+  std::atomic<bool> mInFlight;
+};
+
+}  // namespace uniot
+
+#endif  // !defined(ESP8266)
@@ -25,5 +25,15 @@ class IExecutor
 public:
   virtual ~IExecutor() {}
   virtual void execute(short times) = 0;
+
+  /**
+   * @brief Runs the executor and tells whether it has done any work, so that its task can adapt the period.
+   * An executor that cannot tell is always treated as busy.
+   */
+  virtual bool process(short times)
+  {
+    execute(times);
+    return true;
+  }
 };
 } // namespace uniot
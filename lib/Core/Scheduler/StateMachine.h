@@ -0,0 +1,309 @@
+/*
+ * This is a part of the Uniot project.
+ * Copyright (C) 2016-2024 Uniot <contact@uniot.io>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <Arduino.h>
+#include <Array.h>
+#include <IExecutor.h>
+#include <Logger.h>
+#include <TaskScheduler.h>
+
+#include <functional>
+
+// the longest chain of transitions taken in a single run, a guard that is always true cannot lock up the loop
+#ifndef UNIOT_STATE_MACHINE_MAX_STEPS
+#define UNIOT_STATE_MACHINE_MAX_STEPS 8
+#endif
+
+#ifndef UNIOT_STATE_MACHINE_EVENTS_SIZE
+#define UNIOT_STATE_MACHINE_EVENTS_SIZE 4
+#endif
+
+namespace uniot {
+
+/**
+ * @brief A table-driven state machine that runs on a single scheduler task.
+ *
+ * The states and the transitions are declared up front. A transition is taken on an event, when its guard holds
+ * or when the machine has been in the state for long enough. The transitions of a state are tried in the order
+ * they were declared, and the machine keeps taking them within the same run while any of them applies,
+ * so a chain of states does not wait for a timer between the steps.
+ *
+ * The task only wakes up when there is something to check: every pollMs of the current state if it has guarded
+ * transitions, when the nearest timeout expires, or right after an event is dispatched.
+ * Must only be used from the main loop.
+ */
+class StateMachine : public IExecutor {
+ public:
+  using State = uint8_t;
+  using Event = uint8_t;
+  using Action = std::function<void()>;
+  using Guard = std::function<bool()>;
+
+  static constexpr State NO_STATE = 0xFF;
+  static constexpr State ANY_STATE = 0xFE;  // as the source of a transition, matches every state
+  static constexpr Event NO_EVENT = 0xFF;
+
+  StateMachine()
+      : mTask(*this),
+        mCurrent(NO_STATE),
+        mInitial(NO_STATE),
+        mEnteredMs(0),
+        mScheduledMs(UINT32_MAX),
+        mScheduledPeriodic(false),
+        mEventsHead(0),
+        mEventsCount(0),
+        mTransitionsCount(0) {}
+
+  SchedulerTask &task() {
+    return mTask;
+  }
+
+  /**
+   * @brief Declares a state.
+   *
+   * @param id The identifier of the state, any value below ANY_STATE.
+   * @param name The name used in the logs, it is not copied.
+   * @param onEnter The action run each time the state is entered.
+   * @param pollMs How often the guards of the state are checked, 0 if the state only reacts to events and timeouts.
+   * @param slackMs How late the polls of the state may be, see SchedulerTask::setSlack(), the timeouts are always on time.
+   */
+  StateMachine &state(State id, const char *name, Action onEnter = nullptr, uint32_t pollMs = 0, uint32_t slackMs = 0) {
+    mStates.push({id, name, onEnter, pollMs, slackMs});
+    return *this;
+  }
+
+  /**
+   * @brief Declares a transition taken on the event, if the guard holds.
+   */
+  StateMachine &on(State from, Event event, State to, Guard guard = nullptr, Action action = nullptr) {
+    mTransitions.push({from, to, event, 0, guard, action});
+    return *this;
+  }
+
+  /**
+   * @brief Declares a transition taken as soon as the guard holds.
+   */
+  StateMachine &when(State from, Guard guard, State to, Action action = nullptr) {
+    mTransitions.push({from, to, NO_EVENT, 0, guard, action});
+    return *this;
+  }
+
+  /**
+   * @brief Declares a transition taken once the machine has been in the state for timeoutMs, if the guard holds.
+   */
+  StateMachine &after(State from, uint32_t timeoutMs, State to, Action action = nullptr, Guard guard = nullptr) {
+    mTransitions.push({from, to, NO_EVENT, timeoutMs ? timeoutMs : 1, guard, action});
+    return *this;
+  }
+
+  /**
+   * @brief Enters the initial state on the next run of the task, any pending events are dropped.
+   */
+  void start(State initial) {
+    mInitial = initial;
+    mEventsCount = 0;
+    _schedule(0);
+  }
+
+  /**
+   * @brief Queues the event, it is handled on the next run of the task.
+   * An event that no transition of the current state accepts is dropped.
+   *
+   * @return false if the queue is full.
+   */
+  bool dispatch(Event event) {
+    if (mEventsCount >= UNIOT_STATE_MACHINE_EVENTS_SIZE) {
+      UNIOT_LOG_WARN("state machine: event %d is dropped, the queue is full", event);
+      return false;
+    }
+    mEvents[(mEventsHead + mEventsCount++) % UNIOT_STATE_MACHINE_EVENTS_SIZE] = event;
+    _schedule(0);
+    return true;
+  }
+
+  State current() const {
+    return mCurrent;
+  }
+
+  bool is(State id) const {
+    return mCurrent == id;
+  }
+
+  uint32_t getTimeInStateMs() const {
+    return millis() - mEnteredMs;
+  }
+
+  uint32_t getTransitionsCount() const {
+    return mTransitionsCount;
+  }
+
+  virtual void execute(short _) override {
+    if (mInitial != NO_STATE) {
+      auto initial = mInitial;
+      mInitial = NO_STATE;
+      _enter(initial);
+    }
+
+    for (auto step = 0; step < UNIOT_STATE_MACHINE_MAX_STEPS; step++) {
+      auto transition = _findTransition();
+      if (!transition && mEventsCount) {
+        // nothing waits for the event in this state
+        _popEvent();
+        step--;
+        continue;
+      }
+      if (!transition) {
+        break;
+      }
+      if (transition->event != NO_EVENT) {
+        _popEvent();
+      }
+      if (transition->action) {
+        transition->action();
+      }
+      _enter(transition->to);
+    }
+
+    _scheduleNext();
+  }
+
+ private:
+  struct StateDef {
+    State id;
+    const char *name;
+    Action onEnter;
+    uint32_t pollMs;
+    uint32_t slackMs;
+  };
+
+  struct Transition {
+    State from;
+    State to;
+    Event event;
+    uint32_t timeoutMs;
+    Guard guard;
+    Action action;
+  };
+
+  const StateDef *_findState(State id) const {
+    for (size_t i = 0; i < mStates.size(); i++) {
+      if (mStates[i].id == id) {
+        return &mStates[i];
+      }
+    }
+    return nullptr;
+  }
+
+  const Transition *_findTransition() const {
+    auto event = mEventsCount ? mEvents[mEventsHead] : NO_EVENT;
+    auto inStateMs = getTimeInStateMs();
+    for (size_t i = 0; i < mTransitions.size(); i++) {
+      auto &transition = mTransitions[i];
+      if (transition.from != mCurrent && transition.from != ANY_STATE) {
+        continue;
+      }
+      if (transition.event != NO_EVENT && transition.event != event) {
+        continue;
+      }
+      if (transition.timeoutMs && inStateMs < transition.timeoutMs) {
+        continue;
+      }
+      if (!transition.guard || transition.guard()) {
+        return &transition;
+      }
+    }
+    return nullptr;
+  }
+
+  void _popEvent() {
+    mEventsHead = (mEventsHead + 1) % UNIOT_STATE_MACHINE_EVENTS_SIZE;
+    mEventsCount--;
+  }
+
+  void _enter(State id) {
+    auto state = _findState(id);
+    UNIOT_LOG_DEBUG("state machine: %s -> %s", _name(_findState(mCurrent)), _name(state));
+    mCurrent = id;
+    mEnteredMs = millis();
+    mTransitionsCount++;
+    if (state && state->onEnter) {
+      state->onEnter();
+    }
+  }
+
+  void _scheduleNext() {
+    if (mEventsCount || mInitial != NO_STATE) {
+      _schedule(0);  // the steps have run out or the actions have dispatched more events
+      return;
+    }
+
+    auto state = _findState(mCurrent);
+    uint32_t pollMs = state && state->pollMs ? state->pollMs : UINT32_MAX;
+    uint32_t nextMs = UINT32_MAX;
+    auto inStateMs = getTimeInStateMs();
+    for (size_t i = 0; i < mTransitions.size(); i++) {
+      auto &transition = mTransitions[i];
+      // NOTE: an expired timeout has just been checked, its guard is only re-checked by polling
+      if (transition.timeoutMs > inStateMs && (transition.from == mCurrent || transition.from == ANY_STATE)) {
+        uint32_t leftMs = transition.timeoutMs - inStateMs;
+        nextMs = leftMs < nextMs ? leftMs : nextMs;
+      }
+    }
+    if (pollMs <= nextMs && pollMs != UINT32_MAX) {
+      _schedule(pollMs, true, state->slackMs);
+    } else if (nextMs != UINT32_MAX) {
+      _schedule(nextMs);
+    } else {
+      mTask.detach();
+    }
+  }
+
+  void _schedule(uint32_t ms, bool periodic = false, uint32_t slackMs = 0) {
+    // NOTE: a polled state keeps the same periodic timer running instead of re-arming it on every run
+    if (periodic && mScheduledPeriodic && ms == mScheduledMs && slackMs == mTask.getSlack() && mTask.isAttached()) {
+      return;
+    }
+    mScheduledMs = ms;
+    mScheduledPeriodic = periodic;
+    mTask.setSlack(slackMs);
+    mTask.attach(ms, periodic ? 0 : 1);
+  }
+
+  static const char *_name(const StateDef *state) {
+    return state && state->name ? state->name : "none";
+  }
+
+  SchedulerTask mTask;
+  State mCurrent;
+  State mInitial;
+  uint32_t mEnteredMs;
+  uint32_t mScheduledMs;
+  bool mScheduledPeriodic;
+
+  Event mEvents[UNIOT_STATE_MACHINE_EVENTS_SIZE];
+  uint8_t mEventsHead;
+  uint8_t mEventsCount;
+
+  uint32_t mTransitionsCount;
+  Array<StateDef> mStates;
+  Array<Transition> mTransitions;
+};
+
+}  // namespace uniot
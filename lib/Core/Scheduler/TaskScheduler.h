@@ -22,74 +22,535 @@
 #include "ESP8266Task.h"
 #elif defined(ESP32)
 #include "ESP32Task.h"
+#else
+#include "VirtualTask.h"
 #endif
 
-#include <ClearQueue.h>
+#include <Array.h>
 #include <Common.h>
 #include <IExecutor.h>
 #include <ISchedulerConnectionKit.h>
+#include <LockFreeQueue.h>
+#include <Logger.h>
+#include <Tracer.h>
 
+#include <cstddef>
 #include <functional>
 #include <memory>
+#include <new>
+#include <type_traits>
+
+#ifndef UNIOT_SCHEDULER_READY_QUEUE_SIZE
+#define UNIOT_SCHEDULER_READY_QUEUE_SIZE 32
+#endif
+
+// NOTE: callbacks up to this size are stored inside the task, larger ones are wrapped into std::function
+#ifndef UNIOT_SCHEDULER_TASK_CALLBACK_SIZE
+#define UNIOT_SCHEDULER_TASK_CALLBACK_SIZE (4 * sizeof(void *))
+#endif
+
+// the longest burst of runs a MISSED_CATCH_UP task makes up in a single loop, the older periods are dropped
+#ifndef UNIOT_SCHEDULER_MAX_CATCH_UP
+#define UNIOT_SCHEDULER_MAX_CATCH_UP 4
+#endif
+
+// a loop that takes longer than this puts the scheduler into overload, 0 disables load shedding
+#ifndef UNIOT_SCHEDULER_LOOP_BUDGET_MS
+#define UNIOT_SCHEDULER_LOOP_BUDGET_MS 50
+#endif
+
+// spread the first ticks of the tasks with equal periods across the period, off by default,
+// see TaskScheduler::setPhaseStaggering()
+#ifndef UNIOT_SCHEDULER_STAGGER_PHASES
+#define UNIOT_SCHEDULER_STAGGER_PHASES 0
+#endif
+
+// the number of tasks with the same period the staggering takes into account
+#ifndef UNIOT_SCHEDULER_STAGGER_MAX_TASKS
+#define UNIOT_SCHEDULER_STAGGER_MAX_TASKS 16
+#endif
 
 namespace uniot {
+class TaskScheduler;
+
 class SchedulerTask : public Task {
+  friend class TaskScheduler;
+
  public:
   // TODO: add ms to callback
   using SchedulerTaskCallback = std::function<void(SchedulerTask &, short)>;
-  using spSchedulerTaskCallback = SharedPointer<SchedulerTaskCallback>;
+
+  enum OverrunPolicy : uint8_t {
+    OVERRUN_LOG = 1 << 0,     // print a warning
+    OVERRUN_NOTIFY = 1 << 1,  // call the scheduler's runaway callback
+    OVERRUN_DETACH = 1 << 2   // detach the task
+  };
+
+  // NOTE: the timer keeps the absolute period grid and every elapsed period counts towards `times`,
+  // the policies only differ in what happens to the periods that elapsed while the loop was busy
+  enum MissedTickPolicy : uint8_t {
+    MISSED_COALESCE = 0,  // run once, getMissedPeriods() tells how many periods were merged into the run
+    MISSED_SKIP,          // run once, the missed periods are dropped silently
+    MISSED_CATCH_UP       // run once per elapsed period, up to UNIOT_SCHEDULER_MAX_CATCH_UP in a row
+  };
 
   SchedulerTask(IExecutor &executor)
-      : SchedulerTask([&](SchedulerTask &, short times) { executor.execute(times); }) {}
+      : SchedulerTask([&executor](SchedulerTask &self, short times) { self.reportActivity(executor.process(times)); }) {}
 
-  SchedulerTask(SchedulerTaskCallback callback)
-      : Task(), mTotalElapsedMs(0), mRepeatTimes(0), mCanDoHardWork(false) {
-    mspCallback = std::make_shared<SchedulerTaskCallback>(callback);
+  /**
+   * @brief Creates a task that runs the callback.
+   *
+   * The callback is stored inside the task, so a task that is a static or a member
+   * does not use the heap at all, as long as the callback is not larger than UNIOT_SCHEDULER_TASK_CALLBACK_SIZE
+   * (e.g. a lambda capturing `this` or a couple of references).
+   */
+  template <typename Callback, typename = typename std::enable_if<std::is_invocable<Callback &, SchedulerTask &, short>::value>::type>
+  SchedulerTask(Callback &&callback)
+      : Task(),
+        mTotalElapsedMs(0),
+        mRepeatTimes(0),
+        mCanDoHardWork(false),
+        mpScheduler(nullptr),
+        mHandle(0),
+        mBudgetMs(0),
+        mMaxOverruns(0),
+        mOverrunPolicy(0),
+        mOverruns(0),
+        mTotalOverruns(0),
+        mMaxElapsedMs(0),
+        mFiredTicks(0),
+        mConsumedTicks(0),
+        mMissedPeriods(0),
+        mTotalMissedPeriods(0),
+        mMissedTickPolicy(MISSED_COALESCE),
+        mSlackMs(0),
+        mPeriodMs(0),
+        mFirstDueMs(0),
+        mPendingPeriodMs(0),
+        mSheddable(false),
+        mShedCount(0),
+        mMinPeriodMs(0),
+        mMaxPeriodMs(0),
+        mActive(true),
+        mRequestedPeriodMs(0),
+        mRequestedTimes(0),
+        mPeriodOverrideMs(0),
+        mEnabled(true),
+        mResumePending(false) {
+    using Stored = typename std::decay<Callback>::type;
+    using Inline = typename std::conditional<sizeof(Stored) <= sizeof(mCallbackStorage) && alignof(Stored) <= alignof(std::max_align_t),
+                                             Stored, SchedulerTaskCallback>::type;
+    new (mCallbackStorage) Inline(std::forward<Callback>(callback));
+    mpInvoke = [](void *storage, SchedulerTask &self, short times) { (*static_cast<Inline *>(storage))(self, times); };
+    mpDestroy = [](void *storage) { static_cast<Inline *>(storage)->~Inline(); };
   }
 
-  // TODO: auto detach, maybe mCanDoHardWork should be countable type, if mCanDoHardWork > x then detach, refresh when executed
+  SchedulerTask(const SchedulerTask &) = delete;
+  SchedulerTask &operator=(const SchedulerTask &) = delete;
+
+  virtual inline ~SchedulerTask();
+
   void attach(uint32_t ms, short times = 0) {
+    mRequestedPeriodMs = ms;
+    mRequestedTimes = times;
+    if (!mEnabled) {
+      mResumePending = true;
+      return;
+    }
     mRepeatTimes = times > 0 ? times : -1;
-    Task::attach<volatile bool *>(ms, mRepeatTimes != 1, [](volatile bool *can) { *can = true; }, &mCanDoHardWork);
+    mConsumedTicks = mFiredTicks;
+    if (mPeriodOverrideMs && mRepeatTimes != 1) {
+      ms = mPeriodOverrideMs;
+    } else if (mMaxPeriodMs && mRepeatTimes != 1) {
+      ms = ms < mMinPeriodMs ? mMinPeriodMs : (ms > mMaxPeriodMs ? mMaxPeriodMs : ms);
+    }
+    auto nowMs = millis();
+    auto firstMs = ms + _alignDelay(nowMs + ms, ms);
+    mPeriodMs = mRepeatTimes != 1 ? ms : 0;
+    mFirstDueMs = nowMs + firstMs;
+    // NOTE: a delayed first tick is a one-shot, the loop switches the timer to the period once it has fired
+    mPendingPeriodMs = firstMs != ms ? mPeriodMs : 0;
+    Task::attach<SchedulerTask *>(firstMs, mRepeatTimes != 1 && !mPendingPeriodMs, [](SchedulerTask *self) { self->_onTimer(); }, this);
   }
 
   void once(uint32_t ms) {
     attach(ms, 1);
   }
 
+  void detach() {
+    mResumePending = false;
+    mPendingPeriodMs = 0;
+    Task::detach();
+  }
+
+  /**
+   * @brief Replaces the period the code gives to attach() for a repeating task, e.g. to tune it remotely without a reflash.
+   *
+   * An attached task that repeats forever switches to the new period at once, the others on their next attach().
+   * The adaptive period is suspended while the override is set.
+   *
+   * @param periodMs The period to use instead, 0 gives the period back to the code.
+   */
+  void setPeriodOverride(uint32_t periodMs) {
+    mPeriodOverrideMs = periodMs;
+    if (mRequestedPeriodMs && mRepeatTimes < 0 && Task::isAttached()) {
+      attach(mRequestedPeriodMs, mRequestedTimes);
+    }
+  }
+
+  uint32_t getPeriodOverride() const {
+    return mPeriodOverrideMs;
+  }
+
+  /**
+   * @brief A disabled task is detached and stays so, its attach() calls are only remembered.
+   * Once enabled, the task is attached again as it was last asked to be, unless the code has detached it meanwhile.
+   */
+  void setEnabled(bool enabled) {
+    if (mEnabled == enabled) {
+      return;
+    }
+    mEnabled = enabled;
+    if (!enabled) {
+      mResumePending = Task::isAttached();
+      mPendingPeriodMs = 0;
+      Task::detach();
+    } else if (mResumePending) {
+      mResumePending = false;
+      attach(mRequestedPeriodMs, mRequestedTimes);
+    }
+  }
+
+  bool isEnabled() const {
+    return mEnabled;
+  }
+
+  /**
+   * @brief Limits the time a single run of the task may take.
+   *
+   * When the task exceeds the budget maxOverruns times in a row, the scheduler applies the policy.
+   * A run within the budget resets the counter.
+   *
+   * @param budgetMs The budget of a single run, 0 disables the check.
+   * @param maxOverruns The number of consecutive overruns after which the task is treated as runaway.
+   * @param policy A combination of OverrunPolicy flags.
+   */
+  void setBudget(uint32_t budgetMs, uint8_t maxOverruns = 3, uint8_t policy = OVERRUN_LOG | OVERRUN_NOTIFY | OVERRUN_DETACH) {
+    mBudgetMs = budgetMs;
+    mMaxOverruns = maxOverruns ? maxOverruns : 1;
+    mOverrunPolicy = policy;
+    mOverruns = 0;
+  }
+
+  /**
+   * @brief Allows the ticks of the task to be late by up to slackMs, takes effect on the next attach().
+   *
+   * The first tick is delayed so that it coincides with a tick of another task of the same scheduler whose period
+   * divides or is a multiple of this one, e.g. every tick of a 2 s task then shares the wakeup with a 500 ms task.
+   * Otherwise the ticks are put on a multiple of the period (or of a round fraction of it) counted from the boot,
+   * so that the tasks attached later can line up with them. A one-shot attach ignores the slack and fires on time.
+   */
+  void setSlack(uint32_t slackMs) {
+    mSlackMs = slackMs;
+  }
+
+  uint32_t getSlack() const {
+    return mSlackMs;
+  }
+
+  void setMissedTickPolicy(MissedTickPolicy policy) {
+    mMissedTickPolicy = policy;
+  }
+
+  /**
+   * @brief Marks the task as one that can wait while the scheduler is overloaded, e.g. a status LED or a debug print.
+   *
+   * A due sheddable task is postponed to a later loop while the previous or the current loop is over the budget
+   * of the scheduler, see TaskScheduler::setLoopBudget(). The periods that elapse meanwhile are handled
+   * according to the missed tick policy once the task runs.
+   */
+  void setSheddable(bool sheddable) {
+    mSheddable = sheddable;
+  }
+
+  bool isSheddable() const {
+    return mSheddable;
+  }
+
+  /**
+   * @brief Lets the period of a repeating task follow its activity, takes effect on the next attach().
+   *
+   * Every run that reports no work doubles the period, up to maxMs, and a run that reports some work
+   * brings it back to minMs at once. The period given to attach() is kept within the range.
+   * The runs are reported with reportActivity() or, for an executor, by IExecutor::process().
+   *
+   * @param minMs The period while the task is busy, 0 disables the adaptation.
+   * @param maxMs The period the task slows down to while it is idle.
+   */
+  void setAdaptivePeriod(uint32_t minMs, uint32_t maxMs) {
+    mMinPeriodMs = minMs;
+    mMaxPeriodMs = minMs ? (maxMs > minMs ? maxMs : minMs) : 0;
+  }
+
+  /**
+   * @brief Tells whether the current run has done any work, a run that does not call it counts as busy.
+   */
+  void reportActivity(bool active) {
+    mActive = active;
+  }
+
+  uint32_t getPeriodMs() const {
+    return mPeriodMs;
+  }
+
   inline void loop() {
-    auto startMs = millis();
     if (mCanDoHardWork) {
+      auto startMs = millis();
       mCanDoHardWork = false;
 
-      if (mRepeatTimes > 0 && !--mRepeatTimes) {
-        Task::detach();
+      // NOTE: the flag is cleared first, so a tick that fires from now on either is counted here or queues the task again
+      uint32_t fired = mFiredTicks;
+      uint32_t ticks = fired - mConsumedTicks;
+      mConsumedTicks = fired;
+      if (!ticks) {
+        return;
+      }
+      if (mPendingPeriodMs) {
+        // NOTE: re-arming from the timer context would race with attach() and detach() of the loop
+        ticks += _armPendingPeriod();
+      }
+      if (mRepeatTimes > 0 && ticks > static_cast<uint32_t>(mRepeatTimes)) {
+        ticks = mRepeatTimes;
+      }
+
+      uint32_t runs = 1;
+      if (mMissedTickPolicy == MISSED_CATCH_UP) {
+        runs = ticks < UNIOT_SCHEDULER_MAX_CATCH_UP ? ticks : UNIOT_SCHEDULER_MAX_CATCH_UP;
+      }
+      auto missed = ticks - runs;
+      mTotalMissedPeriods += missed;
+      mMissedPeriods = mMissedTickPolicy == MISSED_SKIP ? 0 : missed;
+      _countDown(missed);
+
+      auto active = false;
+      for (auto run = 0U; run < runs; run++) {
+        _countDown(1);
+        mActive = true;
+        mpInvoke(mCallbackStorage, *this, mRepeatTimes);
+        active |= mActive;
+        if (!Task::isAttached()) {
+          break;  // the task has been detached by the callback or it has run out of repeats
+        }
+        mMissedPeriods = 0;
+      }
+      if (mMaxPeriodMs && mPeriodMs && !mPeriodOverrideMs && Task::isAttached()) {
+        _adaptPeriod(active);
+      }
+
+      auto elapsedMs = millis() - startMs;
+      mTotalElapsedMs += elapsedMs;
+      if (elapsedMs > mMaxElapsedMs) {
+        mMaxElapsedMs = elapsedMs;
+      }
+      if (mBudgetMs) {
+        if (elapsedMs > mBudgetMs) {
+          mOverruns++;
+          mTotalOverruns++;
+        } else {
+          mOverruns = 0;
+        }
       }
-      (*mspCallback)(*this, mRepeatTimes);
     }
-    mTotalElapsedMs += millis() - startMs;
   }
 
   uint64_t getTotalElapsedMs() const {
     return mTotalElapsedMs;
   }
 
+  /**
+   * @brief Returns the number of periods merged into the current run, so that e.g. a sampling task can compensate.
+   * Only reported with the MISSED_COALESCE policy, or when a MISSED_CATCH_UP burst was cut.
+   */
+  uint32_t getMissedPeriods() const {
+    return mMissedPeriods;
+  }
+
+  uint32_t getTotalMissedPeriods() const {
+    return mTotalMissedPeriods;
+  }
+
+  uint32_t getMaxElapsedMs() const {
+    return mMaxElapsedMs;
+  }
+
+  uint32_t getBudgetMs() const {
+    return mBudgetMs;
+  }
+
+  uint8_t getOverruns() const {
+    return mOverruns;
+  }
+
+  uint32_t getTotalOverruns() const {
+    return mTotalOverruns;
+  }
+
+  uint32_t getShedCount() const {
+    return mShedCount;
+  }
+
  private:
+  // NOTE: called from the timer context, so it must stay short and must not allocate
+  inline void _onTimer();
+
+  inline uint32_t _alignDelay(uint32_t dueMs, uint32_t periodMs) const;
+
+  inline void _adaptPeriod(bool active) {
+    uint32_t periodMs = mPeriodMs < mMaxPeriodMs / 2 ? mPeriodMs * 2 : mMaxPeriodMs;
+    if (active) {
+      periodMs = mMinPeriodMs;
+    }
+    if (periodMs != mPeriodMs) {
+      // NOTE: re-arming counts the next period from now, so a busy task gets its next run a minimum period later
+      _armPeriod(periodMs);
+    }
+  }
+
+  /**
+   * @brief Switches a delayed first tick to the period, keeping the ticks on the grid of the first one.
+   *
+   * @return The ticks of the grid the loop has missed since the first one.
+   */
+  inline uint32_t _armPendingPeriod() {
+    auto periodMs = mPendingPeriodMs;
+    auto nowMs = millis();
+    auto lateMs = static_cast<int32_t>(nowMs - mFirstDueMs);
+    uint32_t skipped = lateMs > 0 ? lateMs / periodMs : 0;
+    mFirstDueMs += (skipped + 1) * periodMs;
+    uint32_t delayMs = mFirstDueMs - nowMs;
+    if (delayMs == periodMs) {
+      mPendingPeriodMs = 0;
+      Task::attach<SchedulerTask *>(periodMs, true, [](SchedulerTask *self) { self->_onTimer(); }, this);
+    } else {
+      // NOTE: a periodic timer counts from the moment it is armed, so a late loop arms the next tick of the grid
+      // as a one-shot and tries again then
+      Task::attach<SchedulerTask *>(delayMs, false, [](SchedulerTask *self) { self->_onTimer(); }, this);
+    }
+    return skipped;
+  }
+
+  inline void _armPeriod(uint32_t periodMs) {
+    mPeriodMs = periodMs;
+    mFirstDueMs = millis() + periodMs;
+    mPendingPeriodMs = 0;
+    Task::attach<SchedulerTask *>(periodMs, true, [](SchedulerTask *self) { self->_onTimer(); }, this);
+  }
+
+  inline void _countDown(uint32_t ticks) {
+    if (ticks && mRepeatTimes > 0) {
+      mRepeatTimes -= ticks;
+      if (!mRepeatTimes) {
+        Task::detach();
+      }
+    }
+  }
+
   uint64_t mTotalElapsedMs;
   short mRepeatTimes;
   volatile bool mCanDoHardWork;
-  spSchedulerTaskCallback mspCallback;
+  TaskScheduler *volatile mpScheduler;
+  volatile uint32_t mHandle;
+
+  uint32_t mBudgetMs;
+  uint8_t mMaxOverruns;
+  uint8_t mOverrunPolicy;
+  uint8_t mOverruns;
+  uint32_t mTotalOverruns;
+  uint32_t mMaxElapsedMs;
+
+  // NOTE: each counter is written from one context only, the timer and the loop respectively
+  volatile uint32_t mFiredTicks;
+  uint32_t mConsumedTicks;
+  uint32_t mMissedPeriods;
+  uint32_t mTotalMissedPeriods;
+  MissedTickPolicy mMissedTickPolicy;
+  uint32_t mSlackMs;
+  uint32_t mPeriodMs;
+  uint32_t mFirstDueMs;
+  uint32_t mPendingPeriodMs;
+  bool mSheddable;
+  uint32_t mShedCount;
+  uint32_t mMinPeriodMs;
+  uint32_t mMaxPeriodMs;
+  bool mActive;
+  uint32_t mRequestedPeriodMs;
+  short mRequestedTimes;
+  uint32_t mPeriodOverrideMs;
+  bool mEnabled;
+  bool mResumePending;
+
+  void (*mpInvoke)(void *, SchedulerTask &, short);
+  void (*mpDestroy)(void *);
+  alignas(std::max_align_t) unsigned char mCallbackStorage[UNIOT_SCHEDULER_TASK_CALLBACK_SIZE > sizeof(SchedulerTaskCallback)
+                                                               ? UNIOT_SCHEDULER_TASK_CALLBACK_SIZE
+                                                               : sizeof(SchedulerTaskCallback)];
 };
 
 class TaskScheduler {
+  friend class SchedulerTask;
+
  public:
   using TaskPtr = SharedPointer<SchedulerTask>;
+  using TaskHandle = uint32_t;
   using TaskInfoCallback = std::function<void(const char *, bool, uint64_t)>;
+  using TaskStatsCallback = std::function<void(const char *, const SchedulerTask &)>;
+  using TaskHandleCallback = std::function<void(const char *, TaskHandle)>;
+  using RunawayCallback = std::function<void(const char *, TaskHandle)>;
+
+  /**
+   * @brief The time taken by the loops that had work to do, i.e. the wakeups.
+   */
+  struct LoopStats {
+    uint32_t count;
+    uint32_t meanUs;
+    uint32_t stdDevUs;
+    uint32_t maxUs;
+  };
+
+  enum Topic { TASK_RUNAWAY = FOURCC(rnwy) };
+
+  static constexpr TaskHandle INVALID_HANDLE = 0;
+
+  TaskScheduler()
+      : mTotalElapsedMs(0),
+        mRunawayCount(0),
+        mWakeupsCount(0),
+        mLoopBudgetMs(UNIOT_SCHEDULER_LOOP_BUDGET_MS),
+        mLoopStartMs(0),
+        mLastLoopElapsedMs(0),
+        mShedCount(0),
+        mStaggerPhases(UNIOT_SCHEDULER_STAGGER_PHASES),
+        mLoopWorkCount(0),
+        mLoopWorkSumUs(0),
+        mLoopWorkSumSqUs(0),
+        mLoopWorkMaxUs(0),
+        mTotalBusyUs(0),
+        mFullScan(false),
+        mAlwaysFullScan(false),
+        mFreeSlot(NO_SLOT),
+        mTasksCount(0) {}
 
-  TaskScheduler() : mTotalElapsedMs(0) {}
+  ~TaskScheduler() {
+    for (size_t i = 0; i < mSlots.size(); i++) {
+      if (mSlots[i].task) {
+        mSlots[i].task->mpScheduler = nullptr;
+      }
+    }
+  }
 
-  static TaskPtr make(SchedulerTask::SchedulerTaskCallback callback) {
-    return std::make_shared<SchedulerTask>(callback);
+  template <typename Callback, typename = typename std::enable_if<std::is_invocable<Callback &, SchedulerTask &, short>::value>::type>
+  static TaskPtr make(Callback &&callback) {
+    return std::make_shared<SchedulerTask>(std::forward<Callback>(callback));
   }
 
   static TaskPtr make(IExecutor &executor) {
@@ -97,7 +558,12 @@ class TaskScheduler {
   }
 
   TaskScheduler &push(const char *name, TaskPtr task) {
-    mTasks.push(MakePair(name, task));
+    add(name, task);
+    return *this;
+  }
+
+  TaskScheduler &push(const char *name, SchedulerTask &task) {
+    add(name, task);
     return *this;
   }
 
@@ -106,20 +572,298 @@ class TaskScheduler {
     return *this;
   }
 
+  /**
+   * @brief Registers a task and returns a handle to it.
+   *
+   * The handle stays valid until the task is removed. A handle of a removed task never
+   * matches a task that later reuses the same slot.
+   * The name is not copied, so it must outlive the task registration.
+   *
+   * @return The handle of the task or INVALID_HANDLE if there is no room for it.
+   */
+  TaskHandle add(const char *name, TaskPtr task) {
+    if (!task) {
+      return INVALID_HANDLE;
+    }
+
+    uint16_t index = mFreeSlot;
+    if (index != NO_SLOT) {
+      mFreeSlot = mSlots[index].nextFree;
+    } else {
+      if (mSlots.size() >= NO_SLOT || !mSlots.push(Slot())) {
+        UNIOT_LOG_ERROR("there is no room for the task '%s'", name);
+        return INVALID_HANDLE;
+      }
+      index = mSlots.size() - 1;
+    }
+
+    auto &slot = mSlots[index];
+    slot.name = name;
+    slot.task = task;
+    slot.nextFree = NO_SLOT;
+    mTasksCount++;
+    _indexInsert(index);
+
+    task->mHandle = _makeHandle(index, slot.generation);
+    task->mpScheduler = this;
+    if (task->mCanDoHardWork) {
+      // the timer has fired before the task got here, so it is not in the ready queue
+      mFullScan = true;
+    }
+    return task->mHandle;
+  }
+
+  /**
+   * @brief Registers a task owned by the caller, e.g. a static or a member, without any allocation.
+   *
+   * The task removes itself from the scheduler when it is destroyed.
+   */
+  TaskHandle add(const char *name, SchedulerTask &task) {
+    // NOTE: an aliasing pointer with an empty owner neither allocates a control block nor deletes the task
+    return add(name, TaskPtr(TaskPtr(), &task));
+  }
+
+  /**
+   * @brief Preallocates room for the given number of tasks, so that adding them later does not use the heap.
+   */
+  bool reserve(size_t tasksCount) {
+    if (tasksCount >= NO_SLOT) {
+      return false;
+    }
+    if (!mSlots.reserve(tasksCount)) {
+      return false;
+    }
+    size_t indexSize = mIndex.size() ? mIndex.size() : 16;
+    while (tasksCount * 4 > indexSize * 3) {
+      indexSize *= 2;
+    }
+    if (indexSize > mIndex.size()) {
+      _indexRebuild(indexSize);
+    }
+    return mIndex.size() == indexSize;
+  }
+
+  /**
+   * @brief Detaches the task and releases its slot. Safe to call from the task itself.
+   */
+  bool remove(TaskHandle handle) {
+    if (!_isValid(handle)) {
+      return false;
+    }
+
+    auto index = _getIndex(handle);
+    _indexErase(index);
+
+    auto &slot = mSlots[index];
+    slot.task->detach();
+    slot.task->mpScheduler = nullptr;
+    slot.task->mHandle = INVALID_HANDLE;
+
+    slot.name = nullptr;
+    slot.task.reset();
+    slot.generation = _nextGeneration(slot.generation);
+    slot.nextFree = mFreeSlot;
+    mFreeSlot = index;
+    mTasksCount--;
+    return true;
+  }
+
+  bool remove(const char *name) {
+    return remove(find(name));
+  }
+
+  bool remove(const TaskPtr &task) {
+    return task && task->mpScheduler == this && remove(task->mHandle);
+  }
+
+  bool remove(SchedulerTask &task) {
+    return task.mpScheduler == this && remove(task.mHandle);
+  }
+
+  TaskPtr get(TaskHandle handle) const {
+    return _isValid(handle) ? mSlots[_getIndex(handle)].task : nullptr;
+  }
+
+  TaskPtr get(const char *name) const {
+    return get(find(name));
+  }
+
+  /**
+   * @brief Looks up a task by name in O(1) on average. If several tasks share a name, any of them is returned.
+   */
+  TaskHandle find(const char *name) const {
+    if (!name || !mIndex.size()) {
+      return INVALID_HANDLE;
+    }
+
+    auto mask = mIndex.size() - 1;
+    for (auto pos = _hash(name) & mask;; pos = (pos + 1) & mask) {
+      auto entry = mIndex[pos];
+      if (entry == EMPTY_ENTRY) {
+        return INVALID_HANDLE;
+      }
+      auto &slot = mSlots[entry - 1];
+      if (!strcmp(slot.name, name)) {
+        return _makeHandle(entry - 1, slot.generation);
+      }
+    }
+  }
+
+  bool contains(TaskHandle handle) const {
+    return _isValid(handle);
+  }
+
+  size_t size() const {
+    return mTasksCount;
+  }
+
   inline void loop() {
     auto startMs = millis();
-    mTasks.forEach([&](Pair<const char *, TaskPtr> task) {
-      task.second->loop();
-      yield();
-    });
-    mTotalElapsedMs += millis() - startMs;
+    uint32_t startUs = micros();
+    mLoopStartMs = startMs;
+    auto fullScan = mFullScan || mAlwaysFullScan;
+    auto wakeup = fullScan || !mReadyTasks.isEmpty() || mPostponedTasks.size();
+    if (wakeup) {
+      mWakeupsCount++;
+    }
+    if (fullScan) {
+      mFullScan = false;
+      for (size_t i = 0; i < mSlots.size(); i++) {
+        auto &slot = mSlots[i];
+        if (slot.task && slot.task->mCanDoHardWork) {
+          _execute(_makeHandle(i, slot.generation));
+        }
+      }
+    }
+    if (mPostponedTasks.size()) {
+      // NOTE: the tasks shed by this loop are collected anew, so they wait for the next one
+      std::swap(mPostponedTasks, mRetriedTasks);
+      for (size_t i = 0; i < mRetriedTasks.size(); i++) {
+        _execute(mRetriedTasks[i]);
+      }
+      mRetriedTasks.clear();
+    }
+    // NOTE: only the tasks that were due at the beginning of the loop are run,
+    // a task that becomes ready again during its own execution waits for the next loop
+    TaskHandle handle = INVALID_HANDLE;
+    for (auto pending = mReadyTasks.size(); pending && mReadyTasks.pop(handle); --pending) {
+      // NOTE: the next loop scans all the tasks anyway, so the handles are only drained
+      if (!mAlwaysFullScan) {
+        _execute(handle);
+      }
+    }
+    mLastLoopElapsedMs = millis() - startMs;
+    mTotalElapsedMs += mLastLoopElapsedMs;
+    if (wakeup) {
+      _recordLoopWork(static_cast<uint32_t>(micros()) - startUs);
+    }
+  }
+
+  /**
+   * @brief Delays the first tick of a task without slack so that the tasks with the same period are spread evenly
+   * across it instead of firing in the same loop. Takes effect on the next attach() of a task.
+   */
+  void setPhaseStaggering(bool enabled) {
+    mStaggerPhases = enabled;
+  }
+
+  /**
+   * @brief Returns the mean, the standard deviation and the maximum of the work done per wakeup,
+   * a high deviation means that the work comes in spikes.
+   */
+  LoopStats getLoopStats() const {
+    LoopStats stats = {mLoopWorkCount, 0, 0, mLoopWorkMaxUs};
+    if (mLoopWorkCount) {
+      auto mean = mLoopWorkSumUs / mLoopWorkCount;
+      auto meanSq = mLoopWorkSumSqUs / mLoopWorkCount;
+      stats.meanUs = mean;
+      stats.stdDevUs = meanSq > mean * mean ? _sqrt(meanSq - mean * mean) : 0;
+    }
+    return stats;
+  }
+
+  /**
+   * @brief Returns the time spent in the loops that had work to do since the start, the rest of the time the loop was idle.
+   */
+  uint64_t getTotalBusyUs() const {
+    return mTotalBusyUs;
+  }
+
+  void resetLoopStats() {
+    mLoopWorkCount = 0;
+    mLoopWorkSumUs = 0;
+    mLoopWorkSumSqUs = 0;
+    mLoopWorkMaxUs = 0;
+  }
+
+  /**
+   * @brief Sets the time a single loop may take before the sheddable tasks get postponed, 0 disables shedding.
+   */
+  void setLoopBudget(uint32_t budgetMs) {
+    mLoopBudgetMs = budgetMs;
+  }
+
+  uint32_t getLoopBudget() const {
+    return mLoopBudgetMs;
+  }
+
+  /**
+   * @brief Returns true if the last loop took longer than the budget, so the sheddable tasks are being postponed.
+   */
+  bool isOverloaded() const {
+    return mLoopBudgetMs && mLastLoopElapsedMs > mLoopBudgetMs;
+  }
+
+  /**
+   * @brief Makes every loop walk all the registered tasks instead of running only the due ones from the ready queue.
+   * Only meant to measure the ready queue against the full scan, the scan costs a check per task on each loop.
+   */
+  void setAlwaysFullScan(bool enabled) {
+    mAlwaysFullScan = enabled;
+  }
+
+  /**
+   * @brief Sets the callback called when a task with the OVERRUN_NOTIFY policy exceeds its budget too many times in a row.
+   *
+   * The callback is called from the scheduler loop, after the task has been detached if the policy says so.
+   */
+  void setRunawayCallback(RunawayCallback callback) {
+    mRunawayCallback = callback;
   }
 
   void exportTasksInfo(TaskInfoCallback callback) const {
     if (callback) {
-      mTasks.forEach([&](Pair<const char *, TaskPtr> task) {
-        callback(task.first, task.second->isAttached(), task.second->getTotalElapsedMs());
-      });
+      for (size_t i = 0; i < mSlots.size(); i++) {
+        auto &slot = mSlots[i];
+        if (slot.task) {
+          callback(slot.name, slot.task->isAttached(), slot.task->getTotalElapsedMs());
+        }
+      }
+    }
+  }
+
+  void exportTasksStats(TaskStatsCallback callback) const {
+    if (callback) {
+      for (size_t i = 0; i < mSlots.size(); i++) {
+        auto &slot = mSlots[i];
+        if (slot.task) {
+          callback(slot.name, *slot.task);
+        }
+      }
+    }
+  }
+
+  /**
+   * @brief Lists the tasks with their handles, unlike the names the handles tell apart the tasks that share a name.
+   */
+  void exportTasksHandles(TaskHandleCallback callback) const {
+    if (callback) {
+      for (size_t i = 0; i < mSlots.size(); i++) {
+        auto &slot = mSlots[i];
+        if (slot.task) {
+          callback(slot.name, _makeHandle(i, slot.generation));
+        }
+      }
     }
   }
 
@@ -127,8 +871,360 @@ class TaskScheduler {
     return mTotalElapsedMs;
   }
 
+  uint32_t getRunawayCount() const {
+    return mRunawayCount;
+  }
+
+  /**
+   * @brief Returns the number of loops that had at least one due task, i.e. how often the timers woke the scheduler up.
+   * Tasks that fire together count as a single wakeup, see SchedulerTask::setSlack().
+   */
+  uint32_t getWakeupsCount() const {
+    return mWakeupsCount;
+  }
+
+  /**
+   * @brief Returns the number of times a due sheddable task was postponed because of overload.
+   */
+  uint32_t getShedCount() const {
+    return mShedCount;
+  }
+
  private:
+  struct Slot {
+    const char *name = nullptr;
+    TaskPtr task;
+    uint16_t generation = 1;
+    uint16_t nextFree = NO_SLOT;
+  };
+
+  static constexpr uint16_t NO_SLOT = UINT16_MAX;
+  static constexpr uint16_t EMPTY_ENTRY = 0;  // index entries hold the slot index + 1
+
+  static inline TaskHandle _makeHandle(uint16_t index, uint16_t generation) {
+    return (static_cast<TaskHandle>(generation) << 16) | index;
+  }
+
+  static inline uint16_t _getIndex(TaskHandle handle) {
+    return handle & 0xFFFF;
+  }
+
+  static inline uint16_t _nextGeneration(uint16_t generation) {
+    // zero generation is skipped, so a valid handle is never equal to INVALID_HANDLE
+    return ++generation ? generation : 1;
+  }
+
+  static inline uint32_t _hash(const char *name) {
+    return CRC32(name, strlen(name));
+  }
+
+  bool _isValid(TaskHandle handle) const {
+    auto index = _getIndex(handle);
+    if (handle == INVALID_HANDLE || index >= mSlots.size()) {
+      return false;
+    }
+    auto &slot = mSlots[index];
+    return slot.task && _makeHandle(index, slot.generation) == handle;
+  }
+
+  void _indexInsert(uint16_t index) {
+    // keep the load factor of the open-addressing table below 3/4
+    if (mTasksCount * 4 > mIndex.size() * 3) {
+      _indexRebuild(mIndex.size() ? mIndex.size() * 2 : 16);
+    } else {
+      _indexPlace(index);
+    }
+  }
+
+  void _indexPlace(uint16_t index) {
+    auto mask = mIndex.size() - 1;
+    auto pos = _hash(mSlots[index].name) & mask;
+    while (mIndex[pos] != EMPTY_ENTRY) {
+      pos = (pos + 1) & mask;
+    }
+    mIndex[pos] = index + 1;
+  }
+
+  void _indexErase(uint16_t index) {
+    auto mask = mIndex.size() - 1;
+    auto pos = _hash(mSlots[index].name) & mask;
+    while (mIndex[pos] != index + 1) {
+      pos = (pos + 1) & mask;
+    }
+    // backward shift deletion keeps probe sequences unbroken without tombstones
+    for (auto next = (pos + 1) & mask; mIndex[next] != EMPTY_ENTRY; next = (next + 1) & mask) {
+      auto home = _hash(mSlots[mIndex[next] - 1].name) & mask;
+      if (((next - home) & mask) >= ((next - pos) & mask)) {
+        mIndex[pos] = mIndex[next];
+        pos = next;
+      }
+    }
+    mIndex[pos] = EMPTY_ENTRY;
+  }
+
+  void _indexRebuild(size_t capacity) {
+    Array<uint16_t> index(capacity);
+    while (index.size() < capacity) {
+      index.push(EMPTY_ENTRY);
+    }
+    mIndex = std::move(index);
+    for (size_t i = 0; i < mSlots.size(); i++) {
+      if (mSlots[i].task) {
+        _indexPlace(i);
+      }
+    }
+  }
+
+  void _execute(TaskHandle handle) {
+    // NOTE: a copy keeps the task alive even if it removes itself
+    auto task = get(handle);
+    if (task) {
+      if (task->mSheddable && _shouldShed()) {
+        _shed(handle, *task);
+        return;
+      }
+      {
+        UNIOT_TRACE_SCOPE(TASK, mSlots[_getIndex(handle)].name, handle);
+        task->loop();
+      }
+      yield();
+      if (task->mBudgetMs && task->mOverruns >= task->mMaxOverruns) {
+        _handleRunaway(handle, *task);
+      }
+    }
+  }
+
+  bool _shouldShed() const {
+    return isOverloaded() || (mLoopBudgetMs && millis() - mLoopStartMs > mLoopBudgetMs);
+  }
+
+  void _shed(TaskHandle handle, SchedulerTask &task) {
+    task.mShedCount++;
+    mShedCount++;
+    UNIOT_TRACE_INSTANT(TASK, "shed", handle);
+    // NOTE: the task stays marked as due and the ticks keep counting, so the timer does not queue it again.
+    // The ready queue is only pushed from the timer side, the main loop keeps the postponed tasks on a list of its own
+    if (!mPostponedTasks.push(handle)) {
+      mFullScan = true;
+    }
+  }
+
+  void _handleRunaway(TaskHandle handle, SchedulerTask &task) {
+    // the task might have removed itself, so the name is looked up only if the handle is still valid
+    auto name = _isValid(handle) ? mSlots[_getIndex(handle)].name : "?";
+    mRunawayCount++;
+    task.mOverruns = 0;
+
+    if (task.mOverrunPolicy & SchedulerTask::OVERRUN_LOG) {
+      UNIOT_LOG_WARN("task '%s' exceeded its budget of %lu ms %d times in a row",
+                     name, (unsigned long)task.mBudgetMs, task.mMaxOverruns);
+    }
+    if (task.mOverrunPolicy & SchedulerTask::OVERRUN_DETACH) {
+      task.detach();
+    }
+    if (task.mOverrunPolicy & SchedulerTask::OVERRUN_NOTIFY && mRunawayCallback) {
+      mRunawayCallback(name, handle);
+    }
+  }
+
+  /**
+   * @brief Returns the delay of dueMs, up to maxDelayMs, that lines it up with the ticks of other attached tasks,
+   * the one that shares the most ticks with them and then the smallest one.
+   */
+  uint32_t _findSharedDelay(const SchedulerTask &task, uint32_t dueMs, uint32_t periodMs, uint32_t maxDelayMs) const {
+    uint32_t bestDelayMs = UINT32_MAX;
+    uint32_t bestShared = 0;
+    for (size_t i = 0; i < mSlots.size(); i++) {
+      auto other = mSlots[i].task.get();
+      if (!_isCompatible(task, other, periodMs)) {
+        continue;
+      }
+      // the ticks of both tasks coincide from now on, if the first one falls on a tick of the faster of them
+      auto modulusMs = periodMs < other->mPeriodMs ? periodMs : other->mPeriodMs;
+      uint32_t delayMs = (other->mFirstDueMs % modulusMs + modulusMs - dueMs % modulusMs) % modulusMs;
+      if (delayMs > maxDelayMs) {
+        continue;
+      }
+      auto shared = _countSharedTicks(task, dueMs + delayMs, periodMs);
+      if (shared > bestShared || (shared == bestShared && delayMs < bestDelayMs)) {
+        bestDelayMs = delayMs;
+        bestShared = shared;
+      }
+    }
+    return bestDelayMs;
+  }
+
+  /**
+   * @brief Returns how many ticks per hour a task ticking from firstMs would share with the other attached tasks.
+   */
+  uint32_t _countSharedTicks(const SchedulerTask &task, uint32_t firstMs, uint32_t periodMs) const {
+    static constexpr uint32_t HOUR_MS = 60 * 60 * 1000UL;
+
+    uint32_t shared = 0;
+    for (size_t i = 0; i < mSlots.size(); i++) {
+      auto other = mSlots[i].task.get();
+      if (!_isCompatible(task, other, periodMs)) {
+        continue;
+      }
+      auto otherPeriodMs = other->mPeriodMs;
+      auto modulusMs = periodMs < otherPeriodMs ? periodMs : otherPeriodMs;
+      if (other->mFirstDueMs % modulusMs == firstMs % modulusMs) {
+        // NOTE: one period divides the other, so they meet once per the longer one
+        shared += HOUR_MS / (periodMs > otherPeriodMs ? periodMs : otherPeriodMs) + 1;
+      }
+    }
+    return shared;
+  }
+
+  static bool _isCompatible(const SchedulerTask &task, SchedulerTask *other, uint32_t periodMs) {
+    if (!other || other == &task || !other->mPeriodMs || !other->isAttached()) {
+      return false;
+    }
+    return !(periodMs % other->mPeriodMs) || !(other->mPeriodMs % periodMs);
+  }
+
+  /**
+   * @brief Returns the delay of dueMs that puts it in the middle of the widest gap between the ticks
+   * of the other attached tasks with the same period.
+   */
+  uint32_t _findStaggerDelay(const SchedulerTask &task, uint32_t dueMs, uint32_t periodMs) const {
+    uint32_t phases[UNIOT_SCHEDULER_STAGGER_MAX_TASKS];
+    size_t count = 0;
+    for (size_t i = 0; i < mSlots.size() && count < UNIOT_SCHEDULER_STAGGER_MAX_TASKS; i++) {
+      auto other = mSlots[i].task.get();
+      if (other && other != &task && other->mPeriodMs == periodMs && other->isAttached()) {
+        // insertion sort, there are only a few of them
+        auto phase = other->mFirstDueMs % periodMs;
+        auto j = count++;
+        for (; j > 0 && phases[j - 1] > phase; j--) {
+          phases[j] = phases[j - 1];
+        }
+        phases[j] = phase;
+      }
+    }
+    if (!count) {
+      return 0;
+    }
+
+    uint32_t bestGapMs = 0;
+    uint32_t bestPhase = 0;
+    for (size_t i = 0; i < count; i++) {
+      auto next = i + 1 < count ? phases[i + 1] : phases[0] + periodMs;
+      if (next - phases[i] > bestGapMs) {
+        bestGapMs = next - phases[i];
+        bestPhase = (phases[i] + bestGapMs / 2) % periodMs;
+      }
+    }
+    return (bestPhase + periodMs - dueMs % periodMs) % periodMs;
+  }
+
+  void _recordLoopWork(uint32_t workUs) {
+    mTotalBusyUs += workUs;
+    mLoopWorkCount++;
+    mLoopWorkSumUs += workUs;
+    mLoopWorkSumSqUs += static_cast<uint64_t>(workUs) * workUs;
+    if (workUs > mLoopWorkMaxUs) {
+      mLoopWorkMaxUs = workUs;
+    }
+  }
+
+  static uint32_t _sqrt(uint64_t value) {
+    uint64_t root = 0;
+    for (uint64_t bit = 1ULL << 62; bit; bit >>= 2) {
+      if (value >= root + bit) {
+        value -= root + bit;
+        root = (root >> 1) + bit;
+      } else {
+        root >>= 1;
+      }
+    }
+    return root;
+  }
+
+  void _enqueue(TaskHandle handle) {
+    if (!mReadyTasks.push(handle)) {
+      // the task is still marked as due, so it will be picked up by the full scan
+      mFullScan = true;
+    }
+  }
+
   uint64_t mTotalElapsedMs;
-  ClearQueue<Pair<const char *, TaskPtr>> mTasks;
+  uint32_t mRunawayCount;
+  uint32_t mWakeupsCount;
+  uint32_t mLoopBudgetMs;
+  uint32_t mLoopStartMs;
+  uint32_t mLastLoopElapsedMs;
+  uint32_t mShedCount;
+  bool mStaggerPhases;
+  uint32_t mLoopWorkCount;
+  uint64_t mLoopWorkSumUs;
+  uint64_t mLoopWorkSumSqUs;
+  uint32_t mLoopWorkMaxUs;
+  uint64_t mTotalBusyUs;
+  RunawayCallback mRunawayCallback;
+  volatile bool mFullScan;
+  bool mAlwaysFullScan;
+  uint16_t mFreeSlot;
+  size_t mTasksCount;
+  Array<Slot> mSlots;
+  Array<uint16_t> mIndex;
+  LockFreeQueue<TaskHandle, UNIOT_SCHEDULER_READY_QUEUE_SIZE> mReadyTasks;
+  Array<TaskHandle> mPostponedTasks;
+  Array<TaskHandle> mRetriedTasks;
 };
+
+inline uint32_t SchedulerTask::_alignDelay(uint32_t dueMs, uint32_t periodMs) const {
+  static constexpr uint32_t quanta[] = {1000, 500, 200, 100, 50, 20, 10};
+
+  // NOTE: a one-shot is usually a timeout, so it fires on time
+  if (!periodMs || mRepeatTimes == 1) {
+    return 0;
+  }
+  auto scheduler = mpScheduler;
+  if (!mSlackMs) {
+    // NOTE: the slack lines the ticks up, the staggering spreads them, so only the tasks without slack are staggered
+    auto stagger = scheduler && scheduler->mStaggerPhases;
+    return stagger ? scheduler->_findStaggerDelay(*this, dueMs, periodMs) : 0;
+  }
+  if (scheduler) {
+    auto delayMs = scheduler->_findSharedDelay(*this, dueMs, periodMs, mSlackMs);
+    if (delayMs != UINT32_MAX) {
+      return delayMs;
+    }
+  }
+  // the coarser the grid, the more tasks share it, so the period itself is tried first
+  uint32_t delayMs = (periodMs - dueMs % periodMs) % periodMs;
+  if (delayMs <= mSlackMs) {
+    return delayMs;
+  }
+  for (auto quantumMs : quanta) {
+    if (quantumMs < periodMs && !(periodMs % quantumMs)) {
+      delayMs = (quantumMs - dueMs % quantumMs) % quantumMs;
+      if (delayMs <= mSlackMs) {
+        return delayMs;
+      }
+    }
+  }
+  return 0;
+}
+
+inline SchedulerTask::~SchedulerTask() {
+  auto scheduler = mpScheduler;
+  if (scheduler) {
+    scheduler->remove(*this);
+  }
+  Task::detach();
+  mpDestroy(mCallbackStorage);
+}
+
+inline void SchedulerTask::_onTimer() {
+  mFiredTicks = mFiredTicks + 1;
+  if (!mCanDoHardWork) {
+    mCanDoHardWork = true;
+    auto scheduler = mpScheduler;
+    if (scheduler) {
+      scheduler->_enqueue(mHandle);
+    }
+  }
+}
 }  // namespace uniot
@@ -0,0 +1,256 @@
+/*
+ * This is a part of the Uniot project.
+ * Copyright (C) 2016-2024 Uniot <contact@uniot.io>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#if !defined(ESP8266) && !defined(ESP32)
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace uniot {
+class Task;
+
+/**
+ * @brief A simulated clock that drives the host Task backend.
+ *
+ * Time only moves when it is advanced explicitly, so a simulation is fully deterministic.
+ * Timers fire synchronously from advance() in the order of their deadlines,
+ * the timers with the same deadline fire in the order they were armed (a periodic timer is re-armed each time it fires).
+ * Not thread-safe: the clock and all the tasks must be used from a single thread.
+ */
+class VirtualClock {
+  friend class Task;
+
+ public:
+  VirtualClock() = delete;
+
+  static uint64_t millis() {
+    return _state().nowUs / 1000;
+  }
+
+  static uint64_t micros() {
+    return _state().nowUs;
+  }
+
+  /**
+   * @brief Moves the time forward, firing every timer that becomes due on the way at its exact deadline.
+   */
+  static void advance(uint64_t ms) {
+    advanceUs(ms * 1000);
+  }
+
+  static inline void advanceUs(uint64_t us);
+
+  /**
+   * @brief Runs the loop, skipping the idle time between timer deadlines.
+   *
+   * The loop is called once at the start and then once after each deadline, so a simulation
+   * of hours of device time takes as many iterations as there are timer events.
+   * The loop may advance the clock itself (e.g. with delay()) to simulate the time it takes.
+   *
+   * @param ms The duration of the simulation.
+   * @param loop The function to call, e.g. the scheduler loop.
+   * @return The number of loop iterations.
+   */
+  template <typename Loop>
+  static size_t fastForward(uint64_t ms, Loop loop);
+
+  /**
+   * @brief Returns the time left until the earliest armed timer fires or UINT64_MAX if none is armed.
+   */
+  static inline uint64_t getNextDeadlineMs();
+
+  static size_t getArmedCount() {
+    return _state().armedCount;
+  }
+
+  /**
+   * @brief Rewinds the clock to zero. Must only be called when no timer is armed.
+   */
+  static void reset() {
+    _state().nowUs = 0;
+    _state().sequence = 0;
+  }
+
+ private:
+  struct State {
+    uint64_t nowUs = 0;
+    uint64_t sequence = 0;
+    size_t armedCount = 0;
+    Task *head = nullptr;
+  };
+
+  static State &_state() {
+    static State state;
+    return state;
+  }
+
+  static inline Task *_nextDue(uint64_t limitUs);
+};
+
+class Task {
+  friend class VirtualClock;
+
+ public:
+  using TaskCallback = void (*)(void);
+  using TaskArgCallback = void (*)(void *);
+  template <typename T>
+  using TaskTypeCallback = void (*)(volatile T);
+
+  Task()
+      : mAttached(false),
+        mArmed(false),
+        mDeadlineUs(0),
+        mPeriodUs(0),
+        mSequence(0),
+        mCallback(nullptr),
+        mpArg(nullptr),
+        mpPrev(nullptr),
+        mpNext(nullptr) {}
+
+  virtual ~Task() {
+    detach();
+  }
+
+  void attach(uint32_t ms, bool repeat, TaskCallback callback) {
+    attach_arg(ms, repeat, reinterpret_cast<TaskArgCallback>(callback), nullptr);
+  }
+
+  template <typename T>
+  void attach(uint32_t ms, bool repeat, TaskTypeCallback<volatile T> callback, volatile T arg) {
+    attach_arg(ms, repeat, reinterpret_cast<TaskArgCallback>(callback), reinterpret_cast<volatile void *>(arg));
+  }
+
+  void detach() {
+    _disarm();
+    mAttached = false;
+  }
+
+  // NOTE: as on the device, a one-shot task stays attached after it has fired, until it is detached
+  bool isAttached() {
+    return mAttached;
+  }
+
+ private:
+  bool mAttached;
+  bool mArmed;
+  uint64_t mDeadlineUs;
+  uint64_t mPeriodUs;
+  uint64_t mSequence;
+  TaskArgCallback mCallback;
+  void *mpArg;
+  Task *mpPrev;
+  Task *mpNext;
+
+  void attach_arg(uint32_t ms, bool repeat, TaskArgCallback callback, volatile void *arg) {
+    _disarm();
+
+    auto &state = VirtualClock::_state();
+    mCallback = callback;
+    mpArg = const_cast<void *>(arg);
+    // a zero period would never let the time move, so it is replaced with the smallest possible one
+    mPeriodUs = repeat ? (ms ? ms : 1) * 1000ULL : 0;
+    mDeadlineUs = state.nowUs + ms * 1000ULL;
+    mSequence = state.sequence++;
+    mAttached = true;
+    mArmed = true;
+
+    mpPrev = nullptr;
+    mpNext = state.head;
+    if (state.head) {
+      state.head->mpPrev = this;
+    }
+    state.head = this;
+    state.armedCount++;
+  }
+
+  void _disarm() {
+    if (mArmed) {
+      auto &state = VirtualClock::_state();
+      if (mpPrev) {
+        mpPrev->mpNext = mpNext;
+      } else {
+        state.head = mpNext;
+      }
+      if (mpNext) {
+        mpNext->mpPrev = mpPrev;
+      }
+      mpPrev = mpNext = nullptr;
+      mArmed = false;
+      state.armedCount--;
+    }
+  }
+
+  void _fire() {
+    if (mPeriodUs) {
+      mDeadlineUs += mPeriodUs;
+      mSequence = VirtualClock::_state().sequence++;
+    } else {
+      _disarm();
+    }
+    // NOTE: the callback may detach or re-attach this task or any other one
+    mCallback(mpArg);
+  }
+};
+
+inline Task *VirtualClock::_nextDue(uint64_t limitUs) {
+  Task *next = nullptr;
+  for (auto task = _state().head; task; task = task->mpNext) {
+    if (task->mDeadlineUs <= limitUs &&
+        (!next || task->mDeadlineUs < next->mDeadlineUs ||
+         (task->mDeadlineUs == next->mDeadlineUs && task->mSequence < next->mSequence))) {
+      next = task;
+    }
+  }
+  return next;
+}
+
+inline void VirtualClock::advanceUs(uint64_t us) {
+  auto targetUs = _state().nowUs + us;
+  for (auto task = _nextDue(targetUs); task; task = _nextDue(targetUs)) {
+    _state().nowUs = task->mDeadlineUs;
+    task->_fire();
+  }
+  _state().nowUs = targetUs;
+}
+
+template <typename Loop>
+size_t VirtualClock::fastForward(uint64_t ms, Loop loop) {
+  auto targetUs = _state().nowUs + ms * 1000;
+  size_t iterations = 0;
+  loop();
+  iterations++;
+  for (auto task = _nextDue(targetUs); task; task = _nextDue(targetUs)) {
+    advanceUs(task->mDeadlineUs - _state().nowUs);
+    loop();
+    iterations++;
+  }
+  if (_state().nowUs < targetUs) {
+    _state().nowUs = targetUs;
+  }
+  return iterations;
+}
+
+inline uint64_t VirtualClock::getNextDeadlineMs() {
+  auto task = _nextDue(UINT64_MAX);
+  return task ? (task->mDeadlineUs - _state().nowUs) / 1000 : UINT64_MAX;
+}
+}  // namespace uniot
+
+#endif  // !defined(ESP8266) && !defined(ESP32)
@@ -119,12 +119,11 @@ class Storage {
 
  private:
   Bytes _readSmallFile(File &file) {
-    auto toRead = file.size() - file.position();
-    char *buf = (char *)malloc(toRead);
-    auto countRead = file.readBytes(buf, toRead);
-    const Bytes data((uint8_t *)buf, countRead);
-    free(buf);
-    return data;
+    Bytes data(nullptr, file.size() - file.position());
+    auto countRead = data.fill([&](uint8_t *buf, size_t size) {
+      return file.readBytes((char *)buf, size);
+    });
+    return data.prune(countRead);
   }
 
   static bool sMounted;
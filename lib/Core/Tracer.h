@@ -0,0 +1,195 @@
+/*
+ * This is a part of the Uniot project.
+ * Copyright (C) 2016-2024 Uniot <contact@uniot.io>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <Arduino.h>
+#include <Logger.h>
+#include <Singleton.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#ifndef UNIOT_TRACE_ENABLED
+#define UNIOT_TRACE_ENABLED (UNIOT_LOG_LEVEL_TRACE <= UNIOT_LOG_LEVEL)
+#endif
+
+#ifndef UNIOT_TRACE_BUFFER_SIZE
+#if defined(ESP8266)
+#define UNIOT_TRACE_BUFFER_SIZE 64
+#else
+#define UNIOT_TRACE_BUFFER_SIZE 256
+#endif
+#endif
+
+namespace uniot {
+
+/**
+ * @brief Records what the main loop is doing into a fixed-size ring buffer and exports it
+ * in the Chrome trace event format, which can be opened with chrome://tracing or ui.perfetto.dev.
+ *
+ * A record takes 20 bytes on the device and is written without any allocation, the oldest records are overwritten.
+ * Must only be used from the main loop, not from timer or interrupt contexts.
+ * The names are not copied, so they must outlive the records (string literals, task names).
+ */
+class Tracer : public Singleton<Tracer> {
+  friend class Singleton<Tracer>;
+  static_assert(UNIOT_TRACE_BUFFER_SIZE && !(UNIOT_TRACE_BUFFER_SIZE & (UNIOT_TRACE_BUFFER_SIZE - 1)),
+                "trace buffer size must be a power of two");
+
+ public:
+  enum Category : uint8_t { TASK = 0, EVENT, MQTT, USER };
+
+  /**
+   * @brief Records the time between its construction and destruction as a single complete event.
+   */
+  class Scope {
+   public:
+    Scope(Category category, const char *name, uint32_t arg = 0)
+        : mCategory(category), mpName(name), mArg(arg), mStartUs(micros()) {}
+
+    ~Scope() {
+      uint32_t nowUs = micros();
+      Tracer::getInstance().complete(mCategory, mpName, mStartUs, nowUs - mStartUs, mArg);
+    }
+
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+
+   private:
+    Category mCategory;
+    const char *mpName;
+    uint32_t mArg;
+    uint32_t mStartUs;
+  };
+
+  void complete(Category category, const char *name, uint32_t startUs, uint32_t durationUs, uint32_t arg = 0) {
+    _record(category, PHASE_COMPLETE, name, startUs, durationUs, arg);
+  }
+
+  void instant(Category category, const char *name, uint32_t arg = 0) {
+    _record(category, PHASE_INSTANT, name, micros(), 0, arg);
+  }
+
+  void clear() {
+    mCount = 0;
+  }
+
+  size_t size() const {
+    return mCount < UNIOT_TRACE_BUFFER_SIZE ? mCount : UNIOT_TRACE_BUFFER_SIZE;
+  }
+
+  /**
+   * @brief Returns the number of records lost because the buffer was full.
+   */
+  uint32_t getOverwrittenCount() const {
+    return mCount > UNIOT_TRACE_BUFFER_SIZE ? mCount - UNIOT_TRACE_BUFFER_SIZE : 0;
+  }
+
+  /**
+   * @brief Writes the recorded events as Chrome trace JSON, piece by piece.
+   *
+   * The timestamps are shifted so that the oldest event starts at zero, which also keeps them
+   * monotonic across the 32-bit micros() overflow. Recording is paused during the export,
+   * so the writer may use traced code itself (e.g. publish over MQTT).
+   *
+   * @param write The function called with each null-terminated piece of JSON.
+   */
+  template <typename Writer>
+  void exportChromeTrace(Writer write) {
+    static const char *categories[] = {"task", "event", "mqtt", "user"};
+
+    mPaused = true;
+    auto count = size();
+    auto first = mCount - count;
+    uint32_t nowUs = micros();
+    uint32_t maxAgeUs = 0;
+    for (size_t i = 0; i < count; i++) {
+      uint32_t ageUs = nowUs - _at(first + i).timestampUs;
+      maxAgeUs = ageUs > maxAgeUs ? ageUs : maxAgeUs;
+    }
+
+    write("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+    char buf[160];
+    for (size_t i = 0; i < count; i++) {
+      auto &record = _at(first + i);
+      uint32_t ts = maxAgeUs - (nowUs - record.timestampUs);
+      auto len = snprintf(buf, sizeof(buf), "%s{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"%c\",\"ts\":%lu,",
+                          i ? "," : "", record.name, categories[record.category], record.phase, (unsigned long)ts);
+      if (record.phase == PHASE_COMPLETE) {
+        len += snprintf(buf + len, sizeof(buf) - len, "\"dur\":%lu,", (unsigned long)record.durationUs);
+      } else {
+        len += snprintf(buf + len, sizeof(buf) - len, "\"s\":\"t\",");
+      }
+      snprintf(buf + len, sizeof(buf) - len, "\"pid\":1,\"tid\":1,\"args\":{\"arg\":%lu}}", (unsigned long)record.arg);
+      write(buf);
+    }
+    write("]}");
+    mPaused = false;
+  }
+
+ private:
+  enum Phase : uint8_t { PHASE_COMPLETE = 'X', PHASE_INSTANT = 'i' };
+
+  struct Record {
+    uint32_t timestampUs;
+    uint32_t durationUs;
+    const char *name;
+    uint32_t arg;
+    uint8_t category;
+    uint8_t phase;
+  };
+
+  Tracer() : mCount(0), mPaused(false) {}
+
+  inline void _record(Category category, Phase phase, const char *name, uint32_t timestampUs, uint32_t durationUs, uint32_t arg) {
+    if (mPaused) {
+      return;
+    }
+    auto &record = mRecords[mCount % UNIOT_TRACE_BUFFER_SIZE];
+    record.timestampUs = timestampUs;
+    record.durationUs = durationUs;
+    record.name = name ? name : "?";
+    record.arg = arg;
+    record.category = category;
+    record.phase = phase;
+    mCount++;
+  }
+
+  inline const Record &_at(uint32_t index) const {
+    return mRecords[index % UNIOT_TRACE_BUFFER_SIZE];
+  }
+
+  Record mRecords[UNIOT_TRACE_BUFFER_SIZE];
+  uint32_t mCount;
+  bool mPaused;
+};
+
+}  // namespace uniot
+
+#define UNIOT_TRACE_CONCAT_IMPL(a, b) a##b
+#define UNIOT_TRACE_CONCAT(a, b) UNIOT_TRACE_CONCAT_IMPL(a, b)
+
+#if UNIOT_TRACE_ENABLED
+#define UNIOT_TRACE_SCOPE(category, name, arg) \
+  uniot::Tracer::Scope UNIOT_TRACE_CONCAT(_traceScope, __LINE__)(uniot::Tracer::category, name, arg)
+#define UNIOT_TRACE_INSTANT(category, name, arg) \
+  uniot::Tracer::getInstance().instant(uniot::Tracer::category, name, arg)
+#else
+#define UNIOT_TRACE_SCOPE(...) do {} while (0)
+#define UNIOT_TRACE_INSTANT(...) do {} while (0)
+#endif
@@ -29,6 +29,9 @@ namespace uniot {
 /**
  * @brief A simple Array class that manages a dynamically allocated array and its size.
  *
+ * The storage is raw memory: only the first size() elements are constructed, the rest of the capacity is not.
+ * The elements of trivially copyable types are relocated with memcpy when the storage grows.
+ *
  * @tparam T The type of elements stored in the array.
  */
 template <typename T>
@@ -56,7 +59,7 @@ class Array {
    */
   Array(size_t size, const T* values) : mData(nullptr), mSize(0), mCapacity(0) {
     if (values && size > 0) {
-      mData = new (std::nothrow) T[size];
+      mData = _allocate(size);
       if (!mData) {
         return;
       }
@@ -65,7 +68,7 @@ class Array {
         memcpy(reinterpret_cast<void*>(mData), values, sizeof(T) * size);
       } else {
         for (size_t i = 0; i < size; ++i) {
-          mData[i] = values[i];
+          new (mData + i) T(values[i]);
         }
       }
 
@@ -104,7 +107,8 @@ class Array {
    */
   Array& operator=(Array&& other) noexcept {
     if (this != &other) {
-      delete[] mData;
+      _destroy(0, mSize);
+      _deallocate(mData);
 
       mData = other.mData;
       mSize = other.mSize;
@@ -121,7 +125,8 @@ class Array {
    * @brief Destructor that deallocates the array memory.
    */
   ~Array() {
-    delete[] mData;
+    _destroy(0, mSize);
+    _deallocate(mData);
     mData = nullptr;
     mSize = 0;
     mCapacity = 0;
@@ -216,28 +221,42 @@ class Array {
       return true;
     }
 
-    T* new_data = new (std::nothrow) T[newCapacity];
+    T* new_data = _allocate(newCapacity);
     if (!new_data) {
       return false;
     }
 
-    // Move existing elements
-    for (size_t i = 0; i < mSize; ++i) {
-      new_data[i] = std::move(mData[i]);
-    }
+    _relocate(new_data);
+    mData = new_data;
+    mCapacity = newCapacity;
+    return true;
+  }
 
-    // Initialize new elements
-    if constexpr (std::is_trivially_default_constructible<T>::value) {
-      memset(reinterpret_cast<void*>(new_data + mSize), 0, sizeof(T) * (newCapacity - mSize));
-    } else {
-      for (size_t i = mSize; i < newCapacity; ++i) {
-        new_data[i] = T();
-      }
+  /**
+   * @brief Constructs a new element in place at the end of the array.
+   *
+   * @param args The arguments passed to the constructor of the element.
+   * @return true if the element was added successfully, false otherwise.
+   */
+  template <typename... Args>
+  bool emplace(Args&&... args) {
+    if (mSize < mCapacity) {
+      new (mData + mSize) T(std::forward<Args>(args)...);
+      mSize++;
+      return true;
     }
 
-    delete[] mData;
+    // NOTE: the new element is constructed before the old ones are relocated, the arguments may refer to them
+    size_t newCapacity = (mCapacity == 0) ? 1 : mCapacity * 2;
+    T* new_data = _allocate(newCapacity);
+    if (!new_data) {
+      return false;
+    }
+    new (new_data + mSize) T(std::forward<Args>(args)...);
+    _relocate(new_data);
     mData = new_data;
     mCapacity = newCapacity;
+    mSize++;
     return true;
   }
 
@@ -248,14 +267,7 @@ class Array {
    * @return true if the push was successful, false otherwise.
    */
   bool push(const T& value) {
-    if (mSize >= mCapacity) {
-      size_t newCapacity = (mCapacity == 0) ? 1 : mCapacity * 2;
-      if (!reserve(newCapacity)) {
-        return false;
-      }
-    }
-    mData[mSize++] = value;
-    return true;
+    return emplace(value);
   }
 
   /**
@@ -265,25 +277,14 @@ class Array {
    * @return true if the push was successful, false otherwise.
    */
   bool push(T&& value) {
-    if (mSize >= mCapacity) {
-      size_t newCapacity = (mCapacity == 0) ? 1 : mCapacity * 2;
-      if (!reserve(newCapacity)) {
-        return false;
-      }
-    }
-    mData[mSize++] = std::move(value);
-    return true;
+    return emplace(std::move(value));
   }
 
   /**
    * @brief Clears the array, setting its size to zero.
    */
   void clear() {
-    // if constexpr (!std::is_trivially_destructible<T>::value) {
-    //   for (size_t i = 0; i < mSize; ++i) {
-    //     mData[i].~T();
-    //   }
-    // }
+    _destroy(0, mSize);
     mSize = 0;
   }
 
@@ -299,29 +300,50 @@ class Array {
 
     T* new_data = nullptr;
     if (mSize > 0) {
-      new_data = new (std::nothrow) T[mSize];
+      new_data = _allocate(mSize);
       if (!new_data) {
         return false;
       }
-
-      for (size_t i = 0; i < mSize; ++i) {
-        new_data[i] = std::move(mData[i]);
-      }
     }
 
-    // if constexpr (!std::is_trivially_destructible<T>::value) {
-    //   for (size_t i = mSize; i < mCapacity; ++i) {
-    //     mData[i].~T();
-    //   }
-    // }
-
-    delete[] mData;
+    _relocate(new_data);
     mData = new_data;
     mCapacity = mSize;
     return true;
   }
 
  private:
+  static T* _allocate(size_t count) {
+    return static_cast<T*>(::operator new(sizeof(T) * count, std::nothrow));
+  }
+
+  static void _deallocate(T* data) {
+    ::operator delete(static_cast<void*>(data));
+  }
+
+  void _destroy(size_t from, size_t to) {
+    if constexpr (!std::is_trivially_destructible<T>::value) {
+      for (size_t i = from; i < to; ++i) {
+        mData[i].~T();
+      }
+    }
+  }
+
+  // moves the elements to the new storage and releases the old one
+  void _relocate(T* new_data) {
+    if constexpr (std::is_trivially_copyable<T>::value) {
+      if (mSize) {
+        memcpy(reinterpret_cast<void*>(new_data), mData, sizeof(T) * mSize);
+      }
+    } else {
+      for (size_t i = 0; i < mSize; ++i) {
+        new (new_data + i) T(std::move(mData[i]));
+        mData[i].~T();
+      }
+    }
+    _deallocate(mData);
+  }
+
   T* mData;
   size_t mSize;
   size_t mCapacity;
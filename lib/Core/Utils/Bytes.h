@@ -20,11 +20,38 @@
 
 #include <Common.h>
 #include <Logger.h>
+#include <MemoryProfiler.h>
 #include <WString.h>
 
 #include <functional>
 #include <type_traits>
 
+// payloads up to this size are stored inside the object, e.g. integers, FOURCCs, short SSIDs and event ids
+#ifndef UNIOT_BYTES_INLINE_SIZE
+#define UNIOT_BYTES_INLINE_SIZE 16
+#endif
+
+// the allocator of the heap blocks, UNIOT_BYTES_USE_GLOBAL_BUFFER keeps them out of the system heap
+#if UNIOT_BYTES_USE_GLOBAL_BUFFER
+#include <GlobalBufferMemoryManager.h>
+#define UNIOT_BYTES_MALLOC(size) uniot::GlobalBufferMemoryManager::allocate(size)
+#define UNIOT_BYTES_REALLOC(ptr, size) uniot::GlobalBufferMemoryManager::reallocate(ptr, size)
+#define UNIOT_BYTES_FREE(ptr) uniot::GlobalBufferMemoryManager::deallocate(ptr)
+#elif !defined(UNIOT_BYTES_MALLOC)
+#define UNIOT_BYTES_MALLOC(size) UNIOT_MEM_MALLOC(size)
+#define UNIOT_BYTES_REALLOC(ptr, size) UNIOT_MEM_REALLOC(ptr, size)
+#define UNIOT_BYTES_FREE(ptr) UNIOT_MEM_FREE(ptr)
+#endif
+
+/**
+ * @brief A byte buffer. Payloads up to UNIOT_BYTES_INLINE_SIZE are stored inline.
+ *
+ * Larger payloads live in a reference-counted heap block. Copies and slices of such a payload share the block,
+ * which is copied only when one of the sharers is modified (fill(), terminate(), prune(), assignment), so a payload can be
+ * passed along from receipt to publish without duplicating it. A slice keeps the whole block alive.
+ * The reference counter is atomic, a shared block may be released from another thread,
+ * unless the blocks come from GlobalBufferMemoryManager, which must only be used from the main loop.
+ */
 class Bytes {
  public:
   using Filler = std::function<size_t(uint8_t *buf, size_t size)>;
@@ -53,6 +80,10 @@ class Bytes {
     *this = value;
   }
 
+  Bytes(Bytes &&value) noexcept {
+    _take(value);
+  }
+
   Bytes(const String &value) {
     _init();
     *this = value;
@@ -64,7 +95,13 @@ class Bytes {
 
   Bytes &operator=(const Bytes &rhs) {
     if (this != &rhs) {
-      if (rhs.mBuffer) {
+      if (rhs.mpBlock) {
+        rhs._retain();
+        _release();
+        mpBlock = rhs.mpBlock;
+        mBuffer = rhs.mBuffer;
+        mSize = rhs.mSize;
+      } else if (rhs.mBuffer) {
         _copy(rhs.mBuffer, rhs.mSize);
       } else {
         _invalidate();
@@ -73,6 +110,14 @@ class Bytes {
     return *this;
   }
 
+  Bytes &operator=(Bytes &&rhs) noexcept {
+    if (this != &rhs) {
+      _release();
+      _take(rhs);
+    }
+    return *this;
+  }
+
   Bytes &operator=(const String &rhs) {
     if (rhs.length()) {
       _copy((const uint8_t *)rhs.c_str(), rhs.length());
@@ -95,7 +140,9 @@ class Bytes {
     }
 
     Bytes bytes;
-    bytes._reserve(len / 2);
+    if (!bytes._reserve(len / 2)) {
+      return Bytes();
+    }
     for (size_t i = 0; i < len; i += 2) {
       char buf[3] = {hexStr.charAt(i), hexStr.charAt(i + 1), '\0'};
       uint8_t b = strtol(buf, nullptr, 16);
@@ -105,12 +152,40 @@ class Bytes {
   }
 
   size_t fill(Filler filler) {
-    if (filler) {
+    if (filler && _unshare()) {
       return filler(mBuffer, mSize);
     }
     return 0;
   }
 
+  /**
+   * @brief Returns the bytes in the given range, clamped to the size. A large range shares the heap block.
+   */
+  Bytes slice(size_t offset, size_t length) const {
+    offset = offset < mSize ? offset : mSize;
+    length = length < mSize - offset ? length : mSize - offset;
+    if (!mpBlock || length <= UNIOT_BYTES_INLINE_SIZE) {
+      return length ? Bytes(mBuffer + offset, length) : Bytes();
+    }
+    Bytes part;
+    _retain();
+    part.mpBlock = mpBlock;
+    part.mBuffer = mBuffer + offset;
+    part.mSize = length;
+    return part;
+  }
+
+  /**
+   * @brief Returns true if the heap block is shared with another Bytes, it is copied before a modification.
+   */
+  bool isShared() const {
+#if defined(ESP8266)
+    return mpBlock && mpBlock->refs > 1;
+#else
+    return mpBlock && __atomic_load_n(&mpBlock->refs, __ATOMIC_ACQUIRE) > 1;
+#endif
+  }
+
   Bytes &prune(size_t newSize) {
     if (newSize < mSize) {
       _reserve(newSize);
@@ -166,28 +241,135 @@ class Bytes {
   }
 
  private:
+  struct Block {
+    uint32_t refs;
+    uint32_t capacity;
+
+    uint8_t *data() {
+      return reinterpret_cast<uint8_t *>(this + 1);
+    }
+  };
+
   inline void _init(void) {
     mBuffer = nullptr;
     mSize = 0;
+    mpBlock = nullptr;
   }
 
-  void _invalidate(void) {
-    if (mBuffer) {
-      free(mBuffer);
+  // NOTE: ESP8266 has no threads and no atomic read-modify-write instructions, the counter is plain there
+  inline void _retain() const {
+#if defined(ESP8266)
+    mpBlock->refs++;
+#else
+    __atomic_fetch_add(&mpBlock->refs, 1, __ATOMIC_RELAXED);
+#endif
+  }
+
+  void _release(void) {
+#if defined(ESP8266)
+    if (mpBlock && --mpBlock->refs == 0) {
+#else
+    if (mpBlock && __atomic_sub_fetch(&mpBlock->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+#endif
+      UNIOT_BYTES_FREE(mpBlock);
     }
+    mpBlock = nullptr;
+  }
+
+  void _invalidate(void) {
+    _release();
     _init();
   }
 
+  // takes over the block of the other Bytes or copies its inline bytes, the other one is left empty
+  void _take(Bytes &other) noexcept {
+    mpBlock = other.mpBlock;
+    mSize = other.mSize;
+    if (other.mpBlock) {
+      mBuffer = other.mBuffer;
+    } else if (other.mBuffer) {
+      memcpy(mInline, other.mBuffer, other.mSize);
+      mBuffer = mInline;
+    } else {
+      mBuffer = nullptr;
+    }
+    other._init();
+  }
+
+  bool _unshare() {
+    if (!isShared()) {
+      return true;
+    }
+    auto block = (Block *)UNIOT_BYTES_MALLOC(sizeof(Block) + mSize);
+    if (!block) {
+      return false;
+    }
+    memcpy(block->data(), mBuffer, mSize);
+    block->refs = 1;
+    block->capacity = mSize;
+    _release();
+    mpBlock = block;
+    mBuffer = block->data();
+    return true;
+  }
+
+  inline size_t _capacity() const {
+    if (mpBlock) {
+      return mpBlock->capacity - (mBuffer - mpBlock->data());
+    }
+    return mBuffer ? UNIOT_BYTES_INLINE_SIZE : 0;
+  }
+
   bool _reserve(size_t newSize) {
-    mBuffer = (uint8_t *)realloc(mBuffer, newSize);
-    if (mBuffer && (newSize > mSize)) {
+    if (!newSize) {
+      _invalidate();
+      return false;
+    }
+
+    auto shared = isShared();
+    auto keptSize = mSize < newSize ? mSize : newSize;
+    if (newSize <= UNIOT_BYTES_INLINE_SIZE) {
+      if (mpBlock) {
+        memcpy(mInline, mBuffer, keptSize);
+        _release();
+      }
+      mBuffer = mInline;
+    } else if (shared || !mpBlock || newSize > _capacity() || _capacity() - newSize > UNIOT_BYTES_INLINE_SIZE) {
+      // NOTE: a shrink that would free only a few bytes keeps the block, so a following terminate() does not reallocate
+      Block *block;
+      if (mpBlock && !shared && mBuffer == mpBlock->data()) {
+        block = (Block *)UNIOT_BYTES_REALLOC(mpBlock, sizeof(Block) + newSize);
+      } else {
+        block = (Block *)UNIOT_BYTES_MALLOC(sizeof(Block) + newSize);
+        if (block && mBuffer) {
+          memcpy(block->data(), mBuffer, keptSize);
+        }
+        if (block) {
+          _release();
+        }
+      }
+      if (!block) {
+        _invalidate();
+        return false;
+      }
+      block->refs = 1;
+      block->capacity = newSize;
+      mpBlock = block;
+      mBuffer = block->data();
+    }
+
+    if (newSize > mSize) {
       memset(mBuffer + mSize, 0, newSize - mSize);
     }
     mSize = newSize;
-    return mBuffer;
+    return true;
   }
 
   Bytes &_copy(const uint8_t *data, size_t size) {
+    // NOTE: the old payload is overwritten anyway, so a shared block is let go instead of being copied first
+    if (isShared()) {
+      _invalidate();
+    }
     if (_reserve(size)) {
       memcpy(mBuffer, data, size);
     } else {
@@ -198,4 +380,50 @@ class Bytes {
 
   uint8_t *mBuffer;
   size_t mSize;
+  Block *mpBlock;
+  uint8_t mInline[UNIOT_BYTES_INLINE_SIZE];
+};
+
+/**
+ * @brief A read-only view of bytes owned by someone else, e.g. a Bytes or a buffer of a network client.
+ *
+ * It does not keep the bytes alive, so it is meant for arguments that are only read during the call.
+ */
+class BytesView {
+ public:
+  BytesView() : mpData(nullptr), mSize(0) {}
+
+  BytesView(const uint8_t *data, size_t size) : mpData(data), mSize(data ? size : 0) {}
+
+  BytesView(const Bytes &bytes) : BytesView(bytes.raw(), bytes.size()) {}
+
+  const uint8_t *raw() const {
+    return mpData;
+  }
+
+  size_t size() const {
+    return mSize;
+  }
+
+  bool isEmpty() const {
+    return !mSize;
+  }
+
+  BytesView slice(size_t offset, size_t length) const {
+    offset = offset < mSize ? offset : mSize;
+    length = length < mSize - offset ? length : mSize - offset;
+    return BytesView(mpData + offset, length);
+  }
+
+  Bytes toBytes() const {
+    return Bytes(mpData, mSize);
+  }
+
+  uint32_t checksum() const {
+    return CRC32(mpData, mSize);
+  }
+
+ private:
+  const uint8_t *mpData;
+  size_t mSize;
 };
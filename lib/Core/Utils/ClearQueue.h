@@ -22,10 +22,16 @@
 
 #include <functional>
 
+#include "NodePool.h"
+
 /**
  * std::queue requires much more resources
+ *
+ * The nodes come from the Allocator, by default a pool shared by the queues with the same node layout,
+ * so a queue that is filled and drained all the time does not fragment the heap.
+ * If no node can be allocated, the push methods return false and leave the queue as it was.
  */
-template <typename T>
+template <typename T, typename Allocator = uniot::PoolNodeAllocator<>>
 class ClearQueue {
  public:
   typedef std::function<void(const T &)> VoidCallback;
@@ -36,7 +42,7 @@ class ClearQueue {
   ClearQueue();
   virtual ~ClearQueue();
 
-  void push(const T &value);
+  bool push(const T &value);
   bool pushUnique(const T &value);
   T hardPop();
   const T &hardPeek() const;
@@ -48,6 +54,7 @@ class ClearQueue {
   inline bool isEmpty() const;
   void clean();
   void forEach(VoidCallback callback) const;
+  static size_t trimNodes(size_t spareChunks = 0);
 
  protected:
   typedef struct node {
@@ -57,47 +64,53 @@ class ClearQueue {
 
   pnode mHead;
   pnode mTail;
+
+ private:
+  static pnode _newNode(const T &value);
+  static void _deleteNode(pnode item);
 };
 
-template <typename T>
-ClearQueue<T>::ClearQueue() {
+template <typename T, typename Allocator>
+ClearQueue<T, Allocator>::ClearQueue() {
   mHead = nullptr;
   mTail = nullptr;
 }
 
-template <typename T>
-ClearQueue<T>::~ClearQueue() {
+template <typename T, typename Allocator>
+ClearQueue<T, Allocator>::~ClearQueue() {
   clean();
 }
 
-template <typename T>
-bool ClearQueue<T>::pushUnique(const T &value) {
+template <typename T, typename Allocator>
+bool ClearQueue<T, Allocator>::pushUnique(const T &value) {
   if (!contains(value)) {
-    push(value);
-    return true;
+    return push(value);
   }
   return false;
 }
 
-template <typename T>
-void ClearQueue<T>::push(const T &value) {
-  pnode cur = mTail;
-  mTail = (pnode) new node;
+template <typename T, typename Allocator>
+bool ClearQueue<T, Allocator>::push(const T &value) {
+  pnode fresh = _newNode(value);
+  if (!fresh) {
+    return false;
+  }
 
-  mTail->next = nullptr;
-  mTail->value = value;
+  pnode cur = mTail;
+  mTail = fresh;
   if (isEmpty()) {
     mHead = mTail;
   } else {
     cur->next = mTail;
   }
+  return true;
 }
 
-template <typename T>
-T ClearQueue<T>::hardPop() {
+template <typename T, typename Allocator>
+T ClearQueue<T, Allocator>::hardPop() {
   T value = mHead->value;
   pnode cur = mHead->next;
-  delete mHead;
+  _deleteNode(mHead);
   mHead = cur;
 
   if (mHead == nullptr) {
@@ -107,29 +120,29 @@ T ClearQueue<T>::hardPop() {
   return value;
 }
 
-template <typename T>
-const T &ClearQueue<T>::hardPeek() const {
+template <typename T, typename Allocator>
+const T &ClearQueue<T, Allocator>::hardPeek() const {
   return mHead->value;
 }
 
-template <typename T>
-T ClearQueue<T>::pop(const T &errorCode) {
+template <typename T, typename Allocator>
+T ClearQueue<T, Allocator>::pop(const T &errorCode) {
   if (!isEmpty()) {
     return hardPop();
   }
   return errorCode;
 }
 
-template <typename T>
-const T &ClearQueue<T>::peek(const T &errorCode) const {
+template <typename T, typename Allocator>
+const T &ClearQueue<T, Allocator>::peek(const T &errorCode) const {
   if (!isEmpty()) {
     return hardPeek();
   }
   return errorCode;
 }
 
-template <typename T>
-bool ClearQueue<T>::removeOne(const T &value) {
+template <typename T, typename Allocator>
+bool ClearQueue<T, Allocator>::removeOne(const T &value) {
   if (!isEmpty()) {
     if (mHead->value == value) {
       hardPop();
@@ -138,7 +151,7 @@ bool ClearQueue<T>::removeOne(const T &value) {
     for (pnode cur = mHead; cur->next != nullptr; cur = cur->next) {
       if (cur->next->value == value) {
         pnode newNext = cur->next->next;
-        delete cur->next;
+        _deleteNode(cur->next);
         cur->next = newNext;
 
         if (newNext == nullptr) {
@@ -152,8 +165,8 @@ bool ClearQueue<T>::removeOne(const T &value) {
   return false;
 }
 
-template <typename T>
-bool ClearQueue<T>::contains(const T &value) const {
+template <typename T, typename Allocator>
+bool ClearQueue<T, Allocator>::contains(const T &value) const {
   for (pnode cur = mHead; cur != nullptr; cur = cur->next) {
     if (cur->value == value) {
       return true;
@@ -162,8 +175,8 @@ bool ClearQueue<T>::contains(const T &value) const {
   return false;
 }
 
-template <typename T>
-T *ClearQueue<T>::find(const T &value) const {
+template <typename T, typename Allocator>
+T *ClearQueue<T, Allocator>::find(const T &value) const {
   for (pnode cur = mHead; cur != nullptr; cur = cur->next) {
     if (cur->value == value) {
       return &(cur->value);
@@ -172,25 +185,45 @@ T *ClearQueue<T>::find(const T &value) const {
   return nullptr;
 }
 
-template <typename T>
-inline bool ClearQueue<T>::isEmpty() const {
+template <typename T, typename Allocator>
+inline bool ClearQueue<T, Allocator>::isEmpty() const {
   return mHead == nullptr;
 }
 
-template <typename T>
-void ClearQueue<T>::clean() {
+template <typename T, typename Allocator>
+void ClearQueue<T, Allocator>::clean() {
   for (pnode cur = mHead; cur != nullptr; mHead = cur) {
     cur = mHead->next;
-    delete mHead;
+    _deleteNode(mHead);
   }
 
   mHead = nullptr;
   mTail = nullptr;
 }
 
-template <typename T>
-void ClearQueue<T>::forEach(VoidCallback callback) const {
+template <typename T, typename Allocator>
+void ClearQueue<T, Allocator>::forEach(VoidCallback callback) const {
   for (pnode cur = mHead; cur != nullptr; cur = cur->next) {
     callback(cur->value);
   }
 }
+
+template <typename T, typename Allocator>
+size_t ClearQueue<T, Allocator>::trimNodes(size_t spareChunks) {
+  return Allocator::template trim<node>(spareChunks);
+}
+
+template <typename T, typename Allocator>
+typename ClearQueue<T, Allocator>::pnode ClearQueue<T, Allocator>::_newNode(const T &value) {
+  void *memory = Allocator::template allocate<node>();
+  if (!memory) {
+    return nullptr;
+  }
+  return new (memory) node{value, nullptr};
+}
+
+template <typename T, typename Allocator>
+void ClearQueue<T, Allocator>::_deleteNode(pnode item) {
+  item->~node();
+  Allocator::template deallocate<node>(item);
+}
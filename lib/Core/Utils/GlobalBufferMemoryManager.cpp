@@ -20,177 +20,92 @@
 
 #include <Logger.h>
 
-#include <cassert>
+#include "SegregatedFitHeap.h"
 
 namespace uniot {
 
-uint8_t GlobalBufferMemoryManager::mGlobalBuffer[GlobalBufferMemoryManager::BUFFER_SIZE] = {0};
-GlobalBufferMemoryManager::FreeBlock* GlobalBufferMemoryManager::mFreeList = nullptr;
+using GlobalHeap = SegregatedFitHeap<UNIOT_GLOBAL_BUFFER_SIZE>;
 
-size_t alignSize(size_t size) {
-  const size_t alignment = 4;  // 4-byte alignment
-  return (size + alignment - 1) & ~(alignment - 1);
+// NOTE: constructed on first use, the buffer may be needed by the constructors of other static objects
+static GlobalHeap& globalHeap() {
+  static GlobalHeap heap;
+  return heap;
 }
 
 void GlobalBufferMemoryManager::initialize() {
-  mFreeList = reinterpret_cast<FreeBlock*>(mGlobalBuffer);
-  mFreeList->size = BUFFER_SIZE;
-  mFreeList->next = nullptr;
+  globalHeap().initialize();
 }
 
 void* GlobalBufferMemoryManager::allocate(size_t size) {
-  FreeBlock** prev = &mFreeList;
-  FreeBlock* block = mFreeList;
-
-  size_t alignedSize = alignSize(size + sizeof(FreeBlock)) - sizeof(FreeBlock);
-
-  // Ensure the block size is at least as large as FreeBlock
-  if (alignedSize < sizeof(FreeBlock)) {
-    alignedSize = sizeof(FreeBlock);
-  }
-
-  UNIOT_LOG_DEBUG_IF(DEBUG, "GlobalBufferMemoryManager: Requested size: %d, Adjusted size after alignment: %d", size, alignedSize);
-
-  while (block) {
-    UNIOT_LOG_DEBUG_IF(DEBUG, "GlobalBufferMemoryManager: Checking block of size %d", block->size);
-
-    if (block->size < sizeof(FreeBlock)) {
-      UNIOT_LOG_ERROR("GlobalBufferMemoryManager: Detected a block with invalid size: %d. Possible memory corruption!", block->size);
-      return nullptr;
-    }
-
-    if (block->size >= alignedSize + sizeof(FreeBlock)) {
-      size_t nextBlockSize = block->size - alignedSize - sizeof(FreeBlock);
-
-      // Only split if the next block size is greater than or equal to sizeof(FreeBlock)
-      if (nextBlockSize >= sizeof(FreeBlock) && block->size > alignedSize + 2 * sizeof(FreeBlock)) {
-        // Split the block
-        FreeBlock* nextBlock = reinterpret_cast<FreeBlock*>(reinterpret_cast<uint8_t*>(block) + alignedSize + sizeof(FreeBlock));
-        nextBlock->size = nextBlockSize;
-        nextBlock->next = block->next;
-
-        block->size = alignedSize;
-        block->next = nextBlock;
-
-        // Adjust the previous block to point to the new next block
-        *prev = nextBlock;
-
-        UNIOT_LOG_DEBUG_IF(DEBUG, "GlobalBufferMemoryManager: Block split done, new block of size %d and next block of size %d", block->size, nextBlock->size);
-      } else {
-        // If we can't split, adjust the previous block to point to the next one
-        *prev = block->next;
-      }
-
-      UNIOT_LOG_DEBUG_IF(DEBUG, "GlobalBufferMemoryManager: allocated %d bytes", block->size);
-      return reinterpret_cast<uint8_t*>(block) + sizeof(FreeBlock);
-    }
-
-    prev = &block->next;
-    block = block->next;
-  }
-
-  // No suitable block was found
-  UNIOT_LOG_DEBUG_IF(DEBUG, "GlobalBufferMemoryManager: no suitable block was found for %d bytes", alignedSize);
-  return nullptr;
+  auto ptr = globalHeap().allocate(size);
+  UNIOT_LOG_DEBUG_IF(DEBUG && !ptr, "GlobalBufferMemoryManager: no suitable block was found for %d bytes, the largest one is %d bytes",
+                     size, getLargestFreeBlock());
+  return ptr;
 }
 
 void GlobalBufferMemoryManager::deallocate(void* ptr) {
-  if (!ptr) return;
-
-  FreeBlock* blockToFree = reinterpret_cast<FreeBlock*>(reinterpret_cast<uint8_t*>(ptr) - sizeof(FreeBlock));
+  globalHeap().deallocate(ptr);
+}
 
-  FreeBlock* prev = nullptr;
-  FreeBlock* current = mFreeList;
+void* GlobalBufferMemoryManager::reallocate(void* ptr, size_t newSize) {
+  auto newPtr = globalHeap().reallocate(ptr, newSize);
+  UNIOT_LOG_DEBUG_IF(DEBUG && newSize && !newPtr, "GlobalBufferMemoryManager: failed to reallocate to %d bytes", newSize);
+  return newPtr;
+}
 
-  // Insert the block in its correct position in the sorted free list
-  while (current && current < blockToFree) {
-    prev = current;
-    current = current->next;
-  }
+bool GlobalBufferMemoryManager::owns(const void* ptr) {
+  return globalHeap().owns(ptr);
+}
 
-  if (prev) {
-    // Check if the block to free can be merged with the previous block
-    if (reinterpret_cast<uint8_t*>(prev) + prev->size + sizeof(FreeBlock) == reinterpret_cast<uint8_t*>(blockToFree)) {
-      prev->size += blockToFree->size + sizeof(FreeBlock);
-      blockToFree = prev;
-    } else {
-      prev->next = blockToFree;
-    }
-  } else {
-    mFreeList = blockToFree;
-  }
+size_t GlobalBufferMemoryManager::getTotalFreeMemory() {
+  return globalHeap().getTotalFreeMemory();
+}
 
-  // Additional check to ensure that the blocks are truly adjacent in memory before merging
-  if (current && reinterpret_cast<uint8_t*>(blockToFree) + blockToFree->size + sizeof(FreeBlock) == reinterpret_cast<uint8_t*>(current)) {
-    // Merge blockToFree with current block
-    blockToFree->size += current->size + sizeof(FreeBlock);
-    blockToFree->next = current->next;
-  } else {
-    blockToFree->next = current;
-  }
+size_t GlobalBufferMemoryManager::getLargestFreeBlock() {
+  return globalHeap().getLargestFreeBlock();
+}
 
-  UNIOT_LOG_DEBUG_IF(DEBUG, "GlobalBufferMemoryManager: deallocated %d bytes", blockToFree->size - sizeof(FreeBlock));
+size_t GlobalBufferMemoryManager::getFreeBlocksCount() {
+  return globalHeap().getFreeBlocksCount();
 }
 
-void* GlobalBufferMemoryManager::reallocate(void* ptr, size_t newSize) {
-  UNIOT_LOG_DEBUG_IF(DEBUG, "GlobalBufferMemoryManager: Entering reallocate. Requested newSize: %d", newSize);
+size_t GlobalBufferMemoryManager::getUsedMemory() {
+  return globalHeap().getUsedMemory();
+}
 
-  if (!ptr) {
-    UNIOT_LOG_DEBUG_IF(DEBUG, "GlobalBufferMemoryManager: ptr is null. Redirecting to allocate.");
-    return allocate(newSize);
-  }
+size_t GlobalBufferMemoryManager::getPeakUsedMemory() {
+  return globalHeap().getPeakUsedMemory();
+}
 
-  FreeBlock* block = reinterpret_cast<FreeBlock*>(reinterpret_cast<uint8_t*>(ptr) - sizeof(FreeBlock));
+size_t GlobalBufferMemoryManager::getAllocationsCount() {
+  return globalHeap().getAllocationsCount();
+}
 
-  UNIOT_LOG_DEBUG_IF(DEBUG, "GlobalBufferMemoryManager: Current block size: %d, sizeof(FreeBlock): %d", block->size, sizeof(FreeBlock));
+uint8_t GlobalBufferMemoryManager::getFragmentation() {
+  return globalHeap().getFragmentation();
+}
 
-  // Check if block size is a negative value
-  if (block->size < 0) {
-    UNIOT_LOG_ERROR("GlobalBufferMemoryManager: Detected negative block size: %d. Possible memory corruption!", block->size);
-    return nullptr;  // or handle appropriately
-  }
+}  // namespace uniot
 
-  assert(block->size >= sizeof(FreeBlock));
+void* uniot_global_buffer_malloc(size_t size) {
+  return uniot::GlobalBufferMemoryManager::allocate(size);
+}
 
-  if (block->size >= newSize) {
-    // If the block is big enough, just return the existing pointer
-    UNIOT_LOG_DEBUG_IF(DEBUG, "GlobalBufferMemoryManager: Existing block size is sufficient. Exiting reallocate.");
-    return ptr;
+void* uniot_global_buffer_calloc(size_t count, size_t size) {
+  if (size && count > SIZE_MAX / size) {
+    return nullptr;
   }
-
-  // Otherwise, allocate a new block and copy over the old data
-  void* newPtr = allocate(newSize);
-  if (newPtr) {
-    memcpy(newPtr, ptr, block->size);
-    deallocate(ptr);
-    UNIOT_LOG_DEBUG_IF(DEBUG, "GlobalBufferMemoryManager: Successfully reallocated to new block. Exiting reallocate.");
-  } else {
-    UNIOT_LOG_ERROR("GlobalBufferMemoryManager: Failed to reallocate. Exiting reallocate.");
+  auto ptr = uniot::GlobalBufferMemoryManager::allocate(count * size);
+  if (ptr) {
+    memset(ptr, 0, count * size);
   }
-
-  return newPtr;
+  return ptr;
 }
 
-size_t GlobalBufferMemoryManager::getTotalFreeMemory() {
-  size_t totalFree = 0;
-  FreeBlock* block = mFreeList;
-  while (block) {
-    totalFree += block->size;
-    block = block->next;
-  }
-  return totalFree;
+void* uniot_global_buffer_realloc(void* ptr, size_t size) {
+  return uniot::GlobalBufferMemoryManager::reallocate(ptr, size);
 }
 
-size_t GlobalBufferMemoryManager::getLargestFreeBlock() {
-  size_t largestBlock = 0;
-  FreeBlock* block = mFreeList;
-  while (block) {
-    if (block->size > largestBlock) {
-      largestBlock = block->size;
-    }
-    block = block->next;
-  }
-  return largestBlock;
+void uniot_global_buffer_free(void* ptr) {
+  uniot::GlobalBufferMemoryManager::deallocate(ptr);
 }
-
-}  // namespace uniot
@@ -20,11 +20,22 @@
 
 #include <Arduino.h>
 
+// the size of the buffer, including the headers of the blocks
+#ifndef UNIOT_GLOBAL_BUFFER_SIZE
+#define UNIOT_GLOBAL_BUFFER_SIZE 4096
+#endif
+
 namespace uniot {
 
+/**
+ * @brief Allocates from a single static buffer instead of the system heap, with a SegregatedFitHeap.
+ *
+ * Short-lived payloads kept in the buffer do not fragment the system heap, and the buffer can be watched on its own.
+ * Allocations and deallocations take constant time. Must only be used from the main loop.
+ */
 class GlobalBufferMemoryManager {
  public:
-  // Initialize the memory manager
+  // Free everything allocated so far
   static void initialize();
 
   // Allocate memory from the global buffer
@@ -33,30 +44,43 @@ class GlobalBufferMemoryManager {
   // Deallocate previously allocated memory
   static void deallocate(void* ptr);
 
-  // Resize allocated memory
+  // Resize allocated memory, in place if the next block is free
   static void* reallocate(void* ptr, size_t newSize);
 
+  // Check whether the memory belongs to the global buffer
+  static bool owns(const void* ptr);
+
   // Get the total free memory
   static size_t getTotalFreeMemory();
 
   // Get the largest free block
   static size_t getLargestFreeBlock();
 
- private:
-  struct FreeBlock {
-    size_t size;
-    FreeBlock* next;
-  };
+  // Get the number of free blocks
+  static size_t getFreeBlocksCount();
 
-  // Debug flag
-  static constexpr bool DEBUG = false;
+  // Get the memory held by the allocations
+  static size_t getUsedMemory();
+
+  // Get the highest memory held by the allocations since initialization
+  static size_t getPeakUsedMemory();
 
-  // Size of the global buffer (change as needed)
-  static constexpr size_t BUFFER_SIZE = 4096;
+  // Get the number of live allocations
+  static size_t getAllocationsCount();
 
-  // The global buffer
-  static uint8_t mGlobalBuffer[BUFFER_SIZE];
+  // Get the share of the free memory that cannot be allocated in one piece, in percent
+  static uint8_t getFragmentation();
 
-  static FreeBlock* mFreeList;
+ private:
+  // Debug flag
+  static constexpr bool DEBUG = false;
 };
 }  // namespace uniot
+
+// NOTE: the C entry points let the C libraries (e.g. the CBOR nodes or the Lisp heap) be built on top of the buffer
+extern "C" {
+void* uniot_global_buffer_malloc(size_t size);
+void* uniot_global_buffer_calloc(size_t count, size_t size);
+void* uniot_global_buffer_realloc(void* ptr, size_t size);
+void uniot_global_buffer_free(void* ptr);
+}
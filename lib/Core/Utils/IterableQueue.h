@@ -20,8 +20,8 @@
 
 #include "ClearQueue.h"
 
-template <typename T>
-class IterableQueue : public ClearQueue<T> {
+template <typename T, typename Allocator = uniot::PoolNodeAllocator<>>
+class IterableQueue : public ClearQueue<T, Allocator> {
  public:
   void begin() const;
   bool isEnd() const;
@@ -29,27 +29,27 @@ class IterableQueue : public ClearQueue<T> {
   const T& current() const;
 
  protected:
-  mutable typename ClearQueue<T>::pnode mCurrent;
+  mutable typename ClearQueue<T, Allocator>::pnode mCurrent;
 };
 
-template <typename T>
-void IterableQueue<T>::begin() const {
-  mCurrent = ClearQueue<T>::mHead;
+template <typename T, typename Allocator>
+void IterableQueue<T, Allocator>::begin() const {
+  mCurrent = ClearQueue<T, Allocator>::mHead;
 }
 
-template <typename T>
-bool IterableQueue<T>::isEnd() const {
+template <typename T, typename Allocator>
+bool IterableQueue<T, Allocator>::isEnd() const {
   return !mCurrent;
 }
 
-template <typename T>
-const T& IterableQueue<T>::next() const {
+template <typename T, typename Allocator>
+const T& IterableQueue<T, Allocator>::next() const {
   auto prevCurrent = mCurrent;
   mCurrent = mCurrent->next;
   return prevCurrent->value;
 }
 
-template <typename T>
-const T& IterableQueue<T>::current() const {
+template <typename T, typename Allocator>
+const T& IterableQueue<T, Allocator>::current() const {
   return mCurrent->value;
 }
@@ -20,11 +20,11 @@
 
 #include "ClearQueue.h"
 
-template <typename T>
-class LimitedQueue : public ClearQueue<T> {
+template <typename T, typename Allocator = uniot::PoolNodeAllocator<>>
+class LimitedQueue : public ClearQueue<T, Allocator> {
  public:
   LimitedQueue()
-      : ClearQueue<T>(), mLimit(0), mSize(0) {}
+      : ClearQueue<T, Allocator>(), mLimit(0), mSize(0) {}
 
   inline size_t limit() const {
     return mLimit;
@@ -46,26 +46,29 @@ class LimitedQueue : public ClearQueue<T> {
 
   void applyLimit() {
     for (; mSize > mLimit; --mSize) {
-      ClearQueue<T>::hardPop();
+      ClearQueue<T, Allocator>::hardPop();
     }
   }
 
-  void pushLimited(const T &value) {
-    ClearQueue<T>::push(value);
+  bool pushLimited(const T &value) {
+    if (!ClearQueue<T, Allocator>::push(value)) {
+      return false;
+    }
     mSize++;
     applyLimit();
+    return true;
   }
 
   T popLimited(const T &errorCode) {
     if (mSize) {
       mSize--;
     }
-    return ClearQueue<T>::pop(errorCode);
+    return ClearQueue<T, Allocator>::pop(errorCode);
   }
 
   size_t calcSize() {
     mSize = 0;
-    typename ClearQueue<T>::pnode cur = ClearQueue<T>::mHead;
+    typename ClearQueue<T, Allocator>::pnode cur = ClearQueue<T, Allocator>::mHead;
     while (cur != nullptr) {
       cur = cur->next;
       mSize++;
@@ -74,7 +77,7 @@ class LimitedQueue : public ClearQueue<T> {
   }
 
   void clean() {
-    ClearQueue<T>::clean();
+    ClearQueue<T, Allocator>::clean();
     mSize = 0;
   }
 
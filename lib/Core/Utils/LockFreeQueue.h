@@ -0,0 +1,99 @@
+/*
+ * This is a part of the Uniot project.
+ * Copyright (C) 2016-2024 Uniot <contact@uniot.io>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stddef.h>
+
+#include <atomic>
+
+namespace uniot {
+
+/**
+ * @brief A fixed-size single-producer single-consumer ring buffer.
+ *
+ * The producer (e.g. a timer callback) and the consumer (e.g. the main loop) may run
+ * in different contexts without any locking. No memory is allocated after construction.
+ *
+ * @tparam T The type of the stored elements. Should be cheap to copy.
+ * @tparam N The capacity of the queue. Must be a power of two.
+ */
+template <typename T, size_t N>
+class LockFreeQueue {
+  static_assert(N && !(N & (N - 1)), "capacity must be a power of two");
+
+ public:
+  LockFreeQueue() : mHead(0), mTail(0) {}
+
+  LockFreeQueue(LockFreeQueue const &) = delete;
+  void operator=(LockFreeQueue const &) = delete;
+
+  /**
+   * @brief Appends a value. Must only be called from the producer context.
+   *
+   * @param value The value to append.
+   * @return true if the value was appended, false if the queue is full.
+   */
+  bool push(const T &value) {
+    auto tail = mTail.load(std::memory_order_relaxed);
+    if (tail - mHead.load(std::memory_order_acquire) >= N) {
+      return false;
+    }
+    mBuffer[tail & (N - 1)] = value;
+    mTail.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  /**
+   * @brief Removes the oldest value. Must only be called from the consumer context.
+   *
+   * @param outValue Reference to store the removed value.
+   * @return true if a value was removed, false if the queue is empty.
+   */
+  bool pop(T &outValue) {
+    auto head = mHead.load(std::memory_order_relaxed);
+    if (head == mTail.load(std::memory_order_acquire)) {
+      return false;
+    }
+    outValue = mBuffer[head & (N - 1)];
+    mHead.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  /**
+   * @brief Returns the number of queued values as seen at the moment of the call.
+   */
+  size_t size() const {
+    return mTail.load(std::memory_order_acquire) - mHead.load(std::memory_order_acquire);
+  }
+
+  inline bool isEmpty() const {
+    return !size();
+  }
+
+  static constexpr size_t capacity() {
+    return N;
+  }
+
+ private:
+  T mBuffer[N];
+  std::atomic<size_t> mHead;
+  std::atomic<size_t> mTail;
+};
+
+}  // namespace uniot
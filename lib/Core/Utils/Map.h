@@ -19,34 +19,175 @@
 #pragma once
 
 #include <Common.h>
+#include <stddef.h>
+#include <stdint.h>
 
-#include "IterableQueue.h"
+#include <functional>
+#include <new>
+#include <type_traits>
+#include <utility>
 
 namespace uniot {
 
 /**
- * @brief A simple map class that associates keys with values using an iterable queue.
+ * @brief The default hash of the Map keys: FNV-1a over the characters of strings (String, std::string),
+ * a mix of the bits of integers, enums and pointers.
+ */
+template <typename T_Key>
+struct MapHash {
+  uint32_t operator()(const T_Key& key) const {
+    return _hash(key, 0);
+  }
+
+ private:
+  template <typename K>
+  static auto _hash(const K& key, int) -> decltype(key.c_str(), key.length(), uint32_t()) {
+    uint32_t hash = 2166136261u;
+    auto str = key.c_str();
+    for (size_t i = 0, length = key.length(); i < length; i++) {
+      hash = (hash ^ static_cast<uint8_t>(str[i])) * 16777619u;
+    }
+    return hash;
+  }
+
+  template <typename K>
+  static uint32_t _hash(const K& key, long) {
+    return _mix(_toInteger(key));
+  }
+
+  template <typename K>
+  static typename std::enable_if<std::is_enum<K>::value, uint64_t>::type _toInteger(const K& key) {
+    return static_cast<uint64_t>(key);
+  }
+
+  template <typename K>
+  static typename std::enable_if<std::is_integral<K>::value, uint64_t>::type _toInteger(const K& key) {
+    return static_cast<uint64_t>(key);
+  }
+
+  template <typename K>
+  static uint64_t _toInteger(K* key) {
+    return reinterpret_cast<uintptr_t>(key);
+  }
+
+  static uint32_t _mix(uint64_t value) {
+    // NOTE: the finalizer of MurmurHash3, the low bits of the result select the slot
+    uint32_t hash = static_cast<uint32_t>(value ^ (value >> 32));
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6bu;
+    hash ^= hash >> 13;
+    hash *= 0xc2b2ae35u;
+    hash ^= hash >> 16;
+    return hash;
+  }
+};
+
+/**
+ * @brief A map that associates keys with values, an open-addressing hash table with linear probing.
+ *
+ * The items are stored in a single contiguous block, so a lookup takes one hash and usually one comparison.
+ * Iteration goes through iterators (or forEach) rather than a cursor shared by the map, so it is safe to nest
+ * and to look items up while iterating. Putting or removing items invalidates the iterators and the references
+ * returned by get(), since the items may be moved.
  *
  * @tparam T_Key The type of the keys.
  * @tparam T_Value The type of the values.
+ * @tparam T_Hash The hash function of the keys.
  */
-template <typename T_Key, typename T_Value>
-class Map : public IterableQueue<Pair<T_Key, T_Value>> {
+template <typename T_Key, typename T_Value, typename T_Hash = MapHash<T_Key>>
+class Map {
  public:
   using MapItem = Pair<T_Key, T_Value>;
+  using VoidCallback = std::function<void(const MapItem&)>;
+
+ private:
+  struct Slot {
+    bool used = false;
+    uint32_t hash = 0;
+    alignas(MapItem) unsigned char storage[sizeof(MapItem)];
+
+    MapItem& item() {
+      return *reinterpret_cast<MapItem*>(storage);
+    }
+
+    const MapItem& item() const {
+      return *reinterpret_cast<const MapItem*>(storage);
+    }
+  };
+
+ public:
+  class Iterator {
+   public:
+    Iterator(const Slot* slot, const Slot* end) : mpSlot(slot), mpEnd(end) {
+      _skipFree();
+    }
+
+    const MapItem& operator*() const {
+      return mpSlot->item();
+    }
+
+    const MapItem* operator->() const {
+      return &mpSlot->item();
+    }
+
+    Iterator& operator++() {
+      ++mpSlot;
+      _skipFree();
+      return *this;
+    }
+
+    bool operator==(const Iterator& other) const {
+      return mpSlot == other.mpSlot;
+    }
+
+    bool operator!=(const Iterator& other) const {
+      return mpSlot != other.mpSlot;
+    }
+
+   private:
+    void _skipFree() {
+      while (mpSlot != mpEnd && !mpSlot->used) {
+        ++mpSlot;
+      }
+    }
+
+    const Slot* mpSlot;
+    const Slot* mpEnd;
+  };
+
+  Map() : mpSlots(nullptr), mCapacity(0), mSize(0) {}
+
+  Map(Map const&) = delete;
+  void operator=(Map const&) = delete;
+
+  ~Map() {
+    clean();
+  }
 
   /**
    * @brief Inserts a key-value pair into the map.
    *
    * @param key The key to insert.
    * @param value The value to associate with the key.
-   * @return true if insertion was successful, false if the key already exists.
+   * @return true if insertion was successful, false if the key already exists or there is no memory.
    */
   bool put(const T_Key& key, const T_Value& value) {
-    if (exist(key)) {
+    auto hash = mHash(key);
+    if (_find(key, hash) != NOT_FOUND) {
       return false;
     }
-    IterableQueue<MapItem>::push(MakePair(key, value));
+    // NOTE: the table is kept at most 3/4 full, so a probe always ends on a free slot
+    if ((mSize + 1) * 4 > mCapacity * 3 && !_rehash(mCapacity ? mCapacity * 2 : MIN_CAPACITY)) {
+      return false;
+    }
+    auto index = _home(hash);
+    while (mpSlots[index].used) {
+      index = _nextIndex(index);
+    }
+    new (mpSlots[index].storage) MapItem(key, value);
+    mpSlots[index].hash = hash;
+    mpSlots[index].used = true;
+    mSize++;
     return true;
   }
 
@@ -58,15 +199,8 @@ class Map : public IterableQueue<Pair<T_Key, T_Value>> {
    * @return The associated value if found, otherwise defaultValue.
    */
   const T_Value& get(const T_Key& key, const T_Value& defaultValue = {}) const {
-    IterableQueue<MapItem>::begin();
-    while (!IterableQueue<MapItem>::isEnd()) {
-      auto &item = IterableQueue<MapItem>::current();
-      if (item.first == key) {
-        return item.second;
-      }
-      IterableQueue<MapItem>::next();
-    }
-    return defaultValue;
+    auto index = _find(key, mHash(key));
+    return index != NOT_FOUND ? mpSlots[index].item().second : defaultValue;
   }
 
   /**
@@ -76,15 +210,7 @@ class Map : public IterableQueue<Pair<T_Key, T_Value>> {
    * @return true if the key exists, false otherwise.
    */
   bool exist(const T_Key& key) const {
-    IterableQueue<MapItem>::begin();
-    while (!IterableQueue<MapItem>::isEnd()) {
-      auto item = IterableQueue<MapItem>::current();
-      if (item.first == key) {
-        return true;
-      }
-      IterableQueue<MapItem>::next();
-    }
-    return false;
+    return _find(key, mHash(key)) != NOT_FOUND;
   }
 
   /**
@@ -94,16 +220,131 @@ class Map : public IterableQueue<Pair<T_Key, T_Value>> {
    * @return true if removal was successful, false if the key was not found.
    */
   bool remove(const T_Key& key) {
-    IterableQueue<MapItem>::begin();
-    while (!IterableQueue<MapItem>::isEnd()) {
-      auto& item = IterableQueue<MapItem>::current();
-      if (item.first == key) {
-        return IterableQueue<MapItem>::removeOne(item);
+    auto index = _find(key, mHash(key));
+    if (index == NOT_FOUND) {
+      return false;
+    }
+    mpSlots[index].item().~MapItem();
+    mpSlots[index].used = false;
+    mSize--;
+
+    // NOTE: the following items of the cluster are shifted back instead of leaving a tombstone,
+    // so lookups never scan deleted slots
+    for (auto next = _nextIndex(index); mpSlots[next].used; next = _nextIndex(next)) {
+      auto home = _home(mpSlots[next].hash);
+      if (((next - home) & (mCapacity - 1)) < ((next - index) & (mCapacity - 1))) {
+        continue;  // the gap is before the home slot of the item
+      }
+      _move(next, index);
+      index = next;
+    }
+    return true;
+  }
+
+  /**
+   * @brief Removes all the items and releases the table.
+   */
+  void clean() {
+    for (size_t i = 0; i < mCapacity; i++) {
+      if (mpSlots[i].used) {
+        mpSlots[i].item().~MapItem();
+      }
+    }
+    delete[] mpSlots;
+    mpSlots = nullptr;
+    mCapacity = 0;
+    mSize = 0;
+  }
+
+  inline bool isEmpty() const {
+    return !mSize;
+  }
+
+  inline size_t size() const {
+    return mSize;
+  }
+
+  inline size_t capacity() const {
+    return mCapacity;
+  }
+
+  Iterator begin() const {
+    return Iterator(mpSlots, mpSlots + mCapacity);
+  }
+
+  Iterator end() const {
+    return Iterator(mpSlots + mCapacity, mpSlots + mCapacity);
+  }
+
+  void forEach(VoidCallback callback) const {
+    for (auto& item : *this) {
+      callback(item);
+    }
+  }
+
+ private:
+  static constexpr size_t NOT_FOUND = SIZE_MAX;
+  static constexpr size_t MIN_CAPACITY = 8;
+
+  inline size_t _home(uint32_t hash) const {
+    return hash & (mCapacity - 1);
+  }
+
+  inline size_t _nextIndex(size_t index) const {
+    return (index + 1) & (mCapacity - 1);
+  }
+
+  size_t _find(const T_Key& key, uint32_t hash) const {
+    if (!mSize) {
+      return NOT_FOUND;
+    }
+    for (auto index = _home(hash); mpSlots[index].used; index = _nextIndex(index)) {
+      if (mpSlots[index].hash == hash && mpSlots[index].item().first == key) {
+        return index;
+      }
+    }
+    return NOT_FOUND;
+  }
+
+  void _move(size_t from, size_t to) {
+    new (mpSlots[to].storage) MapItem(std::move(mpSlots[from].item()));
+    mpSlots[to].hash = mpSlots[from].hash;
+    mpSlots[to].used = true;
+    mpSlots[from].item().~MapItem();
+    mpSlots[from].used = false;
+  }
+
+  bool _rehash(size_t capacity) {
+    auto slots = new (std::nothrow) Slot[capacity];
+    if (!slots) {
+      return false;
+    }
+    auto oldSlots = mpSlots;
+    auto oldCapacity = mCapacity;
+    mpSlots = slots;
+    mCapacity = capacity;
+    for (size_t i = 0; i < oldCapacity; i++) {
+      auto& slot = oldSlots[i];
+      if (!slot.used) {
+        continue;
       }
-      IterableQueue<MapItem>::next();
+      auto index = _home(slot.hash);
+      while (mpSlots[index].used) {
+        index = _nextIndex(index);
+      }
+      new (mpSlots[index].storage) MapItem(std::move(slot.item()));
+      mpSlots[index].hash = slot.hash;
+      mpSlots[index].used = true;
+      slot.item().~MapItem();
     }
-    return false;
+    delete[] oldSlots;
+    return true;
   }
+
+  Slot* mpSlots;
+  size_t mCapacity;
+  size_t mSize;
+  T_Hash mHash;
 };
 
 }  // namespace uniot
@@ -0,0 +1,251 @@
+/*
+ * This is a part of the Uniot project.
+ * Copyright (C) 2016-2024 Uniot <contact@uniot.io>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <MemoryProfiler.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <new>
+
+#if !defined(ESP8266)
+#include <mutex>
+#endif
+
+// the number of nodes carved out of the heap at once, one chunk is a single allocation
+#ifndef UNIOT_NODE_POOL_CHUNK_SIZE
+#define UNIOT_NODE_POOL_CHUNK_SIZE 8
+#endif
+
+namespace uniot {
+
+/**
+ * @brief A free list of fixed-size slots, carved out of the heap a chunk at a time.
+ *
+ * A released slot goes back to the free list and is reused by the next allocation, so a container
+ * that keeps pushing and popping reaches its high-water mark and stops touching the heap.
+ * Chunks are only returned to the heap by trim(), once all their slots are free.
+ *
+ * There is one pool per slot size, alignment and chunk size, shared by every container with the same node layout.
+ * It is never destroyed, so that containers with static storage can release their nodes at exit.
+ * On ESP32 and the host the pool is guarded by a mutex, as containers may live on the executor threads.
+ *
+ * @tparam Size The size of a slot.
+ * @tparam Align The alignment of a slot.
+ * @tparam ChunkSize The number of slots in a chunk.
+ */
+template <size_t Size, size_t Align, size_t ChunkSize = UNIOT_NODE_POOL_CHUNK_SIZE>
+class NodePool {
+  static_assert(ChunkSize > 0, "chunk size must not be zero");
+  static_assert(Align <= alignof(max_align_t), "the alignment is not supported by malloc");
+
+ public:
+  NodePool(NodePool const &) = delete;
+  void operator=(NodePool const &) = delete;
+
+  static NodePool &shared() {
+    static NodePool *pool = new NodePool();
+    return *pool;
+  }
+
+  /**
+   * @brief Returns an uninitialized slot or nullptr if the heap is exhausted.
+   */
+  void *allocate() {
+#if !defined(ESP8266)
+    std::lock_guard<std::mutex> lock(mMutex);
+#endif
+    if (!mpFree && !_grow()) {
+      return nullptr;
+    }
+    auto slot = mpFree;
+    mpFree = slot->next;
+    mUsedCount++;
+    return slot->data;
+  }
+
+  void deallocate(void *ptr) {
+    if (!ptr) {
+      return;
+    }
+#if !defined(ESP8266)
+    std::lock_guard<std::mutex> lock(mMutex);
+#endif
+    auto slot = reinterpret_cast<Slot *>(ptr);
+    slot->next = mpFree;
+    mpFree = slot;
+    mUsedCount--;
+  }
+
+  /**
+   * @brief Returns the chunks with no used slots to the heap, e.g. after a burst of events has been handled.
+   *
+   * @param spareChunks The number of free chunks kept for the next allocations.
+   * @return The number of released chunks.
+   */
+  size_t trim(size_t spareChunks = 0) {
+#if !defined(ESP8266)
+    std::lock_guard<std::mutex> lock(mMutex);
+#endif
+    // NOTE: without this many free slots no chunk beyond the spare ones can be free, so the free list is not walked
+    if (getCapacity() - mUsedCount < (spareChunks + 1) * ChunkSize) {
+      return 0;
+    }
+    size_t released = 0;
+    for (Chunk **link = &mpChunks; *link;) {
+      auto chunk = *link;
+      if (_countFree(chunk) < ChunkSize) {
+        link = &chunk->next;
+        continue;
+      }
+      if (spareChunks) {
+        spareChunks--;
+        link = &chunk->next;
+        continue;
+      }
+      for (Slot **freeLink = &mpFree; *freeLink;) {
+        if (_owns(chunk, *freeLink)) {
+          *freeLink = (*freeLink)->next;
+        } else {
+          freeLink = &(*freeLink)->next;
+        }
+      }
+      *link = chunk->next;
+      UNIOT_MEM_FREE(chunk);
+      mChunksCount--;
+      released++;
+    }
+    return released;
+  }
+
+  size_t getChunksCount() const {
+    return mChunksCount;
+  }
+
+  size_t getUsedCount() const {
+    return mUsedCount;
+  }
+
+  size_t getCapacity() const {
+    return mChunksCount * ChunkSize;
+  }
+
+ private:
+  static constexpr size_t SLOT_ALIGN = Align > alignof(void *) ? Align : alignof(void *);
+
+  struct alignas(SLOT_ALIGN) Slot {
+    union {
+      Slot *next;
+      unsigned char data[Size];
+    };
+  };
+
+  struct Chunk {
+    Chunk *next;
+    Slot slots[ChunkSize];
+  };
+
+  NodePool() : mpChunks(nullptr), mpFree(nullptr), mChunksCount(0), mUsedCount(0) {}
+
+  bool _grow() {
+    UNIOT_MEM_SCOPE(QUEUE);
+    auto chunk = static_cast<Chunk *>(UNIOT_MEM_MALLOC(sizeof(Chunk)));
+    if (!chunk) {
+      return false;
+    }
+    chunk->next = mpChunks;
+    mpChunks = chunk;
+    mChunksCount++;
+    // NOTE: the slots are handed out in the order of their addresses
+    for (size_t i = ChunkSize; i > 0; i--) {
+      chunk->slots[i - 1].next = mpFree;
+      mpFree = &chunk->slots[i - 1];
+    }
+    return true;
+  }
+
+  static bool _owns(const Chunk *chunk, const Slot *slot) {
+    return slot >= chunk->slots && slot < chunk->slots + ChunkSize;
+  }
+
+  size_t _countFree(const Chunk *chunk) const {
+    size_t count = 0;
+    for (auto slot = mpFree; slot && count < ChunkSize; slot = slot->next) {
+      count += _owns(chunk, slot);
+    }
+    return count;
+  }
+
+  Chunk *mpChunks;
+  Slot *mpFree;
+  size_t mChunksCount;
+  size_t mUsedCount;
+#if !defined(ESP8266)
+  std::mutex mMutex;
+#endif
+};
+
+/**
+ * @brief Allocates the nodes of a container with the global allocator, one heap block per node.
+ */
+struct HeapNodeAllocator {
+  template <typename Node>
+  static void *allocate() {
+    return ::operator new(sizeof(Node), std::nothrow);
+  }
+
+  template <typename Node>
+  static void deallocate(void *ptr) {
+    ::operator delete(ptr);
+  }
+
+  template <typename Node>
+  static size_t trim(size_t spareChunks) {
+    return 0;
+  }
+};
+
+/**
+ * @brief Allocates the nodes of a container from the shared NodePool of their layout.
+ *
+ * @tparam ChunkSize The number of nodes carved out of the heap at once.
+ */
+template <size_t ChunkSize = UNIOT_NODE_POOL_CHUNK_SIZE>
+struct PoolNodeAllocator {
+  template <typename Node>
+  using Pool = NodePool<sizeof(Node), alignof(Node), ChunkSize>;
+
+  template <typename Node>
+  static void *allocate() {
+    return Pool<Node>::shared().allocate();
+  }
+
+  template <typename Node>
+  static void deallocate(void *ptr) {
+    Pool<Node>::shared().deallocate(ptr);
+  }
+
+  template <typename Node>
+  static size_t trim(size_t spareChunks) {
+    return Pool<Node>::shared().trim(spareChunks);
+  }
+};
+
+}  // namespace uniot
@@ -0,0 +1,399 @@
+/*
+ * This is a part of the Uniot project.
+ * Copyright (C) 2016-2024 Uniot <contact@uniot.io>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+namespace uniot {
+
+/**
+ * @brief A two-level segregated-fit (TLSF) allocator over a fixed buffer.
+ *
+ * The free blocks are kept in lists by size class. The first level splits the sizes by powers of two, the second one
+ * divides each power of two into SL_COUNT linear steps, and a bitmap per level tells which lists are not empty.
+ * A fitting block is found with two bit scans, so allocate() and deallocate() take constant time however many blocks
+ * there are. A freed block is merged with its free neighbours at once, and reallocate() grows a block in place
+ * when the block after it is free.
+ *
+ * Every block starts with a header holding the previous block in memory and its own size,
+ * a free block also keeps its list links in the payload. Payloads are aligned to ALIGNMENT.
+ * Not thread-safe.
+ *
+ * @tparam Size The size of the buffer, including the headers.
+ */
+template <size_t Size>
+class SegregatedFitHeap {
+ public:
+  static constexpr size_t ALIGNMENT = 8;
+
+ private:
+  struct Block {
+    Block *prevPhys;
+    size_t sizeAndFlags;
+    // NOTE: the links are only valid while the block is free, they are a part of the payload otherwise
+    Block *nextFree;
+    Block *prevFree;
+
+    inline size_t size() const {
+      return sizeAndFlags & ~FREE_FLAG;
+    }
+
+    inline bool isFree() const {
+      return sizeAndFlags & FREE_FLAG;
+    }
+  };
+
+  static constexpr size_t FREE_FLAG = 1;
+  static constexpr size_t HEADER_SIZE = offsetof(Block, nextFree);
+  static constexpr size_t MIN_PAYLOAD = sizeof(Block) - HEADER_SIZE;
+
+  static constexpr uint8_t ALIGNMENT_LOG2 = 3;
+  static constexpr uint8_t SL_LOG2 = 4;
+  static constexpr uint8_t SL_COUNT = 1 << SL_LOG2;
+  static constexpr uint8_t FL_SHIFT = SL_LOG2 + ALIGNMENT_LOG2;
+  static constexpr size_t SMALL_SIZE = 1 << FL_SHIFT;  // the sizes below are split linearly by ALIGNMENT
+
+  static constexpr uint8_t _log2(size_t value) {
+    return value > 1 ? 1 + _log2(value >> 1) : 0;
+  }
+
+  static constexpr uint8_t FL_COUNT = _log2(Size) - FL_SHIFT + 2;
+  static constexpr size_t MAX_PAYLOAD = Size - 2 * HEADER_SIZE;
+
+  static_assert((1 << ALIGNMENT_LOG2) == ALIGNMENT, "alignment mismatch");
+  static_assert(HEADER_SIZE % ALIGNMENT == 0 && MIN_PAYLOAD % ALIGNMENT == 0, "the header breaks the alignment");
+  static_assert(Size % ALIGNMENT == 0, "the buffer size must be a multiple of the alignment");
+  static_assert(Size >= 2 * SMALL_SIZE, "the buffer is too small");
+  static_assert(FL_COUNT < 32, "the buffer is too large for the first-level bitmap");
+
+ public:
+  SegregatedFitHeap() {
+    initialize();
+  }
+
+  SegregatedFitHeap(SegregatedFitHeap const &) = delete;
+  void operator=(SegregatedFitHeap const &) = delete;
+
+  /**
+   * @brief Frees everything at once, leaving a single free block followed by a sentinel.
+   */
+  void initialize() {
+    memset(mFreeLists, 0, sizeof(mFreeLists));
+    memset(mSlBitmaps, 0, sizeof(mSlBitmaps));
+    mFlBitmap = 0;
+    mFreeBytes = 0;
+    mFreeBlocksCount = 0;
+    mUsedBytes = 0;
+    mPeakUsedBytes = 0;
+    mAllocationsCount = 0;
+
+    auto first = reinterpret_cast<Block *>(mBuffer);
+    first->prevPhys = nullptr;
+    first->sizeAndFlags = MAX_PAYLOAD;
+    // NOTE: the sentinel is a used block of size zero, so that the last block never looks past the buffer
+    auto sentinel = _next(first);
+    sentinel->prevPhys = first;
+    sentinel->sizeAndFlags = 0;
+    _insert(first);
+  }
+
+  /**
+   * @brief Returns an aligned block of at least the given size or nullptr if no free block is large enough.
+   */
+  void *allocate(size_t size) {
+    if (!size || size > MAX_PAYLOAD) {
+      return nullptr;
+    }
+    size = _adjust(size);
+    auto block = _findSuitable(size);
+    if (!block) {
+      return nullptr;
+    }
+    _remove(block);
+    _split(block, size);
+    mAllocationsCount++;
+    _addUsed(block->size());
+    return _payload(block);
+  }
+
+  void deallocate(void *ptr) {
+    if (!ptr) {
+      return;
+    }
+    auto block = _blockOf(ptr);
+    mAllocationsCount--;
+    mUsedBytes -= block->size();
+    _free(block);
+  }
+
+  /**
+   * @brief Resizes the block as realloc() does. The block grows in place if the next one is free and large enough,
+   * a shrunk block gives its tail back. The original block is left untouched if the new size cannot be allocated.
+   */
+  void *reallocate(void *ptr, size_t newSize) {
+    if (!ptr) {
+      return allocate(newSize);
+    }
+    if (!newSize) {
+      deallocate(ptr);
+      return nullptr;
+    }
+    if (newSize > MAX_PAYLOAD) {
+      return nullptr;
+    }
+
+    auto block = _blockOf(ptr);
+    auto size = block->size();
+    newSize = _adjust(newSize);
+    mUsedBytes -= size;
+    if (newSize > size) {
+      auto next = _next(block);
+      if (next->isFree() && size + HEADER_SIZE + next->size() >= newSize) {
+        _remove(next);
+        _absorbNext(block);
+      } else {
+        mUsedBytes += size;
+        auto newPtr = allocate(newSize);
+        if (newPtr) {
+          memcpy(newPtr, ptr, size);
+          deallocate(ptr);
+        }
+        return newPtr;
+      }
+    }
+    _split(block, newSize);
+    _addUsed(block->size());
+    return ptr;
+  }
+
+  bool owns(const void *ptr) const {
+    return ptr >= mBuffer && ptr < mBuffer + Size;
+  }
+
+  /**
+   * @brief Returns the usable size of an allocated block, which may be larger than requested.
+   */
+  size_t getBlockSize(const void *ptr) const {
+    return ptr ? _blockOf(const_cast<void *>(ptr))->size() : 0;
+  }
+
+  size_t getTotalFreeMemory() const {
+    return mFreeBytes;
+  }
+
+  /**
+   * @brief Returns the largest size that can be allocated at once.
+   */
+  size_t getLargestFreeBlock() const {
+    if (!mFlBitmap) {
+      return 0;
+    }
+    auto fl = _msb(mFlBitmap);
+    auto sl = _msb(mSlBitmaps[fl]);
+    size_t largest = 0;
+    // NOTE: the blocks of a class differ in size, but only the top class has to be looked through
+    for (auto block = mFreeLists[fl][sl]; block; block = block->nextFree) {
+      largest = block->size() > largest ? block->size() : largest;
+    }
+    return largest;
+  }
+
+  size_t getFreeBlocksCount() const {
+    return mFreeBlocksCount;
+  }
+
+  size_t getUsedMemory() const {
+    return mUsedBytes;
+  }
+
+  size_t getPeakUsedMemory() const {
+    return mPeakUsedBytes;
+  }
+
+  size_t getAllocationsCount() const {
+    return mAllocationsCount;
+  }
+
+  /**
+   * @brief Returns the share of the free memory that cannot be allocated in one piece, in percent.
+   * Zero means all the free memory is a single block.
+   */
+  uint8_t getFragmentation() const {
+    return mFreeBytes ? 100 - getLargestFreeBlock() * 100 / mFreeBytes : 0;
+  }
+
+ private:
+  static inline uint8_t _msb(uint32_t value) {
+    return 31 - __builtin_clz(value);
+  }
+
+  static inline uint8_t _lsb(uint32_t value) {
+    return __builtin_ctz(value);
+  }
+
+  static inline size_t _adjust(size_t size) {
+    size = (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+    return size < MIN_PAYLOAD ? MIN_PAYLOAD : size;
+  }
+
+  static inline void _mapping(size_t size, uint8_t &fl, uint8_t &sl) {
+    if (size < SMALL_SIZE) {
+      fl = 0;
+      sl = size / (SMALL_SIZE / SL_COUNT);
+    } else {
+      auto msb = _msb(size);
+      fl = msb - FL_SHIFT + 1;
+      sl = (size >> (msb - SL_LOG2)) ^ SL_COUNT;
+    }
+  }
+
+  static inline uint8_t *_payload(Block *block) {
+    return reinterpret_cast<uint8_t *>(block) + HEADER_SIZE;
+  }
+
+  static inline Block *_blockOf(void *ptr) {
+    return reinterpret_cast<Block *>(static_cast<uint8_t *>(ptr) - HEADER_SIZE);
+  }
+
+  static inline Block *_next(Block *block) {
+    return reinterpret_cast<Block *>(_payload(block) + block->size());
+  }
+
+  Block *_findSuitable(size_t size) {
+    // NOTE: the size is rounded up to the next class, so that any block of the class found is large enough
+    auto rounded = size >= SMALL_SIZE ? size + (1 << (_msb(size) - SL_LOG2)) - 1 : size;
+    uint8_t fl, sl;
+    _mapping(rounded, fl, sl);
+    if (fl < FL_COUNT) {
+      uint32_t slMap = mSlBitmaps[fl] & (~0U << sl);
+      if (!slMap) {
+        uint32_t flMap = mFlBitmap & (~0U << (fl + 1));
+        fl = flMap ? _lsb(flMap) : 0;
+        slMap = flMap ? mSlBitmaps[fl] : 0;
+      }
+      if (slMap) {
+        return mFreeLists[fl][_lsb(slMap)];
+      }
+    }
+
+    // the class of the size itself may still hold a large enough block, e.g. the largest free one
+    _mapping(size, fl, sl);
+    for (auto block = mFreeLists[fl][sl]; block; block = block->nextFree) {
+      if (block->size() >= size) {
+        return block;
+      }
+    }
+    return nullptr;
+  }
+
+  void _insert(Block *block) {
+    uint8_t fl, sl;
+    _mapping(block->size(), fl, sl);
+    auto &head = mFreeLists[fl][sl];
+    block->prevFree = nullptr;
+    block->nextFree = head;
+    if (head) {
+      head->prevFree = block;
+    }
+    head = block;
+    mSlBitmaps[fl] |= 1U << sl;
+    mFlBitmap |= 1U << fl;
+
+    block->sizeAndFlags |= FREE_FLAG;
+    mFreeBytes += block->size();
+    mFreeBlocksCount++;
+  }
+
+  void _remove(Block *block) {
+    uint8_t fl, sl;
+    _mapping(block->size(), fl, sl);
+    if (block->prevFree) {
+      block->prevFree->nextFree = block->nextFree;
+    } else {
+      mFreeLists[fl][sl] = block->nextFree;
+      if (!block->nextFree) {
+        mSlBitmaps[fl] &= ~(1U << sl);
+        if (!mSlBitmaps[fl]) {
+          mFlBitmap &= ~(1U << fl);
+        }
+      }
+    }
+    if (block->nextFree) {
+      block->nextFree->prevFree = block->prevFree;
+    }
+
+    block->sizeAndFlags &= ~FREE_FLAG;
+    mFreeBytes -= block->size();
+    mFreeBlocksCount--;
+  }
+
+  // the next block must already be out of the free lists
+  void _absorbNext(Block *block) {
+    auto next = _next(block);
+    block->sizeAndFlags += HEADER_SIZE + next->size();
+    _next(block)->prevPhys = block;
+  }
+
+  // gives the tail of a used block back if it is large enough to make a block of its own
+  void _split(Block *block, size_t size) {
+    if (block->size() < size + HEADER_SIZE + MIN_PAYLOAD) {
+      return;
+    }
+    auto rest = reinterpret_cast<Block *>(_payload(block) + size);
+    rest->sizeAndFlags = block->size() - size - HEADER_SIZE;
+    rest->prevPhys = block;
+    _next(rest)->prevPhys = rest;
+    block->sizeAndFlags = size;
+    _free(rest);
+  }
+
+  void _free(Block *block) {
+    auto prev = block->prevPhys;
+    if (prev && prev->isFree()) {
+      _remove(prev);
+      _absorbNext(prev);
+      block = prev;
+    }
+    if (_next(block)->isFree()) {
+      _remove(_next(block));
+      _absorbNext(block);
+    }
+    _insert(block);
+  }
+
+  inline void _addUsed(size_t size) {
+    mUsedBytes += size;
+    mPeakUsedBytes = mUsedBytes > mPeakUsedBytes ? mUsedBytes : mPeakUsedBytes;
+  }
+
+  alignas(ALIGNMENT) uint8_t mBuffer[Size];
+  Block *mFreeLists[FL_COUNT][SL_COUNT];
+  uint32_t mSlBitmaps[FL_COUNT];
+  uint32_t mFlBitmap;
+
+  size_t mFreeBytes;
+  size_t mFreeBlocksCount;
+  size_t mUsedBytes;
+  size_t mPeakUsedBytes;
+  size_t mAllocationsCount;
+};
+
+}  // namespace uniot
@@ -19,6 +19,8 @@
 #pragma once
 
 #include <Arduino.h>
+#include <BackgroundWorker.h>
+#include <CpuGovernor.h>
 #include <Credentials.h>
 #include <Date.h>
 #include <EventBus.h>
@@ -27,18 +29,34 @@
 
 class UniotCore {
  public:
-  UniotCore() : mScheduler(), mEventBus(FOURCC(main)) {}
+  UniotCore()
+      : mScheduler(),
+        mEventBus(FOURCC(main)),
+        mTaskEventBus(mEventBus),
+        mTaskStoreDate(uniot::Date::getInstance()),
+        mCpuGovernor(mScheduler) {}
 
   void begin(uint32_t eventBusTaskPeriod = 10, uint32_t storeDateTaskPeriod = 5 * 60 * 1000UL) {
     UNIOT_LOG_SET_READY();
 
-    auto taskHandleEventBus = uniot::TaskScheduler::make(mEventBus);
-    mScheduler.push("event_bus", taskHandleEventBus);
-    taskHandleEventBus->attach(eventBusTaskPeriod);
+    mScheduler.setRunawayCallback([this](const char *name, uniot::TaskScheduler::TaskHandle handle) {
+      mEventBus.emitEvent(uniot::TaskScheduler::TASK_RUNAWAY, static_cast<int>(handle));
+    });
 
-    auto taskStoreDate = uniot::TaskScheduler::make(uniot::Date::getInstance());
-    mScheduler.push("store_date", taskStoreDate);
-    taskStoreDate->attach(storeDateTaskPeriod);
+    mScheduler.push("event_bus", mTaskEventBus);
+    // NOTE: the bus slows down to a tenth of its rate while no events are emitted
+    mTaskEventBus.setAdaptivePeriod(eventBusTaskPeriod, 10 * eventBusTaskPeriod);
+    mTaskEventBus.attach(eventBusTaskPeriod);
+
+    mScheduler.push("store_date", mTaskStoreDate);
+    // NOTE: the date may be stored a whole period later, so the task can share wakeups with any other one
+    mTaskStoreDate.setSlack(storeDateTaskPeriod);
+    mTaskStoreDate.attach(storeDateTaskPeriod);
+
+    // NOTE: the task only runs while a network operation is in flight
+    mScheduler.push("net_worker", uniot::NetworkWorker::getInstance().task());
+    // NOTE: the governor only runs once it is started, see getCpuGovernor()
+    mScheduler.push("cpu_governor", mCpuGovernor.task());
   }
 
   void loop() {
@@ -53,9 +71,16 @@ class UniotCore {
     return mScheduler;
   }
 
+  uniot::CpuGovernor& getCpuGovernor() {
+    return mCpuGovernor;
+  }
+
  private:
   uniot::TaskScheduler mScheduler;
   uniot::CoreEventBus mEventBus;
+  uniot::SchedulerTask mTaskEventBus;
+  uniot::SchedulerTask mTaskStoreDate;
+  uniot::CpuGovernor mCpuGovernor;
 };
 
 extern UniotCore Uniot;
\ No newline at end of file
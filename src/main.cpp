@@ -52,6 +52,7 @@ void setup() {
       .push("print_time", taskPrintTime)
       .push("print_heap", taskPrintHeap);
 
+  taskPrintHeap->setSheddable(true);
   taskPrintHeap->attach(500);
   taskPrintTime->attach(500);
 
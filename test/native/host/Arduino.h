@@ -0,0 +1,47 @@
+/*
+ * This is a part of the Uniot project.
+ * Copyright (C) 2016-2024 Uniot <contact@uniot.io>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// NOTE: the minimal subset of the Arduino API used by the core, for the native test environment.
+// The time is virtual, see VirtualClock.
+
+#pragma once
+
+#include <VirtualTask.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+inline unsigned long millis() {
+  return static_cast<unsigned long>(uniot::VirtualClock::millis());
+}
+
+inline unsigned long micros() {
+  return static_cast<unsigned long>(uniot::VirtualClock::micros());
+}
+
+// NOTE: a busy task on the device takes real time, here it is simulated by advancing the clock
+inline void delay(unsigned long ms) {
+  uniot::VirtualClock::advance(ms);
+}
+
+inline void delayMicroseconds(unsigned int us) {
+  uniot::VirtualClock::advanceUs(us);
+}
+
+inline void yield() {}
@@ -0,0 +1,62 @@
+/*
+ * This is a part of the Uniot project.
+ * Copyright (C) 2016-2024 Uniot <contact@uniot.io>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// NOTE: the subset of the Arduino String used by the core utilities, for the native test environment.
+
+#pragma once
+
+#include <stddef.h>
+
+#include <string>
+
+class String {
+ public:
+  String(const char *str = "") : mValue(str ? str : "") {}
+
+  size_t length() const {
+    return mValue.length();
+  }
+
+  bool isEmpty() const {
+    return mValue.empty();
+  }
+
+  const char *c_str() const {
+    return mValue.c_str();
+  }
+
+  char charAt(size_t index) const {
+    return index < mValue.length() ? mValue[index] : '\0';
+  }
+
+  String &operator+=(const char *str) {
+    mValue += str;
+    return *this;
+  }
+
+  bool operator==(const String &rhs) const {
+    return mValue == rhs.mValue;
+  }
+
+  bool operator!=(const String &rhs) const {
+    return mValue != rhs.mValue;
+  }
+
+ private:
+  std::string mValue;
+};
@@ -0,0 +1,114 @@
+/*
+ * This is a part of the Uniot project.
+ * Copyright (C) 2016-2024 Uniot <contact@uniot.io>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <unity.h>
+
+#include "test_data_array.h"
+#include "test_data_background_worker.h"
+#include "test_data_bytes.h"
+#include "test_data_calendar.h"
+#include "test_data_clear_queue.h"
+#include "test_data_cpu_governor.h"
+#include "test_data_executor_pool.h"
+#include "test_data_map.h"
+#include "test_data_memory_profiler.h"
+#include "test_data_scheduler.h"
+#include "test_data_segregated_fit_heap.h"
+#include "test_data_state_machine.h"
+#include "test_data_tracer.h"
+#include "test_data_virtual_clock.h"
+
+int main(int argc, char **argv)
+{
+  UNITY_BEGIN();
+
+  // test_data_array.h
+  RUN_TEST(test_function_array_uninitialized_storage);
+  RUN_TEST(test_function_array_trivial_relocation);
+
+  // test_data_background_worker.h
+  RUN_TEST(test_function_background_worker_inline);
+  RUN_TEST(test_function_background_worker_thread);
+
+  // test_data_bytes.h
+  RUN_TEST(test_function_bytes_inline_storage);
+  RUN_TEST(test_function_bytes_heap_storage);
+  RUN_TEST(test_function_bytes_shared_slices);
+  RUN_TEST(test_function_bytes_move);
+
+  // test_data_calendar.h
+  RUN_TEST(test_function_calendar_rules);
+  RUN_TEST(test_function_calendar_wakeups);
+
+  // test_data_clear_queue.h
+  RUN_TEST(test_function_clear_queue_node_pool_reuse);
+  RUN_TEST(test_function_clear_queue_push_failure);
+  RUN_TEST(test_function_clear_queue_allocator_benchmark);
+
+  // test_data_cpu_governor.h
+  RUN_TEST(test_function_cpu_governor_policy);
+
+  // test_data_executor_pool.h
+  RUN_TEST(test_function_executor_pool_scaling);
+  RUN_TEST(test_function_executor_pool_exclusive_group);
+  RUN_TEST(test_function_executor_pool_affinity);
+  RUN_TEST(test_function_executor_pool_pooled_executor);
+
+  // test_data_virtual_clock.h
+  RUN_TEST(test_function_virtual_clock_timers_order);
+  RUN_TEST(test_function_virtual_clock_detach_from_callback);
+  RUN_TEST(test_function_virtual_clock_scheduler_day);
+  RUN_TEST(test_function_virtual_clock_runaway_task);
+
+  // test_data_scheduler.h
+  RUN_TEST(test_function_scheduler_static_tasks_without_heap);
+  RUN_TEST(test_function_scheduler_make_single_allocation);
+  RUN_TEST(test_function_scheduler_missed_ticks_policies);
+  RUN_TEST(test_function_scheduler_slack_coalesces_wakeups);
+  RUN_TEST(test_function_scheduler_slack_late_loop_and_timeouts);
+  RUN_TEST(test_function_scheduler_load_shedding);
+  RUN_TEST(test_function_scheduler_adaptive_period);
+  RUN_TEST(test_function_scheduler_phase_staggering);
+  RUN_TEST(test_function_scheduler_period_override);
+
+  // test_data_segregated_fit_heap.h
+  RUN_TEST(test_function_segregated_fit_heap_random_workload);
+  RUN_TEST(test_function_segregated_fit_heap_in_place_growth);
+
+  // test_data_map.h
+  RUN_TEST(test_function_map_matches_std_map);
+  RUN_TEST(test_function_map_nested_iteration);
+
+  // test_data_memory_profiler.h
+  RUN_TEST(test_function_memory_profiler_tagged_scopes);
+  RUN_TEST(test_function_memory_profiler_threads_and_accounting);
+#if UNIOT_MEM_PROFILER_ENABLED
+  RUN_TEST(test_function_memory_profiler_node_pool_tag);
+#endif
+
+  // test_data_state_machine.h
+  RUN_TEST(test_function_state_machine_chain_in_one_run);
+  RUN_TEST(test_function_state_machine_connection_flow);
+  RUN_TEST(test_function_state_machine_expired_guarded_timeout);
+
+  // test_data_tracer.h
+  RUN_TEST(test_function_tracer_scheduler_timeline);
+  RUN_TEST(test_function_tracer_ring_overwrite);
+
+  return UNITY_END();
+}
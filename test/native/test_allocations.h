@@ -0,0 +1,80 @@
+/*
+ * This is a part of the Uniot project.
+ * Copyright (C) 2016-2024 Uniot <contact@uniot.io>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+// NOTE: the global allocation functions are replaced to count the heap allocations made by the code under test
+
+static std::atomic<size_t> gAllocationsCount(0);
+
+// NOTE: the replaced operators keep their blocks on malloc(), the block is released by the same helper for all of them,
+// so the compiler does not see free() called on the result of an operator new
+__attribute__((noinline)) static void releaseCountedBlock(void *ptr) noexcept
+{
+  free(ptr);
+}
+
+void *operator new(size_t size)
+{
+  gAllocationsCount++;
+  if (auto ptr = malloc(size ? size : 1))
+  {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+void *operator new[](size_t size)
+{
+  return operator new(size);
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept
+{
+  gAllocationsCount++;
+  return malloc(size ? size : 1);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &tag) noexcept
+{
+  return operator new(size, tag);
+}
+
+void operator delete(void *ptr) noexcept
+{
+  releaseCountedBlock(ptr);
+}
+
+void operator delete[](void *ptr) noexcept
+{
+  releaseCountedBlock(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept
+{
+  releaseCountedBlock(ptr);
+}
+
+void operator delete[](void *ptr, size_t) noexcept
+{
+  releaseCountedBlock(ptr);
+}
@@ -0,0 +1,138 @@
+/*
+ * This is a part of the Uniot project.
+ * Copyright (C) 2016-2024 Uniot <contact@uniot.io>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <Array.h>
+#include <Common.h>
+#include <unity.h>
+
+#include "test_allocations.h"
+
+using namespace uniot;
+
+struct TrackedItem {
+  static int constructed;
+  static int copied;
+  static int moved;
+  static int destroyed;
+
+  int value;
+
+  static void reset()
+  {
+    constructed = copied = moved = destroyed = 0;
+  }
+
+  static int alive()
+  {
+    return constructed + copied + moved - destroyed;
+  }
+
+  TrackedItem(int value) : value(value) { constructed++; }
+  TrackedItem(const TrackedItem &other) : value(other.value) { copied++; }
+  TrackedItem(TrackedItem &&other) noexcept : value(other.value) { moved++; }
+  TrackedItem &operator=(const TrackedItem &other) = delete;
+  ~TrackedItem() { destroyed++; }
+};
+
+int TrackedItem::constructed = 0;
+int TrackedItem::copied = 0;
+int TrackedItem::moved = 0;
+int TrackedItem::destroyed = 0;
+
+void test_function_array_uninitialized_storage(void)
+{
+  TrackedItem::reset();
+  {
+    // the reserved capacity constructs nothing
+    Array<TrackedItem> array;
+    auto allocations = gAllocationsCount.load();
+    TEST_ASSERT_TRUE(array.reserve(8));
+    TEST_ASSERT_EQUAL(1, gAllocationsCount - allocations);
+    TEST_ASSERT_EQUAL(0, TrackedItem::alive());
+
+    // an emplaced element is constructed in place, a pushed one is copied or moved once
+    TEST_ASSERT_TRUE(array.emplace(1));
+    TrackedItem item(2);
+    TEST_ASSERT_TRUE(array.push(item));
+    TEST_ASSERT_TRUE(array.push(TrackedItem(3)));
+    TEST_ASSERT_EQUAL(3, TrackedItem::constructed);
+    TEST_ASSERT_EQUAL(1, TrackedItem::copied);
+    TEST_ASSERT_EQUAL(1, TrackedItem::moved);
+    for (int i = 4; i <= 8; i++) {
+      array.emplace(i);
+    }
+    TEST_ASSERT_EQUAL(1, gAllocationsCount - allocations);
+
+    // growing moves the elements once and destroys the old ones
+    TrackedItem::reset();
+    TEST_ASSERT_TRUE(array.emplace(9));
+    TEST_ASSERT_EQUAL(2, gAllocationsCount - allocations);
+    TEST_ASSERT_EQUAL(16, array.capacity());
+    TEST_ASSERT_EQUAL(1, TrackedItem::constructed);
+    TEST_ASSERT_EQUAL(0, TrackedItem::copied);
+    TEST_ASSERT_EQUAL(8, TrackedItem::moved);
+    TEST_ASSERT_EQUAL(8, TrackedItem::destroyed);
+    for (size_t i = 0; i < array.size(); i++) {
+      TEST_ASSERT_EQUAL((int)i + 1, array[i].value);
+    }
+
+    // an element of the array itself can be pushed while the array grows
+    while (array.size() < array.capacity()) {
+      array.emplace(0);
+    }
+    TEST_ASSERT_TRUE(array.push(array[0]));
+    TEST_ASSERT_EQUAL(1, array[array.size() - 1].value);
+
+    TEST_ASSERT_TRUE(array.shrink());
+    TEST_ASSERT_EQUAL(array.size(), array.capacity());
+    TrackedItem::reset();
+    array.clear();
+    TEST_ASSERT_EQUAL(17, TrackedItem::destroyed);
+    array.emplace(10);
+    TrackedItem::reset();
+  }
+  // the destructor destroys the elements, not the capacity
+  TEST_ASSERT_EQUAL(2, TrackedItem::destroyed);
+}
+
+void test_function_array_trivial_relocation(void)
+{
+  auto allocations = gAllocationsCount.load();
+  Array<uint32_t> array;
+  for (uint32_t i = 0; i < 1000; i++) {
+    TEST_ASSERT_TRUE(array.push(i * 3));
+  }
+  // doubling from one element: 1, 2, 4, ..., 1024
+  TEST_ASSERT_EQUAL(11, gAllocationsCount - allocations);
+  TEST_ASSERT_EQUAL(1024, array.capacity());
+  for (uint32_t i = 0; i < 1000; i++) {
+    TEST_ASSERT_EQUAL(i * 3, array[i]);
+  }
+
+  uint16_t values[] = {1, 2, 3};
+  Array<uint16_t> copy(COUNT_OF(values), values);
+  TEST_ASSERT_EQUAL(3, copy.size());
+  TEST_ASSERT_EQUAL(3, copy[2]);
+
+  Array<uint16_t> moved = std::move(copy);
+  TEST_ASSERT_EQUAL(0, copy.size());
+  TEST_ASSERT_NULL(copy.raw());
+  TEST_ASSERT_EQUAL(2, moved[1]);
+}
@@ -0,0 +1,111 @@
+/*
+ * This is a part of the Uniot project.
+ * Copyright (C) 2016-2024 Uniot <contact@uniot.io>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <BackgroundWorker.h>
+#include <TaskScheduler.h>
+#include <unity.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+using namespace uniot;
+
+void test_function_background_worker_inline(void)
+{
+  TaskScheduler scheduler;
+  BackgroundWorker worker(false);
+  scheduler.push("worker", worker.task());
+
+  // without a thread the jobs take turns on the main loop and the completions follow them
+  auto result = 0;
+  auto doneRuns = 0;
+  TEST_ASSERT_TRUE(worker.post([&] { result = 42; }, [&] { doneRuns++; }));
+  TEST_ASSERT_TRUE(worker.post([&] { result++; }, [&] { doneRuns++; }));
+  TEST_ASSERT_EQUAL(0, result);
+  TEST_ASSERT_EQUAL(2, worker.getInFlightCount());
+
+  VirtualClock::fastForward(100, [&] { scheduler.loop(); });
+  TEST_ASSERT_EQUAL(43, result);
+  TEST_ASSERT_EQUAL(2, doneRuns);
+  TEST_ASSERT_EQUAL(0, worker.getInFlightCount());
+  TEST_ASSERT_FALSE(worker.task().isAttached());
+
+  // the slots are limited, a completion may post the next job
+  for (auto i = 0; i < UNIOT_BACKGROUND_WORKER_QUEUE_SIZE; i++)
+  {
+    TEST_ASSERT_TRUE(worker.post([] {}));
+  }
+  TEST_ASSERT_FALSE(worker.post([] {}));
+  VirtualClock::fastForward(100, [&] { scheduler.loop(); });
+  TEST_ASSERT_TRUE(worker.post([] {}, [&] { worker.post([&] { result = 0; }); }));
+  VirtualClock::fastForward(100, [&] { scheduler.loop(); });
+  TEST_ASSERT_EQUAL(0, result);
+  TEST_ASSERT_EQUAL(2 + UNIOT_BACKGROUND_WORKER_QUEUE_SIZE + 2, worker.getDoneCount());
+}
+
+void test_function_background_worker_thread(void)
+{
+  TaskScheduler scheduler;
+  BackgroundWorker worker(true);
+  scheduler.push("worker", worker.task());
+
+  auto controlRuns = 0;
+  SchedulerTask control([&](SchedulerTask &self, short t) { controlRuns++; });
+  scheduler.push("control", control);
+  control.attach(10);
+
+  // the job blocks as a connection to a server would, the main loop keeps going meanwhile
+  std::atomic<bool> release(false);
+  std::atomic<bool> jobFinished(false);
+  auto threadId = std::this_thread::get_id();
+  auto jobThreadId = threadId;
+  auto doneThreadId = std::thread::id();
+  TEST_ASSERT_TRUE(worker.post(
+      [&] {
+        jobThreadId = std::this_thread::get_id();
+        while (!release)
+        {
+          std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        jobFinished = true;
+      },
+      [&] { doneThreadId = std::this_thread::get_id(); }));
+  TEST_ASSERT_TRUE(worker.isThreaded());
+
+  VirtualClock::fastForward(1000, [&] { scheduler.loop(); });
+  TEST_ASSERT_EQUAL(100, controlRuns);
+  TEST_ASSERT_EQUAL(1, worker.getInFlightCount());
+
+  // NOTE: the virtual time does not follow the thread, so the task of the worker is run directly until the completion arrives
+  release = true;
+  for (auto i = 0; i < 1000 && worker.getInFlightCount(); i++)
+  {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    worker.execute(0);
+  }
+  TEST_ASSERT_TRUE(jobFinished);
+  TEST_ASSERT_EQUAL(0, worker.getInFlightCount());
+  TEST_ASSERT_TRUE(jobThreadId != threadId);
+  TEST_ASSERT_TRUE(doneThreadId == threadId);
+  TEST_ASSERT_FALSE(worker.task().isAttached());
+
+  control.detach();
+}
@@ -0,0 +1,253 @@
+/*
+ * This is a part of the Uniot project.
+ * Copyright (C) 2016-2024 Uniot <contact@uniot.io>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <Bytes.h>
+#include <unity.h>
+
+static bool isStoredInline(const Bytes &bytes)
+{
+  auto begin = reinterpret_cast<const uint8_t *>(&bytes);
+  return bytes.raw() >= begin && bytes.raw() < begin + sizeof(Bytes);
+}
+
+void test_function_bytes_inline_storage(void)
+{
+  Bytes empty;
+  TEST_ASSERT_NULL(empty.raw());
+  TEST_ASSERT_EQUAL(0, empty.size());
+
+  // the small values never touch the heap
+  Bytes number(uint32_t(0x11223344));
+  TEST_ASSERT_TRUE(isStoredInline(number));
+  TEST_ASSERT_EQUAL(4, number.size());
+  TEST_ASSERT_EQUAL_HEX8(0x44, number.raw()[0]);
+
+  Bytes id("event_42");
+  TEST_ASSERT_TRUE(isStoredInline(id));
+  TEST_ASSERT_EQUAL(9, id.size());
+  TEST_ASSERT_EQUAL_STRING("event_42", id.c_str());
+
+  Bytes copy(id);
+  TEST_ASSERT_TRUE(isStoredInline(copy));
+  TEST_ASSERT_TRUE(copy.raw() != id.raw());
+  TEST_ASSERT_EQUAL_STRING("event_42", copy.c_str());
+  TEST_ASSERT_EQUAL(id.checksum(), copy.checksum());
+
+  // terminate() within the capacity keeps the buffer
+  Bytes ssid(String("home"));
+  TEST_ASSERT_TRUE(isStoredInline(ssid));
+  TEST_ASSERT_EQUAL(5, ssid.size());
+  TEST_ASSERT_EQUAL_STRING("home", ssid.c_str());
+  Bytes unterminated((const uint8_t *)"abcdef", 6);
+  auto raw = unterminated.raw();
+  unterminated.terminate();
+  TEST_ASSERT_EQUAL_PTR(raw, unterminated.raw());
+  TEST_ASSERT_EQUAL(7, unterminated.size());
+  TEST_ASSERT_EQUAL_STRING("abcdef", unterminated.c_str());
+
+  Bytes zero;
+  zero.terminate();
+  TEST_ASSERT_TRUE(isStoredInline(zero));
+  TEST_ASSERT_EQUAL(1, zero.size());
+  TEST_ASSERT_EQUAL_STRING("", zero.c_str());
+
+  // fill() sees the whole zeroed buffer
+  Bytes filled(nullptr, 8);
+  size_t zeros = 0;
+  TEST_ASSERT_EQUAL(8, filled.fill([&](uint8_t *buf, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+      zeros += !buf[i];
+      buf[i] = i;
+    }
+    return size;
+  }));
+  TEST_ASSERT_EQUAL(8, zeros);
+  TEST_ASSERT_EQUAL(7, filled.raw()[7]);
+
+  filled.prune(0);
+  TEST_ASSERT_NULL(filled.raw());
+  TEST_ASSERT_EQUAL(0, filled.size());
+}
+
+void test_function_bytes_heap_storage(void)
+{
+  uint8_t data[64];
+  for (size_t i = 0; i < sizeof(data); i++) {
+    data[i] = i + 1;
+  }
+
+  // a large payload moves to the heap and back inline when it is pruned
+  Bytes bytes(data, UNIOT_BYTES_INLINE_SIZE);
+  TEST_ASSERT_TRUE(isStoredInline(bytes));
+  bytes.terminate();
+  TEST_ASSERT_FALSE(isStoredInline(bytes));
+  TEST_ASSERT_EQUAL(UNIOT_BYTES_INLINE_SIZE + 1, bytes.size());
+  TEST_ASSERT_EQUAL_MEMORY(data, bytes.raw(), UNIOT_BYTES_INLINE_SIZE);
+  TEST_ASSERT_EQUAL(0, bytes.raw()[UNIOT_BYTES_INLINE_SIZE]);
+
+  bytes = Bytes(data, sizeof(data));
+  TEST_ASSERT_EQUAL_MEMORY(data, bytes.raw(), sizeof(data));
+
+  // a small shrink keeps the block, so terminating it again does not reallocate
+  auto raw = bytes.raw();
+  bytes.prune(sizeof(data) - 4);
+  TEST_ASSERT_EQUAL_PTR(raw, bytes.raw());
+  bytes.terminate();
+  TEST_ASSERT_EQUAL_PTR(raw, bytes.raw());
+  TEST_ASSERT_EQUAL(sizeof(data) - 3, bytes.size());
+  TEST_ASSERT_EQUAL(0, bytes.raw()[sizeof(data) - 4]);
+
+  bytes.prune(4);
+  TEST_ASSERT_TRUE(isStoredInline(bytes));
+  TEST_ASSERT_EQUAL(4, bytes.size());
+  TEST_ASSERT_EQUAL_MEMORY(data, bytes.raw(), 4);
+
+  // the bytes that appear by growing again are zeroed
+  bytes.terminate();
+  TEST_ASSERT_EQUAL_STRING("\x01\x02\x03\x04", bytes.c_str());
+
+  auto hex = Bytes::fromHexString("00FF10");
+  TEST_ASSERT_EQUAL(3, hex.size());
+  TEST_ASSERT_EQUAL_HEX8(0xFF, hex.raw()[1]);
+  TEST_ASSERT_EQUAL_STRING("00FF10", hex.toHexString().c_str());
+}
+
+void test_function_bytes_shared_slices(void)
+{
+  uint8_t data[100];
+  for (size_t i = 0; i < sizeof(data); i++) {
+    data[i] = i + 1;
+  }
+
+  // a copy of a large payload shares it
+  Bytes message(data, sizeof(data));
+  TEST_ASSERT_FALSE(message.isShared());
+  Bytes copy = message;
+  TEST_ASSERT_EQUAL_PTR(message.raw(), copy.raw());
+  TEST_ASSERT_TRUE(message.isShared());
+  TEST_ASSERT_TRUE(copy.isShared());
+
+  // a slice points into the same block and outlives the original
+  auto payload = message.slice(10, 50);
+  TEST_ASSERT_EQUAL_PTR(message.raw() + 10, payload.raw());
+  TEST_ASSERT_EQUAL(50, payload.size());
+  message.clean();
+  copy.clean();
+  TEST_ASSERT_FALSE(payload.isShared());
+  TEST_ASSERT_EQUAL_MEMORY(data + 10, payload.raw(), 50);
+
+  // a small slice is copied inline, out-of-range slices are clamped
+  auto header = payload.slice(0, 4);
+  TEST_ASSERT_TRUE(isStoredInline(header));
+  TEST_ASSERT_EQUAL_MEMORY(data + 10, header.raw(), 4);
+  TEST_ASSERT_EQUAL(20, payload.slice(30, 1000).size());
+  TEST_ASSERT_EQUAL(0, payload.slice(1000, 10).size());
+  TEST_ASSERT_NULL(payload.slice(1000, 10).raw());
+
+  // the sharers are copied before they are modified
+  Bytes original(data, sizeof(data));
+  Bytes modified = original;
+  modified.fill([](uint8_t *buf, size_t size) {
+    buf[0] = 0xAA;
+    return size;
+  });
+  TEST_ASSERT_TRUE(original.raw() != modified.raw());
+  TEST_ASSERT_EQUAL_HEX8(1, original.raw()[0]);
+  TEST_ASSERT_EQUAL_HEX8(0xAA, modified.raw()[0]);
+  TEST_ASSERT_FALSE(original.isShared());
+
+  auto text = original.slice(20, 30);
+  auto raw = text.raw();
+  text.terminate();
+  TEST_ASSERT_TRUE(raw != text.raw());
+  TEST_ASSERT_EQUAL(31, text.size());
+  TEST_ASSERT_EQUAL(0, text.raw()[30]);
+  TEST_ASSERT_EQUAL(data[50], original.raw()[50]);
+
+  // pruning a shared payload copies the part that is kept
+  Bytes narrowed = original;
+  narrowed.prune(40);
+  TEST_ASSERT_TRUE(original.raw() != narrowed.raw());
+  TEST_ASSERT_EQUAL(40, narrowed.size());
+  TEST_ASSERT_EQUAL(100, original.size());
+  TEST_ASSERT_EQUAL_MEMORY(data, narrowed.raw(), 40);
+
+  // new contents written into a copy, of any size, leave the original as it was
+  Bytes shorter = original;
+  shorter = String("a string of thirty-one chars...");
+  TEST_ASSERT_EQUAL(32, shorter.size());
+  TEST_ASSERT_EQUAL_STRING("a string of thirty-one chars...", shorter.c_str());
+  Bytes longer = original;
+  uint8_t other[150];
+  memset(other, 0x55, sizeof(other));
+  longer = Bytes(other, sizeof(other));
+  TEST_ASSERT_EQUAL_HEX8(0x55, longer.raw()[149]);
+  TEST_ASSERT_EQUAL_MEMORY(data, original.raw(), sizeof(data));
+  TEST_ASSERT_FALSE(original.isShared());
+
+  // a view reads without owning
+  BytesView view(original);
+  TEST_ASSERT_EQUAL_PTR(original.raw(), view.raw());
+  auto part = view.slice(90, 20);
+  TEST_ASSERT_EQUAL(10, part.size());
+  TEST_ASSERT_EQUAL(CRC32(data + 90, 10), part.checksum());
+  auto owned = part.toBytes();
+  TEST_ASSERT_TRUE(isStoredInline(owned));
+  TEST_ASSERT_EQUAL_MEMORY(data + 90, owned.raw(), 10);
+  TEST_ASSERT_TRUE(BytesView().isEmpty());
+}
+
+void test_function_bytes_move(void)
+{
+  static_assert(std::is_nothrow_move_constructible<Bytes>::value, "Bytes must be nothrow movable");
+  static_assert(std::is_nothrow_move_assignable<Bytes>::value, "Bytes must be nothrow movable");
+
+  uint8_t data[64] = {1, 2, 3};
+
+  // a moved payload keeps its block and leaves the source empty
+  Bytes source(data, sizeof(data));
+  auto raw = source.raw();
+  Bytes target(std::move(source));
+  TEST_ASSERT_EQUAL_PTR(raw, target.raw());
+  TEST_ASSERT_FALSE(target.isShared());
+  TEST_ASSERT_NULL(source.raw());
+  TEST_ASSERT_EQUAL(0, source.size());
+
+  Bytes small((uint8_t)7);
+  target = std::move(small);
+  TEST_ASSERT_TRUE(isStoredInline(target));
+  TEST_ASSERT_EQUAL(1, target.size());
+  TEST_ASSERT_EQUAL(7, target.raw()[0]);
+  TEST_ASSERT_NULL(small.raw());
+
+  // the storage of an array grows by moving the payloads, the blocks are neither copied nor shared
+  uniot::Array<Bytes> payloads;
+  const uint8_t *raws[9];
+  for (size_t i = 0; i < COUNT_OF(raws); i++) {
+    data[0] = i;
+    payloads.push(Bytes(data, sizeof(data)));
+    raws[i] = payloads[i].raw();
+  }
+  for (size_t i = 0; i < COUNT_OF(raws); i++) {
+    TEST_ASSERT_EQUAL_PTR(raws[i], payloads[i].raw());
+    TEST_ASSERT_FALSE(payloads[i].isShared());
+    TEST_ASSERT_EQUAL(i, payloads[i].raw()[0]);
+  }
+}
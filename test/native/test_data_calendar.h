@@ -0,0 +1,99 @@
+/*
+ * This is a part of the Uniot project.
+ * Copyright (C) 2016-2024 Uniot <contact@uniot.io>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <Arduino.h>
+#include <Calendar.h>
+#include <TaskScheduler.h>
+#include <unity.h>
+
+using namespace uniot;
+
+static time_t sCalendarClockOffset = 0;
+
+static time_t calendarClock()
+{
+  return sCalendarClockOffset + VirtualClock::millis() / 1000;
+}
+
+void test_function_calendar_rules(void)
+{
+  // 2024-03-15 06:59:30 UTC, a Friday
+  const time_t friday = 1710485970;
+
+  TEST_ASSERT_EQUAL(friday + 30, Calendar::Rule::daily(7, 0).next(friday));
+  TEST_ASSERT_EQUAL(friday + 30 + 24 * 3600, Calendar::Rule::daily(7, 0).next(friday + 30));
+  TEST_ASSERT_EQUAL(friday + 30, Calendar::Rule::hourly().next(friday));
+  TEST_ASSERT_EQUAL(friday + 30 + 3600, Calendar::Rule::hourly().next(friday + 30));
+  TEST_ASSERT_EQUAL(friday + 30 + 15 * 60, Calendar::Rule::hourly(15).next(friday + 30));
+  TEST_ASSERT_EQUAL(friday + 30, (Calendar::Rule{-1, -1, Calendar::EVERY_WEEKDAY}).next(friday));
+  TEST_ASSERT_EQUAL(friday + 90, (Calendar::Rule{-1, -1, Calendar::EVERY_WEEKDAY}).next(friday + 30));
+  // 23:59 the same day, then the next day
+  TEST_ASSERT_EQUAL(friday + 30 + 17 * 3600 - 60, Calendar::Rule::daily(23, 59).next(friday));
+  // Monday only, three days later
+  TEST_ASSERT_EQUAL(friday + 30 + 3 * 24 * 3600 + 3600, (Calendar::Rule{0, 8, 1 << 1}).next(friday));
+  // Friday only, a week later
+  TEST_ASSERT_EQUAL(friday + 30 + 7 * 24 * 3600 - 3600, (Calendar::Rule{0, 6, 1 << 5}).next(friday));
+
+  TEST_ASSERT_EQUAL(0, (Calendar::Rule{60, 0, Calendar::EVERY_WEEKDAY}).next(friday));
+  TEST_ASSERT_EQUAL(0, (Calendar::Rule{0, 0, 0}).next(friday));
+}
+
+void test_function_calendar_wakeups(void)
+{
+  const time_t dayStart = 1710460800;  // 2024-03-15 00:00:00 UTC
+  TaskScheduler scheduler;
+  Calendar calendar(calendarClock);
+  scheduler.push("calendar", calendar.task());
+
+  // the clock is not set yet, so nothing is planned
+  sCalendarClockOffset = 1000 - VirtualClock::millis() / 1000;
+  auto morningRuns = 0;
+  auto hourlyRuns = 0;
+  time_t lastMorning = 0;
+  calendar.add(Calendar::Rule::daily(7, 0), [&](time_t planned) {
+    morningRuns++;
+    lastMorning = planned;
+  });
+  calendar.add(Calendar::Rule::hourly(), [&](time_t planned) { hourlyRuns++; });
+  TEST_ASSERT_FALSE(calendar.task().isAttached());
+
+  // the sync sets the clock to 00:30
+  sCalendarClockOffset = dayStart + 30 * 60 - VirtualClock::millis() / 1000;
+  calendar.replan();
+  TEST_ASSERT_EQUAL(dayStart + 3600, calendar.getNextEpoch());
+
+  auto before = scheduler.getWakeupsCount();
+  VirtualClock::fastForward(24 * 3600 * 1000ULL, [&] { scheduler.loop(); });
+  TEST_ASSERT_EQUAL(1, morningRuns);
+  TEST_ASSERT_EQUAL(dayStart + 7 * 3600, lastMorning);
+  TEST_ASSERT_EQUAL(24, hourlyRuns);
+  // 07:00 and 08:00 share the wakeup of the hourly entry
+  TEST_ASSERT_EQUAL(24, scheduler.getWakeupsCount() - before);
+
+  // an unannounced jump of the clock back by two hours is noticed on the next wakeup and the hours run again
+  hourlyRuns = 0;
+  sCalendarClockOffset -= 2 * 3600;
+  VirtualClock::fastForward(3 * 3600 * 1000ULL, [&] { scheduler.loop(); });
+  TEST_ASSERT_EQUAL(2, hourlyRuns);
+
+  calendar.clear();
+  TEST_ASSERT_TRUE(calendar.isEmpty());
+  TEST_ASSERT_FALSE(calendar.task().isAttached());
+}
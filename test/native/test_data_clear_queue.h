@@ -0,0 +1,210 @@
+/*
+ * This is a part of the Uniot project.
+ * Copyright (C) 2016-2024 Uniot <contact@uniot.io>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <ClearQueue.h>
+#include <LimitedQueue.h>
+#include <unity.h>
+
+#include <chrono>
+
+using namespace uniot;
+
+// NOTE: the odd chunk sizes give the tests pools of their own, the default ones are shared with the rest of the suite
+using TestPoolAllocator = PoolNodeAllocator<7>;
+using BenchPoolAllocator = PoolNodeAllocator<UNIOT_NODE_POOL_CHUNK_SIZE + 1>;
+
+struct CountingHeapAllocator {
+  static size_t allocations;
+
+  template <typename Node>
+  static void *allocate() {
+    allocations++;
+    return HeapNodeAllocator::allocate<Node>();
+  }
+
+  template <typename Node>
+  static void deallocate(void *ptr) {
+    HeapNodeAllocator::deallocate<Node>(ptr);
+  }
+};
+
+size_t CountingHeapAllocator::allocations = 0;
+
+struct ExhaustibleHeapAllocator {
+  static bool exhausted;
+
+  template <typename Node>
+  static void *allocate() {
+    return exhausted ? nullptr : HeapNodeAllocator::allocate<Node>();
+  }
+
+  template <typename Node>
+  static void deallocate(void *ptr) {
+    HeapNodeAllocator::deallocate<Node>(ptr);
+  }
+};
+
+bool ExhaustibleHeapAllocator::exhausted = false;
+
+template <typename T, typename Allocator>
+class InspectableQueue : public ClearQueue<T, Allocator> {
+ public:
+  using Pool = typename Allocator::template Pool<typename ClearQueue<T, Allocator>::node>;
+};
+
+template <typename Allocator>
+static uint64_t runQueueWorkload(ClearQueue<uint32_t, Allocator> &queue, size_t depth, size_t rounds)
+{
+  auto start = std::chrono::steady_clock::now();
+  uint32_t sum = 0;
+  for (size_t round = 0; round < rounds; round++) {
+    for (size_t i = 0; i < depth; i++) {
+      queue.push(round + i);
+    }
+    queue.removeOne(round + depth / 2);
+    while (!queue.isEmpty()) {
+      sum += queue.hardPop();
+    }
+  }
+  TEST_ASSERT_NOT_EQUAL(0, sum);
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+void test_function_clear_queue_node_pool_reuse(void)
+{
+  using Pool = InspectableQueue<int, TestPoolAllocator>::Pool;
+  auto &pool = Pool::shared();
+  TEST_ASSERT_EQUAL(0, pool.getChunksCount());
+
+  {
+    ClearQueue<int, TestPoolAllocator> queue;
+    for (int i = 0; i < 20; i++) {
+      queue.push(i);
+    }
+    TEST_ASSERT_EQUAL(20, pool.getUsedCount());
+    TEST_ASSERT_EQUAL(3, pool.getChunksCount());
+
+    // the popped and removed nodes are reused, the pool does not grow
+    TEST_ASSERT_EQUAL(0, queue.hardPop());
+    TEST_ASSERT_TRUE(queue.removeOne(10));
+    TEST_ASSERT_TRUE(queue.removeOne(19));
+    TEST_ASSERT_EQUAL(17, pool.getUsedCount());
+    queue.push(100);
+    queue.push(101);
+    queue.push(102);
+    queue.push(103);
+    TEST_ASSERT_EQUAL(21, pool.getUsedCount());
+    TEST_ASSERT_EQUAL(21, pool.getCapacity());
+    TEST_ASSERT_EQUAL(103, *queue.find(103));
+    TEST_ASSERT_EQUAL(1, queue.hardPeek());
+
+    int expected[] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 11, 12, 13, 14, 15, 16, 17, 18, 100, 101, 102, 103};
+    size_t index = 0;
+    queue.forEach([&](const int &value) {
+      TEST_ASSERT_EQUAL(expected[index++], value);
+    });
+    TEST_ASSERT_EQUAL(21, index);
+
+    queue.clean();
+    TEST_ASSERT_EQUAL(0, pool.getUsedCount());
+    TEST_ASSERT_TRUE(queue.isEmpty());
+    // the spare chunks are kept for the next allocations
+    TEST_ASSERT_EQUAL(2, pool.trim(1));
+    TEST_ASSERT_EQUAL(1, pool.getChunksCount());
+    TEST_ASSERT_EQUAL(0, pool.trim(1));
+    TEST_ASSERT_EQUAL(1, pool.trim());
+    TEST_ASSERT_EQUAL(0, pool.getChunksCount());
+
+    // a limited queue shares the pool, it needs one node more than its limit
+    LimitedQueue<int, TestPoolAllocator> limited;
+    limited.limit(5);
+    for (int i = 0; i < 50; i++) {
+      limited.pushLimited(i);
+    }
+    TEST_ASSERT_EQUAL(5, limited.size());
+    TEST_ASSERT_EQUAL(5, pool.getUsedCount());
+    TEST_ASSERT_EQUAL(1, pool.getChunksCount());
+    TEST_ASSERT_EQUAL(45, limited.popLimited(-1));
+
+    // a chunk with used nodes is kept
+    TEST_ASSERT_EQUAL(0, pool.trim());
+    TEST_ASSERT_EQUAL(4, pool.getUsedCount());
+    limited.pushLimited(200);
+    limited.pushLimited(201);
+    TEST_ASSERT_EQUAL(47, limited.popLimited(-1));
+  }
+
+  TEST_ASSERT_EQUAL(0, pool.getUsedCount());
+  TEST_ASSERT_EQUAL(1, pool.trim());
+  TEST_ASSERT_EQUAL(0, pool.getChunksCount());
+}
+
+void test_function_clear_queue_allocator_benchmark(void)
+{
+  const size_t depth = 16;
+  const size_t rounds = 5000;
+  using Pool = InspectableQueue<uint32_t, BenchPoolAllocator>::Pool;
+
+  ClearQueue<uint32_t, CountingHeapAllocator> heapQueue;
+  CountingHeapAllocator::allocations = 0;
+  auto heapUs = runQueueWorkload(heapQueue, depth, rounds);
+
+  ClearQueue<uint32_t, BenchPoolAllocator> poolQueue;
+  auto poolUs = runQueueWorkload(poolQueue, depth, rounds);
+
+  // every push is a heap allocation with the global allocator, the pool only grows up to the deepest queue
+  TEST_ASSERT_EQUAL(depth * rounds, CountingHeapAllocator::allocations);
+  auto chunks = Pool::shared().getChunksCount();
+  TEST_ASSERT_EQUAL((depth + UNIOT_NODE_POOL_CHUNK_SIZE) / (UNIOT_NODE_POOL_CHUNK_SIZE + 1), chunks);
+  TEST_ASSERT_EQUAL(0, Pool::shared().getUsedCount());
+
+  char message[160];
+  snprintf(message, sizeof(message), "%u push/pop: heap %u allocations, %lu us; pool %u allocations, %lu us",
+           (unsigned)(depth * rounds), (unsigned)CountingHeapAllocator::allocations, (unsigned long)heapUs,
+           (unsigned)chunks, (unsigned long)poolUs);
+  TEST_MESSAGE(message);
+  Pool::shared().trim();
+}
+
+void test_function_clear_queue_push_failure(void)
+{
+  ClearQueue<int, ExhaustibleHeapAllocator> queue;
+  LimitedQueue<int, ExhaustibleHeapAllocator> limited;
+  limited.limit(3);
+  ExhaustibleHeapAllocator::exhausted = false;
+  TEST_ASSERT_TRUE(queue.push(1));
+  TEST_ASSERT_TRUE(limited.pushLimited(1));
+
+  // a failed push reports it and leaves the queue as it was
+  ExhaustibleHeapAllocator::exhausted = true;
+  TEST_ASSERT_FALSE(queue.push(2));
+  TEST_ASSERT_FALSE(queue.pushUnique(3));
+  TEST_ASSERT_FALSE(limited.pushLimited(2));
+  TEST_ASSERT_EQUAL(1, limited.size());
+  TEST_ASSERT_FALSE(queue.contains(2));
+  TEST_ASSERT_EQUAL(1, queue.hardPeek());
+
+  ExhaustibleHeapAllocator::exhausted = false;
+  TEST_ASSERT_FALSE(queue.pushUnique(1));
+  TEST_ASSERT_TRUE(queue.pushUnique(3));
+  TEST_ASSERT_EQUAL(1, queue.hardPop());
+  TEST_ASSERT_EQUAL(3, queue.hardPop());
+  TEST_ASSERT_TRUE(queue.isEmpty());
+}
@@ -0,0 +1,80 @@
+/*
+ * This is a part of the Uniot project.
+ * Copyright (C) 2016-2024 Uniot <contact@uniot.io>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <CpuGovernor.h>
+#include <TaskScheduler.h>
+#include <unity.h>
+
+#include <vector>
+
+using namespace uniot;
+
+void test_function_cpu_governor_policy(void)
+{
+  TaskScheduler scheduler;
+  std::vector<uint32_t> switches;
+  CpuGovernor governor(scheduler, [&](uint32_t mhz) {
+    switches.push_back(mhz);
+    return true;
+  });
+  scheduler.push("cpu_governor", governor.task());
+
+  // the work of a run takes workUs at 240 MHz and proportionally longer at a lower frequency
+  uint32_t workUs = 3000;
+  SchedulerTask work([&](SchedulerTask &self, short t) {
+    delayMicroseconds(workUs * 240 / governor.getFrequencyMhz());
+  });
+  scheduler.push("work", work);
+  work.attach(10);
+  governor.start(80);
+
+  // 90% at 80 MHz steps up at once, 45% at 160 MHz is in between the thresholds, so it stays there
+  VirtualClock::fastForward(10 * UNIOT_CPU_GOVERNOR_PERIOD_MS, [&] { scheduler.loop(); });
+  TEST_ASSERT_EQUAL(1, switches.size());
+  TEST_ASSERT_EQUAL(160, governor.getFrequencyMhz());
+  TEST_ASSERT_UINT32_WITHIN(2, 45, governor.getUtilizationPercent());
+
+  // a burst: 90% at 160 MHz steps up again
+  workUs = 6000;
+  VirtualClock::fastForward(10 * UNIOT_CPU_GOVERNOR_PERIOD_MS, [&] { scheduler.loop(); });
+  TEST_ASSERT_EQUAL(2, switches.size());
+  TEST_ASSERT_EQUAL(240, governor.getFrequencyMhz());
+
+  // idle, the frequency goes down only after enough quiet samples and one level at a time
+  workUs = 500;
+  VirtualClock::fastForward((UNIOT_CPU_GOVERNOR_DOWN_SAMPLES - 1) * UNIOT_CPU_GOVERNOR_PERIOD_MS, [&] { scheduler.loop(); });
+  TEST_ASSERT_EQUAL(240, governor.getFrequencyMhz());
+  VirtualClock::fastForward(2 * UNIOT_CPU_GOVERNOR_DOWN_SAMPLES * UNIOT_CPU_GOVERNOR_PERIOD_MS, [&] { scheduler.loop(); });
+  TEST_ASSERT_EQUAL(4, switches.size());
+  TEST_ASSERT_EQUAL(160, switches[2]);
+  TEST_ASSERT_EQUAL(80, switches[3]);
+
+  // 25% at 240 MHz is 37% at 160 MHz, but it would be 75% at 80 MHz, over the upper threshold,
+  // so it stops at 160 MHz rather than flip between the levels
+  governor.start(240);
+  workUs = 2500;
+  switches.clear();
+  VirtualClock::fastForward(4 * UNIOT_CPU_GOVERNOR_DOWN_SAMPLES * UNIOT_CPU_GOVERNOR_PERIOD_MS, [&] { scheduler.loop(); });
+  TEST_ASSERT_EQUAL(1, switches.size());
+  TEST_ASSERT_EQUAL(160, governor.getFrequencyMhz());
+
+  work.detach();
+  governor.stop();
+}
@@ -0,0 +1,257 @@
+/*
+ * This is a part of the Uniot project.
+ * Copyright (C) 2016-2024 Uniot <contact@uniot.io>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <ExecutorPool.h>
+#include <unity.h>
+
+#include <chrono>
+#include <cstdio>
+
+using namespace uniot;
+
+class BusyExecutor : public IExecutor
+{
+public:
+  BusyExecutor() : runs(0), active(nullptr), maxActive(nullptr), mSink(0) {}
+
+  virtual void execute(short _) override
+  {
+    if (active)
+    {
+      auto now = ++*active;
+      auto max = maxActive->load();
+      while (now > max && !maxActive->compare_exchange_weak(max, now))
+      {
+      }
+    }
+
+    uint32_t x = 0;
+    for (uint32_t i = 0; i < 100000; i++)
+    {
+      x = x * 1664525u + 1013904223u;
+    }
+    mSink += x;
+    runs++;
+
+    if (active)
+    {
+      --*active;
+    }
+  }
+
+  std::atomic<int> runs;
+  std::atomic<int> *active;
+  std::atomic<int> *maxActive;
+
+private:
+  std::atomic<uint32_t> mSink;
+};
+
+static void submitAll(ExecutorPool &pool, IExecutor &executor, int times, uint8_t group = ExecutorPool::NO_GROUP, uint8_t affinity = ExecutorPool::ANY_WORKER)
+{
+  for (auto i = 0; i < times; i++)
+  {
+    while (!pool.submit(executor, 0, group, affinity))
+    {
+      std::this_thread::yield();
+    }
+  }
+}
+
+class BarrierExecutor : public IExecutor
+{
+public:
+  BarrierExecutor(std::atomic<int> &arrived, int parties) : reached(false), mArrived(arrived), mParties(parties) {}
+
+  virtual void execute(short _) override
+  {
+    ++mArrived;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (mArrived < mParties && std::chrono::steady_clock::now() < deadline)
+    {
+      std::this_thread::yield();
+    }
+    reached = mArrived >= mParties;
+  }
+
+  std::atomic<bool> reached;
+
+private:
+  std::atomic<int> &mArrived;
+  int mParties;
+};
+
+void test_function_executor_pool_scaling(void)
+{
+  constexpr int EXECUTORS_COUNT = 16;
+  constexpr int ROUNDS = 32;
+
+  {
+    ExecutorPool pool(4);
+    TEST_ASSERT_TRUE(pool.start());
+
+    // the first worker is kept busy, so the job queued on it can only run if another worker steals it
+    std::atomic<int> blockerArrived(0);
+    BarrierExecutor blocker(blockerArrived, 2);
+    TEST_ASSERT_TRUE(pool.submit(blocker, 0, ExecutorPool::NO_GROUP, 0));
+    while (!blockerArrived)
+    {
+      std::this_thread::yield();
+    }
+
+    // the jobs wait for each other, so they only finish if they run on three workers at the same time
+    std::atomic<int> arrived(0);
+    BarrierExecutor parties[] = {{arrived, 3}, {arrived, 3}, {arrived, 3}};
+    for (auto &party : parties)
+    {
+      submitAll(pool, party, 1);
+    }
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (arrived < 3 && std::chrono::steady_clock::now() < deadline)
+    {
+      std::this_thread::yield();
+    }
+    blockerArrived++;
+    pool.waitIdle();
+    for (auto &party : parties)
+    {
+      TEST_ASSERT_TRUE(party.reached);
+    }
+    TEST_ASSERT_TRUE(pool.getStolenCount() >= 1);
+  }
+
+  // the throughput depends on the cores and the load of the machine, so it is only reported
+  double baseline = 0;
+  for (unsigned workers = 1; workers <= 4; workers *= 2)
+  {
+    ExecutorPool pool(workers);
+    TEST_ASSERT_TRUE(pool.start());
+
+    BusyExecutor executors[EXECUTORS_COUNT];
+    auto start = std::chrono::steady_clock::now();
+    for (auto round = 0; round < ROUNDS; round++)
+    {
+      for (auto &executor : executors)
+      {
+        submitAll(pool, executor, 1);
+      }
+    }
+    pool.waitIdle();
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    auto total = 0;
+    for (auto &executor : executors)
+    {
+      total += executor.runs;
+    }
+    TEST_ASSERT_EQUAL(EXECUTORS_COUNT * ROUNDS, total);
+
+    auto throughput = total / elapsed;
+    baseline = baseline ? baseline : throughput;
+
+    char msg[128];
+    snprintf(msg, sizeof(msg), "%u workers on %u cores: %.0f jobs/s, x%.2f, %u stolen",
+             workers, std::thread::hardware_concurrency(), throughput, throughput / baseline, pool.getStolenCount());
+    TEST_MESSAGE(msg);
+  }
+}
+
+void test_function_executor_pool_exclusive_group(void)
+{
+  ExecutorPool pool(4);
+  TEST_ASSERT_TRUE(pool.start());
+
+  std::atomic<int> active(0);
+  std::atomic<int> maxActive(0);
+  BusyExecutor executors[8];
+  for (auto &executor : executors)
+  {
+    executor.active = &active;
+    executor.maxActive = &maxActive;
+    submitAll(pool, executor, 10, 5);
+  }
+  pool.waitIdle();
+
+  TEST_ASSERT_EQUAL(1, maxActive.load());
+  for (auto &executor : executors)
+  {
+    TEST_ASSERT_EQUAL(10, executor.runs.load());
+  }
+}
+
+void test_function_executor_pool_affinity(void)
+{
+  ExecutorPool pool(4);
+  TEST_ASSERT_TRUE(pool.start());
+
+  BusyExecutor pinned;
+  submitAll(pool, pinned, 20, ExecutorPool::NO_GROUP, 2);
+  pool.waitIdle();
+
+  TEST_ASSERT_EQUAL(20, pinned.runs.load());
+  TEST_ASSERT_EQUAL(0, pool.getStolenCount());
+}
+
+void test_function_executor_pool_pooled_executor(void)
+{
+  ExecutorPool pool(2);
+  TEST_ASSERT_TRUE(pool.start());
+
+  BusyExecutor executor;
+  PooledExecutor pooled(pool, executor);
+  for (auto i = 0; i < 100; i++)
+  {
+    pooled.execute(0);
+  }
+  pool.waitIdle();
+
+  // ticks that arrive while the executor is still running are merged
+  TEST_ASSERT_TRUE(executor.runs > 0);
+  TEST_ASSERT_TRUE(executor.runs <= 100);
+  TEST_ASSERT_FALSE(pooled.isInFlight());
+
+  // a run still queued when the pool stops is not lost, the executor keeps working afterwards
+  ExecutorPool single(1);
+  TEST_ASSERT_TRUE(single.start());
+  std::atomic<bool> release(false);
+  single.submit([](void *arg, short)
+                {
+                  while (!static_cast<std::atomic<bool> *>(arg)->load())
+                  {
+                    std::this_thread::yield();
+                  }
+                },
+                &release, 0);
+  PooledExecutor queued(single, executor);
+  auto runs = executor.runs.load();
+  queued.execute(0);
+  std::thread releaser([&]
+                       {
+                         std::this_thread::sleep_for(std::chrono::milliseconds(20));
+                         release = true;
+                       });
+  single.stop();
+  releaser.join();
+  TEST_ASSERT_EQUAL(runs + 1, executor.runs.load());
+  TEST_ASSERT_FALSE(queued.isInFlight());
+
+  queued.execute(0);
+  TEST_ASSERT_EQUAL(runs + 2, executor.runs.load());
+}
@@ -0,0 +1,104 @@
+/*
+ * This is a part of the Uniot project.
+ * Copyright (C) 2016-2024 Uniot <contact@uniot.io>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <Map.h>
+#include <unity.h>
+
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+
+using namespace uniot;
+
+void test_function_map_matches_std_map(void)
+{
+  Map<uint32_t, uint32_t> map;
+  std::map<uint32_t, uint32_t> reference;
+  std::mt19937 random(42);
+
+  // a small key range keeps the clusters dense, so removals shift items back all the time
+  for (int i = 0; i < 20000; i++) {
+    uint32_t key = random() % 200;
+    switch (random() % 3) {
+      case 0:
+        TEST_ASSERT_EQUAL(!reference.count(key), map.put(key, i));
+        reference.emplace(key, i);
+        break;
+      case 1:
+        TEST_ASSERT_EQUAL(reference.erase(key), map.remove(key));
+        break;
+      default:
+        TEST_ASSERT_EQUAL(reference.count(key), map.exist(key));
+        TEST_ASSERT_EQUAL(reference.count(key) ? reference[key] : UINT32_MAX, map.get(key, UINT32_MAX));
+        break;
+    }
+    TEST_ASSERT_EQUAL(reference.size(), map.size());
+  }
+
+  size_t visited = 0;
+  for (auto &item : map) {
+    TEST_ASSERT_EQUAL(reference[item.first], item.second);
+    visited++;
+  }
+  TEST_ASSERT_EQUAL(reference.size(), visited);
+  TEST_ASSERT_TRUE(map.size() * 4 <= map.capacity() * 3);
+
+  map.clean();
+  TEST_ASSERT_TRUE(map.isEmpty());
+  TEST_ASSERT_EQUAL(0, map.capacity());
+  TEST_ASSERT_FALSE(map.exist(1));
+  TEST_ASSERT_TRUE(map.put(1, 1));
+}
+
+void test_function_map_nested_iteration(void)
+{
+  Map<std::string, std::shared_ptr<int>> map;
+  for (int i = 0; i < 10; i++) {
+    TEST_ASSERT_TRUE(map.put("channel_" + std::to_string(i), std::make_shared<int>(i)));
+  }
+  TEST_ASSERT_FALSE(map.put("channel_3", nullptr));
+  TEST_ASSERT_EQUAL(3, *map.get("channel_3"));
+  TEST_ASSERT_NULL(map.get("channel_10", nullptr).get());
+
+  // the inner loops and lookups do not disturb the outer one
+  size_t outer = 0;
+  size_t inner = 0;
+  size_t found = 0;
+  for (auto &item : map) {
+    outer++;
+    map.forEach([&](const Map<std::string, std::shared_ptr<int>>::MapItem &other) {
+      inner++;
+      found += map.exist(other.first) && *map.get(other.first) == *other.second;
+    });
+    TEST_ASSERT_EQUAL(*item.second, *map.get(item.first));
+  }
+  TEST_ASSERT_EQUAL(10, outer);
+  TEST_ASSERT_EQUAL(100, inner);
+  TEST_ASSERT_EQUAL(100, found);
+
+  // the values are released with their items
+  auto value = map.get("channel_5");
+  TEST_ASSERT_EQUAL(2, value.use_count());
+  TEST_ASSERT_TRUE(map.remove("channel_5"));
+  TEST_ASSERT_EQUAL(1, value.use_count());
+  map.clean();
+  TEST_ASSERT_EQUAL(0, map.size());
+}
@@ -0,0 +1,120 @@
+/*
+ * This is a part of the Uniot project.
+ * Copyright (C) 2016-2024 Uniot <contact@uniot.io>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <ClearQueue.h>
+#include <MemoryProfiler.h>
+#include <unity.h>
+
+#include <thread>
+
+using namespace uniot;
+
+void test_function_memory_profiler_tagged_scopes(void)
+{
+  auto user = MemoryProfiler::getStats(MemoryProfiler::USER);
+  auto cbor = MemoryProfiler::getStats(MemoryProfiler::CBOR);
+
+  void *ptr = nullptr;
+  void *nested = nullptr;
+  {
+    MemoryProfiler::Scope scope(MemoryProfiler::USER);
+    ptr = MemoryProfiler::allocate(100);
+    {
+      MemoryProfiler::Scope inner(MemoryProfiler::CBOR);
+      nested = MemoryProfiler::allocate(30);
+    }
+    // the outer tag is back once the inner scope ends
+    TEST_ASSERT_EQUAL(MemoryProfiler::USER, MemoryProfiler::current());
+  }
+  TEST_ASSERT_EQUAL(MemoryProfiler::UNTAGGED, MemoryProfiler::current());
+  TEST_ASSERT_EQUAL(0, reinterpret_cast<uintptr_t>(ptr) % alignof(max_align_t));
+  TEST_ASSERT_EQUAL(user.liveBytes + 100, MemoryProfiler::getStats(MemoryProfiler::USER).liveBytes);
+  TEST_ASSERT_EQUAL(user.allocationsCount + 1, MemoryProfiler::getStats(MemoryProfiler::USER).allocationsCount);
+  TEST_ASSERT_EQUAL(cbor.liveBytes + 30, MemoryProfiler::getStats(MemoryProfiler::CBOR).liveBytes);
+
+  // a block stays with the subsystem that allocated it, wherever it is resized or freed
+  MemoryProfiler::resetPeaks();
+  {
+    MemoryProfiler::Scope scope(MemoryProfiler::MQTT);
+    memset(ptr, 0x5A, 100);
+    ptr = MemoryProfiler::reallocate(ptr, 400);
+    TEST_ASSERT_EQUAL_HEX8(0x5A, static_cast<uint8_t *>(ptr)[99]);
+    ptr = MemoryProfiler::reallocate(ptr, 50);
+    MemoryProfiler::deallocate(nested);
+  }
+  auto after = MemoryProfiler::getStats(MemoryProfiler::USER);
+  TEST_ASSERT_EQUAL(user.liveBytes + 50, after.liveBytes);
+  TEST_ASSERT_EQUAL(user.liveBytes + 400, after.peakBytes);
+  TEST_ASSERT_EQUAL(user.liveCount + 1, after.liveCount);
+  TEST_ASSERT_EQUAL(cbor.liveBytes, MemoryProfiler::getStats(MemoryProfiler::CBOR).liveBytes);
+
+  MemoryProfiler::deallocate(ptr);
+  TEST_ASSERT_EQUAL(user.liveBytes, MemoryProfiler::getStats(MemoryProfiler::USER).liveBytes);
+  TEST_ASSERT_EQUAL(user.liveCount, MemoryProfiler::getStats(MemoryProfiler::USER).liveCount);
+
+  size_t exported = 0;
+  MemoryProfiler::exportStats([&](const char *name, const MemoryProfiler::Stats &stats) {
+    exported += !strcmp(name, "user") || !strcmp(name, "cbor");
+  });
+  TEST_ASSERT_EQUAL(2, exported);
+}
+
+void test_function_memory_profiler_threads_and_accounting(void)
+{
+  auto queue = MemoryProfiler::getStats(MemoryProfiler::QUEUE);
+  auto lisp = MemoryProfiler::getStats(MemoryProfiler::LISP);
+
+  // the scope of one thread does not tag the allocations of another one
+  MemoryProfiler::Scope scope(MemoryProfiler::QUEUE);
+  void *ptr = nullptr;
+  std::thread([&] { ptr = MemoryProfiler::allocate(64); }).join();
+  TEST_ASSERT_EQUAL(queue.liveBytes, MemoryProfiler::getStats(MemoryProfiler::QUEUE).liveBytes);
+  MemoryProfiler::deallocate(ptr);
+
+  // the memory the libraries allocate on their own is accounted explicitly
+  MemoryProfiler::account(MemoryProfiler::LISP, 8000);
+  TEST_ASSERT_EQUAL(lisp.liveBytes + 8000, MemoryProfiler::getStats(MemoryProfiler::LISP).liveBytes);
+  TEST_ASSERT_TRUE(MemoryProfiler::getTotalLiveBytes() >= 8000);
+  MemoryProfiler::release(MemoryProfiler::LISP, 8000);
+  TEST_ASSERT_EQUAL(lisp.liveBytes, MemoryProfiler::getStats(MemoryProfiler::LISP).liveBytes);
+  TEST_ASSERT_EQUAL(lisp.allocationsCount + 1, MemoryProfiler::getStats(MemoryProfiler::LISP).allocationsCount);
+}
+
+#if UNIOT_MEM_PROFILER_ENABLED
+void test_function_memory_profiler_node_pool_tag(void)
+{
+  // NOTE: the odd chunk size gives the test a pool of its own
+  using Allocator = PoolNodeAllocator<5>;
+  auto queue = MemoryProfiler::getStats(MemoryProfiler::QUEUE);
+
+  // the chunks of the node pools are charged to the queues, whatever the scope of the caller
+  {
+    MemoryProfiler::Scope scope(MemoryProfiler::USER);
+    ClearQueue<int, Allocator> values;
+    values.push(1);
+    auto grown = MemoryProfiler::getStats(MemoryProfiler::QUEUE);
+    TEST_ASSERT_EQUAL(queue.liveCount + 1, grown.liveCount);
+    TEST_ASSERT_TRUE(grown.liveBytes >= queue.liveBytes + 5 * sizeof(int));
+  }
+  TEST_ASSERT_EQUAL(1, (ClearQueue<int, Allocator>::trimNodes()));
+  TEST_ASSERT_EQUAL(queue.liveBytes, MemoryProfiler::getStats(MemoryProfiler::QUEUE).liveBytes);
+  TEST_ASSERT_EQUAL(queue.liveCount, MemoryProfiler::getStats(MemoryProfiler::QUEUE).liveCount);
+}
+#endif
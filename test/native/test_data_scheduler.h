@@ -0,0 +1,466 @@
+/*
+ * This is a part of the Uniot project.
+ * Copyright (C) 2016-2024 Uniot <contact@uniot.io>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <Arduino.h>
+#include <TaskScheduler.h>
+#include <unity.h>
+
+#include "test_allocations.h"
+
+using namespace uniot;
+
+class CounterExecutor : public IExecutor
+{
+public:
+  CounterExecutor() : runs(0) {}
+
+  virtual void execute(short _) override
+  {
+    runs++;
+  }
+
+  int runs;
+};
+
+void test_function_scheduler_static_tasks_without_heap(void)
+{
+  TaskScheduler scheduler;
+  TEST_ASSERT_TRUE(scheduler.reserve(3));
+
+  auto before = gAllocationsCount.load();
+
+  CounterExecutor executor;
+  int lambdaRuns = 0;
+  SchedulerTask executorTask(executor);
+  SchedulerTask lambdaTask([&lambdaRuns](SchedulerTask &self, short t) { lambdaRuns++; });
+  {
+    SchedulerTask scopedTask([](SchedulerTask &self, short t) {});
+    scheduler.push("executor", executorTask)
+        .push("lambda", lambdaTask)
+        .push("scoped", scopedTask);
+    TEST_ASSERT_EQUAL(3, scheduler.size());
+    scopedTask.attach(1);
+  }
+  // a destroyed task leaves the scheduler by itself
+  TEST_ASSERT_EQUAL(2, scheduler.size());
+  TEST_ASSERT_EQUAL(TaskScheduler::INVALID_HANDLE, scheduler.find("scoped"));
+
+  executorTask.attach(10);
+  lambdaTask.attach(20, 3);
+  VirtualClock::fastForward(1000, [&] { scheduler.loop(); });
+  TEST_ASSERT_TRUE(scheduler.remove(executorTask));
+
+  TEST_ASSERT_EQUAL(before, gAllocationsCount.load());
+  TEST_ASSERT_EQUAL(100, executor.runs);
+  TEST_ASSERT_EQUAL(3, lambdaRuns);
+  TEST_ASSERT_EQUAL(1, scheduler.size());
+}
+
+void test_function_scheduler_make_single_allocation(void)
+{
+  auto runs = 0;
+  auto before = gAllocationsCount.load();
+  auto task = TaskScheduler::make([&runs](SchedulerTask &self, short t) { runs++; });
+  TEST_ASSERT_EQUAL(before + 1, gAllocationsCount.load());
+
+  // a callback that does not fit inline still works, it just takes another allocation
+  char big[UNIOT_SCHEDULER_TASK_CALLBACK_SIZE + 16] = {1};
+  auto bigTask = TaskScheduler::make([&runs, big](SchedulerTask &self, short t) { runs += big[0]; });
+
+  TaskScheduler scheduler;
+  scheduler.push("small", task)
+      .push("big", bigTask);
+  task->once(5);
+  bigTask->once(5);
+  VirtualClock::advance(5);
+  scheduler.loop();
+  TEST_ASSERT_EQUAL(2, runs);
+}
+
+void test_function_scheduler_missed_ticks_policies(void)
+{
+  struct Probe
+  {
+    int runs = 0;
+    uint32_t missed = 0;
+    short lastTimes = 0;
+  } coalesce, skip, catchUp;
+  auto makeProbe = [](Probe &probe) {
+    return TaskScheduler::make([&probe](SchedulerTask &self, short times) {
+      probe.runs++;
+      probe.missed += self.getMissedPeriods();
+      probe.lastTimes = times;
+    });
+  };
+
+  TaskScheduler scheduler;
+  auto coalesceTask = makeProbe(coalesce);
+  auto skipTask = makeProbe(skip);
+  auto catchUpTask = makeProbe(catchUp);
+  skipTask->setMissedTickPolicy(SchedulerTask::MISSED_SKIP);
+  catchUpTask->setMissedTickPolicy(SchedulerTask::MISSED_CATCH_UP);
+  scheduler.push("coalesce", coalesceTask)
+      .push("skip", skipTask)
+      .push("catch_up", catchUpTask);
+  coalesceTask->attach(10, 10);
+  skipTask->attach(10, 10);
+  catchUpTask->attach(10);
+
+  // the loop is late: three periods elapse before it runs
+  auto startMs = millis();
+  VirtualClock::advance(35);
+  scheduler.loop();
+  TEST_ASSERT_EQUAL(1, coalesce.runs);
+  TEST_ASSERT_EQUAL(2, coalesce.missed);
+  TEST_ASSERT_EQUAL(7, coalesce.lastTimes);
+  TEST_ASSERT_EQUAL(1, skip.runs);
+  TEST_ASSERT_EQUAL(0, skip.missed);
+  TEST_ASSERT_EQUAL(2, skipTask->getTotalMissedPeriods());
+  TEST_ASSERT_EQUAL(3, catchUp.runs);
+  TEST_ASSERT_EQUAL(0, catchUp.missed);
+
+  // a burst longer than the limit is cut and the rest is reported as missed
+  static_assert(UNIOT_SCHEDULER_MAX_CATCH_UP < 7, "the burst below must be cut");
+  VirtualClock::advance(65);
+  scheduler.loop();
+  TEST_ASSERT_EQUAL(3 + UNIOT_SCHEDULER_MAX_CATCH_UP, catchUp.runs);
+  TEST_ASSERT_EQUAL(7 - UNIOT_SCHEDULER_MAX_CATCH_UP, catchUp.missed);
+  TEST_ASSERT_EQUAL(7 - UNIOT_SCHEDULER_MAX_CATCH_UP, catchUpTask->getTotalMissedPeriods());
+
+  // elapsed periods, not runs, count towards `times`, so the finite tasks end on the period grid
+  TEST_ASSERT_FALSE(coalesceTask->isAttached());
+  TEST_ASSERT_FALSE(skipTask->isAttached());
+  TEST_ASSERT_EQUAL(2, coalesce.runs);
+  TEST_ASSERT_EQUAL(0, coalesce.lastTimes);
+  TEST_ASSERT_EQUAL(2 + 6, coalesce.missed);
+  TEST_ASSERT_EQUAL(100, millis() - startMs);
+
+  catchUpTask->detach();
+}
+
+static uint32_t simulateWakeupsPerHour(bool withSlack)
+{
+  constexpr uint64_t HOUR_MS = 60 * 60 * 1000ULL;
+
+  TaskScheduler scheduler;
+  SchedulerTask led([](SchedulerTask &self, short t) {});
+  SchedulerTask monitor([](SchedulerTask &self, short t) {});
+  SchedulerTask storeDate([](SchedulerTask &self, short t) {});
+  scheduler.push("signal_led", led)
+      .push("wifi_monitor", monitor)
+      .push("store_date", storeDate);
+  if (withSlack)
+  {
+    led.setSlack(100);
+    monitor.setSlack(1000);
+    storeDate.setSlack(5 * 60 * 1000UL);
+  }
+
+  // the tasks are started at arbitrary moments, as they are on the device,
+  // but counted from a round hour, since the ticks are lined up on multiples of the periods counted from the boot
+  // NOTE: the loop keeps running meanwhile, it is the loop that switches a delayed first tick to the period
+  auto loop = [&] { scheduler.loop(); };
+  VirtualClock::advance(HOUR_MS - VirtualClock::millis() % HOUR_MS);
+  VirtualClock::fastForward(13, loop);
+  storeDate.attach(5 * 60 * 1000UL);
+  VirtualClock::fastForward(271, loop);
+  led.attach(500);
+  VirtualClock::fastForward(1187, loop);
+  monitor.attach(2000);
+
+  auto before = scheduler.getWakeupsCount();
+  VirtualClock::fastForward(HOUR_MS, loop);
+  return scheduler.getWakeupsCount() - before;
+}
+
+void test_function_scheduler_slack_coalesces_wakeups(void)
+{
+  auto independent = simulateWakeupsPerHour(false);
+  auto coalesced = simulateWakeupsPerHour(true);
+
+  char msg[128];
+  snprintf(msg, sizeof(msg), "wakeups per hour: %lu without slack, %lu with slack",
+           (unsigned long)independent, (unsigned long)coalesced);
+  TEST_MESSAGE(msg);
+
+  // every wifi_monitor tick shares the wakeup with a signal_led one,
+  // store_date is attached first and the small slack of signal_led is not enough to line up with it
+  TEST_ASSERT_UINT32_WITHIN(2, 3600 * 2 + 12, coalesced);
+  TEST_ASSERT_UINT32_WITHIN(2, 3600 * 2 + 1800 + 12, independent);
+}
+
+void test_function_scheduler_slack_late_loop_and_timeouts(void)
+{
+  TaskScheduler scheduler;
+  uint32_t lateMs = 7;
+  uint32_t runs = 0;
+  uint32_t offGrid = 0;
+  SchedulerTask task([&](SchedulerTask &self, short t) {
+    runs++;
+    offGrid += millis() % 100 != lateMs;
+  });
+  scheduler.push("task", task);
+  task.setSlack(100);
+  auto loop = [&] {
+    delay(lateMs);
+    scheduler.loop();
+  };
+
+  // the first tick is delayed onto a grid of 100 ms, a late loop must not move the ticks that follow it
+  VirtualClock::advance(1000 - VirtualClock::millis() % 1000 + 30);
+  task.attach(1000);
+  VirtualClock::fastForward(10 * 1000 + 100, loop);
+  TEST_ASSERT_EQUAL(10, runs);
+  TEST_ASSERT_EQUAL(0, offGrid);
+
+  lateMs = 0;
+  VirtualClock::fastForward(5 * 1000, loop);
+  TEST_ASSERT_EQUAL(15, runs);
+  TEST_ASSERT_EQUAL(0, offGrid);
+
+  // a one-shot is a timeout, the slack does not postpone it
+  task.detach();
+  VirtualClock::advance(30);
+  auto startMs = millis();
+  uint32_t firedMs = 0;
+  SchedulerTask timeout([&](SchedulerTask &self, short t) { firedMs = millis(); });
+  scheduler.push("timeout", timeout);
+  timeout.setSlack(1000);
+  timeout.once(500);
+  VirtualClock::fastForward(2000, [&] { scheduler.loop(); });
+  TEST_ASSERT_EQUAL(500, firedMs - startMs);
+}
+
+struct OverloadResult
+{
+  uint32_t burstLatenessMs;
+  uint32_t cosmeticRuns;
+  uint32_t shedCount;
+};
+
+static OverloadResult simulateOverload(uint32_t loopBudgetMs)
+{
+  TaskScheduler scheduler;
+  scheduler.setLoopBudget(loopBudgetMs);
+
+  auto startMs = millis();
+  uint32_t burstLatenessMs = 0;
+  uint32_t cosmeticRuns = 0;
+  // a burst of traffic makes every mqtt run take 60 ms for the first second
+  SchedulerTask mqtt([&](SchedulerTask &self, short t) {
+    auto sinceStartMs = millis() - startMs;
+    if (sinceStartMs < 1000)
+    {
+      burstLatenessMs += sinceStartMs % 100;
+      delay(60);
+    }
+  });
+  SchedulerTask cosmetic([&](SchedulerTask &self, short t) {
+    cosmeticRuns++;
+    delay(30);
+  });
+  cosmetic.setSheddable(true);
+  scheduler.push("cosmetic", cosmetic)
+      .push("mqtt", mqtt);
+  cosmetic.attach(100);
+  mqtt.attach(100);
+
+  VirtualClock::fastForward(2000, [&] { scheduler.loop(); });
+  return {burstLatenessMs, cosmeticRuns, scheduler.getShedCount()};
+}
+
+void test_function_scheduler_load_shedding(void)
+{
+  auto unbounded = simulateOverload(0);
+  TEST_ASSERT_EQUAL(0, unbounded.shedCount);
+  TEST_ASSERT_EQUAL(9 * 30, unbounded.burstLatenessMs);
+  TEST_ASSERT_EQUAL(20, unbounded.cosmeticRuns);
+
+  // only the first loop of the burst runs the cosmetic task ahead of mqtt,
+  // then it waits until a loop fits into the budget again
+  auto shedding = simulateOverload(50);
+  TEST_ASSERT_EQUAL(30, shedding.burstLatenessMs);
+  TEST_ASSERT_EQUAL(9, shedding.shedCount);
+  TEST_ASSERT_EQUAL(11, shedding.cosmeticRuns);
+}
+
+class QueueExecutor : public IExecutor
+{
+public:
+  int pending = 0;
+  int runs = 0;
+
+  virtual void execute(short times) override
+  {
+    runs++;
+    pending = 0;
+  }
+
+  virtual bool process(short times) override
+  {
+    auto busy = pending > 0;
+    execute(times);
+    return busy;
+  }
+};
+
+void test_function_scheduler_adaptive_period(void)
+{
+  TaskScheduler scheduler;
+  QueueExecutor executor;
+  SchedulerTask task(executor);
+  task.setAdaptivePeriod(10, 100);
+  scheduler.push("queue", task);
+  task.attach(10);
+
+  // idle, the period doubles on every run: 10, 20, 40, 80, then stays at 100
+  VirtualClock::fastForward(1000, [&] { scheduler.loop(); });
+  TEST_ASSERT_EQUAL(4 + 8, executor.runs);
+  TEST_ASSERT_EQUAL(100, task.getPeriodMs());
+
+  // the first busy run, at 1050 ms, brings the period back to the minimum
+  executor.pending = 1;
+  executor.runs = 0;
+  VirtualClock::fastForward(50, [&] { scheduler.loop(); });
+  TEST_ASSERT_EQUAL(10, task.getPeriodMs());
+  executor.pending = 1;
+  VirtualClock::fastForward(10, [&] { scheduler.loop(); });
+  TEST_ASSERT_EQUAL(2, executor.runs);
+  TEST_ASSERT_EQUAL(10, task.getPeriodMs());
+
+  // a callback that does not report is always busy
+  auto plainRuns = 0;
+  SchedulerTask plain([&](SchedulerTask &self, short t) { plainRuns++; });
+  plain.setAdaptivePeriod(10, 100);
+  scheduler.push("plain", plain);
+  plain.attach(10);
+  VirtualClock::fastForward(1000, [&] { scheduler.loop(); });
+  TEST_ASSERT_EQUAL(100, plainRuns);
+  TEST_ASSERT_EQUAL(10, plain.getPeriodMs());
+
+  task.detach();
+  plain.detach();
+}
+
+static TaskScheduler::LoopStats simulateEqualPeriods(bool stagger)
+{
+  TaskScheduler scheduler;
+  scheduler.setPhaseStaggering(stagger);
+  SchedulerTask fast([](SchedulerTask &self, short t) { delay(1); });
+  SchedulerTask a([](SchedulerTask &self, short t) { delay(2); });
+  SchedulerTask b([](SchedulerTask &self, short t) { delay(2); });
+  SchedulerTask c([](SchedulerTask &self, short t) { delay(2); });
+  SchedulerTask d([](SchedulerTask &self, short t) { delay(2); });
+  scheduler.push("fast", fast)
+      .push("a", a)
+      .push("b", b)
+      .push("c", c)
+      .push("d", d);
+  fast.attach(10);
+  a.attach(20);
+  b.attach(20);
+  c.attach(20);
+  d.attach(20);
+
+  VirtualClock::fastForward(1000, [&] { scheduler.loop(); });
+  return scheduler.getLoopStats();
+}
+
+void test_function_scheduler_phase_staggering(void)
+{
+  auto aligned = simulateEqualPeriods(false);
+  auto staggered = simulateEqualPeriods(true);
+
+  char msg[128];
+  snprintf(msg, sizeof(msg), "work per loop: %lu +- %lu us aligned, %lu +- %lu us staggered",
+           (unsigned long)aligned.meanUs, (unsigned long)aligned.stdDevUs,
+           (unsigned long)staggered.meanUs, (unsigned long)staggered.stdDevUs);
+  TEST_MESSAGE(msg);
+
+  // aligned, every other tick of the fast task comes with all four 20 ms tasks: 1 ms, 9 ms, 1 ms, ...
+  TEST_ASSERT_EQUAL(100, aligned.count);
+  TEST_ASSERT_EQUAL(5000, aligned.meanUs);
+  TEST_ASSERT_EQUAL(4000, aligned.stdDevUs);
+  TEST_ASSERT_EQUAL(9000, aligned.maxUs);
+
+  // staggered, the 20 ms tasks tick 5 ms apart: 3 ms with the fast task, 2 ms without it,
+  // the delayed first ticks of three of them fall out of the simulated second
+  TEST_ASSERT_EQUAL(100 + 2 * 49, staggered.count);
+  TEST_ASSERT_UINT32_WITHIN(50, 2500, staggered.meanUs);
+  TEST_ASSERT_UINT32_WITHIN(50, 500, staggered.stdDevUs);
+  TEST_ASSERT_EQUAL(3000, staggered.maxUs);
+}
+
+void test_function_scheduler_period_override(void)
+{
+  TaskScheduler scheduler;
+  auto runs = 0;
+  SchedulerTask task([&](SchedulerTask &self, short t) { runs++; });
+  scheduler.push("tuned", task);
+  task.attach(10);
+
+  // an attached task switches to the override at once
+  task.setPeriodOverride(100);
+  VirtualClock::fastForward(1000, [&] { scheduler.loop(); });
+  TEST_ASSERT_EQUAL(10, runs);
+  TEST_ASSERT_EQUAL(100, task.getPeriodMs());
+
+  // the code attaching the task again does not undo the override
+  task.attach(20);
+  TEST_ASSERT_EQUAL(100, task.getPeriodMs());
+
+  // a disabled task ignores attach() and comes back as it was last attached
+  task.setEnabled(false);
+  TEST_ASSERT_FALSE(task.isAttached());
+  task.attach(50);
+  TEST_ASSERT_FALSE(task.isAttached());
+  runs = 0;
+  VirtualClock::fastForward(1000, [&] { scheduler.loop(); });
+  TEST_ASSERT_EQUAL(0, runs);
+  task.setEnabled(true);
+  TEST_ASSERT_TRUE(task.isAttached());
+  TEST_ASSERT_EQUAL(100, task.getPeriodMs());
+
+  // without the override the period asked by the code is back
+  task.setPeriodOverride(0);
+  TEST_ASSERT_EQUAL(50, task.getPeriodMs());
+  VirtualClock::fastForward(1000, [&] { scheduler.loop(); });
+  TEST_ASSERT_EQUAL(20, runs);
+
+  // the code detaching a disabled task wins over enabling it later
+  task.setEnabled(false);
+  task.detach();
+  task.setEnabled(true);
+  TEST_ASSERT_FALSE(task.isAttached());
+
+  // the names are not unique, the handles reach every task once
+  SchedulerTask twin([&](SchedulerTask &self, short t) {});
+  scheduler.push("tuned", twin);
+  size_t visited = 0;
+  scheduler.exportTasksHandles([&](const char *name, TaskScheduler::TaskHandle handle) {
+    if (!strcmp(name, "tuned")) {
+      scheduler.get(handle)->setPeriodOverride(200);
+      visited++;
+    }
+  });
+  TEST_ASSERT_EQUAL(2, visited);
+  TEST_ASSERT_EQUAL(200, task.getPeriodOverride());
+  TEST_ASSERT_EQUAL(200, twin.getPeriodOverride());
+}
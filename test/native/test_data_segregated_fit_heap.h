@@ -0,0 +1,154 @@
+/*
+ * This is a part of the Uniot project.
+ * Copyright (C) 2016-2024 Uniot <contact@uniot.io>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <SegregatedFitHeap.h>
+#include <unity.h>
+
+#include <map>
+#include <random>
+
+using namespace uniot;
+
+static bool isFilledWith(const uint8_t *data, size_t size, uint8_t value)
+{
+  for (size_t i = 0; i < size; i++) {
+    if (data[i] != value) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void test_function_segregated_fit_heap_random_workload(void)
+{
+  static SegregatedFitHeap<4096> heap;
+  heap.initialize();
+  auto initialFree = heap.getTotalFreeMemory();
+  TEST_ASSERT_EQUAL(initialFree, heap.getLargestFreeBlock());
+  TEST_ASSERT_EQUAL(1, heap.getFreeBlocksCount());
+
+  // every live block is filled with its own byte, so an overlap or a lost copy shows up as a wrong byte
+  std::map<uint8_t *, std::pair<size_t, uint8_t>> live;
+  std::mt19937 random(7);
+  uint8_t nextValue = 1;
+  for (int i = 0; i < 20000; i++) {
+    auto it = live.empty() ? live.end() : std::next(live.begin(), random() % live.size());
+    size_t size = 1 + random() % (random() % 4 ? 48 : 600);
+    switch (random() % 3) {
+      case 0: {
+        auto ptr = static_cast<uint8_t *>(heap.allocate(size));
+        if (ptr) {
+          TEST_ASSERT_EQUAL(0, reinterpret_cast<uintptr_t>(ptr) % SegregatedFitHeap<4096>::ALIGNMENT);
+          TEST_ASSERT_TRUE(heap.owns(ptr) && heap.getBlockSize(ptr) >= size);
+          memset(ptr, nextValue, size);
+          live[ptr] = {size, nextValue++};
+        }
+        break;
+      }
+      case 1:
+        if (it != live.end()) {
+          TEST_ASSERT_TRUE(isFilledWith(it->first, it->second.first, it->second.second));
+          heap.deallocate(it->first);
+          live.erase(it);
+        }
+        break;
+      default:
+        if (it != live.end()) {
+          auto value = it->second.second;
+          auto kept = size < it->second.first ? size : it->second.first;
+          auto ptr = static_cast<uint8_t *>(heap.reallocate(it->first, size));
+          if (ptr) {
+            TEST_ASSERT_TRUE(isFilledWith(ptr, kept, value));
+            memset(ptr, value, size);
+            live.erase(it);
+            live[ptr] = {size, value};
+          } else {
+            TEST_ASSERT_TRUE(isFilledWith(it->first, it->second.first, value));
+          }
+        }
+        break;
+    }
+
+    size_t used = 0;
+    for (auto &block : live) {
+      used += heap.getBlockSize(block.first);
+    }
+    TEST_ASSERT_EQUAL(used, heap.getUsedMemory());
+    TEST_ASSERT_EQUAL(live.size(), heap.getAllocationsCount());
+    TEST_ASSERT_TRUE(heap.getLargestFreeBlock() <= heap.getTotalFreeMemory());
+  }
+
+  for (auto &block : live) {
+    TEST_ASSERT_TRUE(isFilledWith(block.first, block.second.first, block.second.second));
+    heap.deallocate(block.first);
+  }
+  // the free blocks have merged back into one
+  TEST_ASSERT_EQUAL(initialFree, heap.getTotalFreeMemory());
+  TEST_ASSERT_EQUAL(initialFree, heap.getLargestFreeBlock());
+  TEST_ASSERT_EQUAL(1, heap.getFreeBlocksCount());
+  TEST_ASSERT_EQUAL(0, heap.getFragmentation());
+  TEST_ASSERT_TRUE(heap.getPeakUsedMemory() > initialFree / 2);
+}
+
+void test_function_segregated_fit_heap_in_place_growth(void)
+{
+  static SegregatedFitHeap<1024> heap;
+  heap.initialize();
+  auto initialFree = heap.getTotalFreeMemory();
+
+  // the largest free block can always be allocated at once
+  auto whole = heap.allocate(heap.getLargestFreeBlock());
+  TEST_ASSERT_NOT_NULL(whole);
+  TEST_ASSERT_NULL(heap.allocate(1));
+  heap.deallocate(whole);
+
+  auto a = static_cast<uint8_t *>(heap.allocate(64));
+  auto b = heap.allocate(64);
+  auto c = heap.allocate(64);
+  memset(a, 0xA5, 64);
+  heap.deallocate(b);
+  TEST_ASSERT_EQUAL(2, heap.getFreeBlocksCount());
+  TEST_ASSERT_TRUE(heap.getFragmentation() > 0);
+
+  // the freed neighbour is taken over, the data stays where it is
+  TEST_ASSERT_EQUAL_PTR(a, heap.reallocate(a, 120));
+  TEST_ASSERT_TRUE(isFilledWith(a, 64, 0xA5));
+  TEST_ASSERT_EQUAL(1, heap.getFreeBlocksCount());
+
+  // a shrink gives the tail back, which is merged with nothing as the next block is used
+  TEST_ASSERT_EQUAL_PTR(a, heap.reallocate(a, 32));
+  TEST_ASSERT_EQUAL(2, heap.getFreeBlocksCount());
+
+  // a block that cannot grow in place is moved
+  auto moved = static_cast<uint8_t *>(heap.reallocate(a, 300));
+  TEST_ASSERT_NOT_NULL(moved);
+  TEST_ASSERT_TRUE(moved != a);
+  TEST_ASSERT_TRUE(isFilledWith(moved, 32, 0xA5));
+
+  // a failed reallocation leaves the block untouched
+  TEST_ASSERT_NULL(heap.reallocate(moved, 4096));
+  TEST_ASSERT_TRUE(isFilledWith(moved, 32, 0xA5));
+
+  heap.deallocate(moved);
+  heap.deallocate(c);
+  TEST_ASSERT_EQUAL(0, heap.getAllocationsCount());
+  TEST_ASSERT_EQUAL(0, heap.getUsedMemory());
+  TEST_ASSERT_EQUAL(initialFree, heap.getLargestFreeBlock());
+}
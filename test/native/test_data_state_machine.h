@@ -0,0 +1,125 @@
+/*
+ * This is a part of the Uniot project.
+ * Copyright (C) 2016-2024 Uniot <contact@uniot.io>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <Arduino.h>
+#include <StateMachine.h>
+#include <TaskScheduler.h>
+#include <unity.h>
+
+using namespace uniot;
+
+void test_function_state_machine_chain_in_one_run(void)
+{
+  enum { A = 0, B, C };
+  TaskScheduler scheduler;
+  StateMachine machine;
+  auto entered = 0;
+  machine
+      .state(A, "a", [&] { entered++; })
+      .state(B, "b", [&] { entered++; })
+      .state(C, "c", [&] { entered++; })
+      .when(A, [] { return true; }, B)
+      .when(B, [] { return true; }, C);
+  scheduler.push("machine", machine.task());
+  machine.start(A);
+
+  VirtualClock::advance(0);
+  scheduler.loop();
+  TEST_ASSERT_EQUAL(C, machine.current());
+  TEST_ASSERT_EQUAL(3, entered);
+  TEST_ASSERT_EQUAL(3, machine.getTransitionsCount());
+  // C has nothing to wait for, so the task is not woken up anymore
+  TEST_ASSERT_FALSE(machine.task().isAttached());
+}
+
+void test_function_state_machine_connection_flow(void)
+{
+  enum State { CONNECT = 0, CONNECTING, CONNECTED, CONFIG };
+  enum Event { FORGET = 0 };
+  TaskScheduler scheduler;
+  StateMachine machine;
+  auto connected = false;
+  auto tries = 0;
+  uint32_t connectedAtMs = 0;
+  // the radio is slow to connect on the first attempt only
+  SchedulerTask radio([&](SchedulerTask &self, short t) { connected = true; });
+  machine
+      .state(CONNECT, "connect", [&] {
+        tries++;
+        radio.once(tries == 1 ? 1500 : 650);
+      })
+      .state(CONNECTING, "connecting", nullptr, 100)
+      .state(CONNECTED, "connected", [&] { connectedAtMs = millis(); }, 2000, 1000)
+      .state(CONFIG, "config")
+      .on(StateMachine::ANY_STATE, FORGET, CONFIG)
+      .when(CONNECT, [] { return true; }, CONNECTING)
+      .when(CONNECTING, [&] { return connected; }, CONNECTED)
+      .after(CONNECTING, 1000, CONNECT, nullptr, [&] { return tries < 3; })
+      .when(CONNECTED, [&] { return !connected; }, CONNECT);
+  scheduler.push("machine", machine.task())
+      .push("radio", radio);
+
+  auto startMs = millis();
+  machine.start(CONNECT);
+  auto iterations = VirtualClock::fastForward(4000, [&] { scheduler.loop(); });
+
+  // the first attempt times out after a second, the second one gets through on the next poll,
+  // the slack of the connected polls does not postpone the polls and the timeouts of the other states
+  TEST_ASSERT_EQUAL(CONNECTED, machine.current());
+  TEST_ASSERT_EQUAL(1000, machine.task().getSlack());
+  TEST_ASSERT_EQUAL(2, tries);
+  TEST_ASSERT_EQUAL(1000 + 700, connectedAtMs - startMs);
+  // a poll per 100 ms while connecting, one per 2 s once connected, and the radio events
+  TEST_ASSERT_LESS_OR_EQUAL(24, iterations);
+
+  TEST_ASSERT_TRUE(machine.dispatch(FORGET));
+  VirtualClock::advance(0);
+  scheduler.loop();
+  TEST_ASSERT_EQUAL(CONFIG, machine.current());
+  TEST_ASSERT_FALSE(machine.task().isAttached());
+  radio.detach();
+}
+
+void test_function_state_machine_expired_guarded_timeout(void)
+{
+  enum { WAITING = 0, DONE };
+  TaskScheduler scheduler;
+  StateMachine machine;
+  auto ready = false;
+  machine
+      .state(WAITING, "waiting")
+      .state(DONE, "done")
+      .after(WAITING, 100, DONE, nullptr, [&] { return ready; })
+      .on(WAITING, 0, DONE);
+  scheduler.push("machine", machine.task());
+  machine.start(WAITING);
+
+  // the guard is false when the timeout expires, and nothing polls it, so the task must go idle
+  auto iterations = VirtualClock::fastForward(1000, [&] { scheduler.loop(); });
+  TEST_ASSERT_EQUAL(WAITING, machine.current());
+  TEST_ASSERT_LESS_OR_EQUAL(3, iterations);
+
+  // an event that the state does not accept is dropped, the accepted one is taken
+  TEST_ASSERT_TRUE(machine.dispatch(7));
+  TEST_ASSERT_TRUE(machine.dispatch(0));
+  VirtualClock::advance(0);
+  scheduler.loop();
+  TEST_ASSERT_EQUAL(DONE, machine.current());
+}
@@ -0,0 +1,96 @@
+/*
+ * This is a part of the Uniot project.
+ * Copyright (C) 2016-2024 Uniot <contact@uniot.io>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <Arduino.h>
+#include <TaskScheduler.h>
+#include <Tracer.h>
+#include <unity.h>
+
+#include <string>
+
+using namespace uniot;
+
+static size_t countOccurrences(const std::string &str, const char *what)
+{
+  size_t count = 0;
+  for (auto pos = str.find(what); pos != std::string::npos; pos = str.find(what, pos + 1))
+  {
+    count++;
+  }
+  return count;
+}
+
+void test_function_tracer_scheduler_timeline(void)
+{
+  auto &tracer = Tracer::getInstance();
+  tracer.clear();
+
+  TaskScheduler scheduler;
+  auto busy = TaskScheduler::make([](SchedulerTask &self, short t) { delay(2); });
+  auto idle = TaskScheduler::make([](SchedulerTask &self, short t) {});
+  scheduler.push("busy", busy)
+      .push("idle", idle);
+  busy->attach(10);
+  idle->attach(20);
+
+  VirtualClock::fastForward(100, [&] { scheduler.loop(); });
+  busy->detach();
+  idle->detach();
+
+  TEST_ASSERT_EQUAL(15, tracer.size());
+
+  std::string json;
+  tracer.exportChromeTrace([&](const char *piece) { json += piece; });
+  TEST_MESSAGE(json.substr(0, 120).c_str());
+
+  TEST_ASSERT_EQUAL(0, json.find("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[{"));
+  TEST_ASSERT_EQUAL(json.size() - 2, json.rfind("]}"));
+  TEST_ASSERT_EQUAL(10, countOccurrences(json, "\"name\":\"busy\""));
+  TEST_ASSERT_EQUAL(5, countOccurrences(json, "\"name\":\"idle\""));
+  TEST_ASSERT_EQUAL(10, countOccurrences(json, "\"dur\":2000,"));
+  // the oldest event starts the timeline
+  TEST_ASSERT_EQUAL(1, countOccurrences(json, "\"ts\":0,"));
+}
+
+void test_function_tracer_ring_overwrite(void)
+{
+  auto &tracer = Tracer::getInstance();
+  tracer.clear();
+
+  for (auto i = 0; i < UNIOT_TRACE_BUFFER_SIZE + 10; i++)
+  {
+    tracer.instant(Tracer::USER, "tick", i);
+    delayMicroseconds(5);
+  }
+  TEST_ASSERT_EQUAL(UNIOT_TRACE_BUFFER_SIZE, tracer.size());
+  TEST_ASSERT_EQUAL(10, tracer.getOverwrittenCount());
+
+  std::string json;
+  tracer.exportChromeTrace([&](const char *piece) {
+    // recording is paused while exporting, so the writer cannot overwrite what is being exported
+    tracer.instant(Tracer::USER, "writer");
+    json += piece;
+  });
+  TEST_ASSERT_EQUAL(UNIOT_TRACE_BUFFER_SIZE, countOccurrences(json, "\"ph\":\"i\""));
+  TEST_ASSERT_EQUAL(0, countOccurrences(json, "\"name\":\"writer\""));
+  TEST_ASSERT_EQUAL(1, countOccurrences(json, "\"args\":{\"arg\":10}"));
+  TEST_ASSERT_EQUAL(0, countOccurrences(json, "\"args\":{\"arg\":9}"));
+  TEST_ASSERT_EQUAL(10, tracer.getOverwrittenCount());
+}
@@ -0,0 +1,150 @@
+/*
+ * This is a part of the Uniot project.
+ * Copyright (C) 2016-2024 Uniot <contact@uniot.io>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <Arduino.h>
+#include <TaskScheduler.h>
+#include <unity.h>
+
+#include <chrono>
+#include <cstdio>
+
+using namespace uniot;
+
+void test_function_virtual_clock_timers_order(void)
+{
+  struct Probe
+  {
+    Task task;
+    char id;
+    char *log;
+  };
+  char log[16] = {0};
+  Probe fast = {{}, 'f', log};
+  Probe slow = {{}, 's', log};
+  Probe once = {{}, 'o', log};
+  auto record = [](Probe *probe) { probe->log[strlen(probe->log)] = probe->id; };
+
+  fast.task.attach<Probe *>(10, true, record, &fast);
+  slow.task.attach<Probe *>(25, true, record, &slow);
+  once.task.attach<Probe *>(20, false, record, &once);
+  TEST_ASSERT_EQUAL(3, VirtualClock::getArmedCount());
+  TEST_ASSERT_EQUAL(10, VirtualClock::getNextDeadlineMs());
+
+  auto startMs = millis();
+  VirtualClock::advance(50);
+  TEST_ASSERT_EQUAL(startMs + 50, millis());
+  // on the same deadline the timer that was (re)armed earlier fires first
+  TEST_ASSERT_EQUAL_STRING("fofsffsf", log);
+  // as on the device, a fired one-shot task stays attached until it is detached
+  TEST_ASSERT_TRUE(once.task.isAttached());
+  TEST_ASSERT_EQUAL(2, VirtualClock::getArmedCount());
+
+  fast.task.detach();
+  slow.task.detach();
+  once.task.detach();
+  TEST_ASSERT_EQUAL(0, VirtualClock::getArmedCount());
+}
+
+void test_function_virtual_clock_detach_from_callback(void)
+{
+  struct Pair
+  {
+    Task first;
+    Task second;
+    int firstRuns;
+    int secondRuns;
+  } pair = {{}, {}, 0, 0};
+
+  pair.first.attach<Pair *>(5, true, [](Pair *p) {
+    p->firstRuns++;
+    p->second.detach();
+    p->first.detach();
+  }, &pair);
+  pair.second.attach<Pair *>(5, true, [](Pair *p) { p->secondRuns++; }, &pair);
+
+  VirtualClock::advance(100);
+  TEST_ASSERT_EQUAL(1, pair.firstRuns);
+  TEST_ASSERT_EQUAL(0, pair.secondRuns);
+  TEST_ASSERT_EQUAL(0, VirtualClock::getArmedCount());
+}
+
+void test_function_virtual_clock_scheduler_day(void)
+{
+  constexpr uint64_t DAY_MS = 24 * 60 * 60 * 1000ULL;
+
+  TaskScheduler scheduler;
+  uint64_t fastRuns = 0;
+  uint64_t slowRuns = 0;
+  int onceRuns = 0;
+  auto fast = TaskScheduler::make([&](SchedulerTask &self, short t) { fastRuns++; });
+  auto slow = TaskScheduler::make([&](SchedulerTask &self, short t) {
+    slowRuns++;
+    delay(3);  // the simulated time the work takes
+  });
+  auto once = TaskScheduler::make([&](SchedulerTask &self, short t) { onceRuns++; });
+  scheduler.push("fast", fast)
+      .push("slow", slow)
+      .push("once", once);
+  fast->attach(100);
+  slow->attach(60 * 1000UL);
+  once->once(1000);
+
+  auto startMs = millis();
+  auto startReal = std::chrono::steady_clock::now();
+  auto iterations = VirtualClock::fastForward(DAY_MS, [&] { scheduler.loop(); });
+  auto realMs = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startReal).count();
+
+  char msg[128];
+  snprintf(msg, sizeof(msg), "24 h simulated in %ld ms (%lu loops)", (long)realMs, (unsigned long)iterations);
+  TEST_MESSAGE(msg);
+
+  // the slow task is due at the very end of the day, so its last run ends a bit later
+  TEST_ASSERT_EQUAL(startMs + DAY_MS + 3, millis());
+  TEST_ASSERT_EQUAL(DAY_MS / 100, fastRuns);
+  TEST_ASSERT_EQUAL(DAY_MS / (60 * 1000), slowRuns);
+  TEST_ASSERT_EQUAL(1, onceRuns);
+  TEST_ASSERT_FALSE(once->isAttached());
+  TEST_ASSERT_EQUAL(3 * slowRuns, slow->getTotalElapsedMs());
+  TEST_ASSERT_EQUAL(0, fast->getTotalElapsedMs());
+
+  fast->detach();
+  slow->detach();
+}
+
+void test_function_virtual_clock_runaway_task(void)
+{
+  TaskScheduler scheduler;
+  auto runs = 0;
+  auto task = TaskScheduler::make([&](SchedulerTask &self, short t) {
+    // the second run is within the budget, so it resets the count of overruns in a row
+    delay(++runs == 2 ? 1 : 20);
+  });
+  task->setBudget(5, 3, SchedulerTask::OVERRUN_DETACH);
+  scheduler.push("runaway", task);
+  task->attach(50);
+
+  VirtualClock::fastForward(60 * 1000UL, [&] { scheduler.loop(); });
+
+  TEST_ASSERT_FALSE(task->isAttached());
+  TEST_ASSERT_EQUAL(5, runs);
+  TEST_ASSERT_EQUAL(4, task->getTotalOverruns());
+  TEST_ASSERT_EQUAL(20, task->getMaxElapsedMs());
+  TEST_ASSERT_EQUAL(1, scheduler.getRunawayCount());
+}
@@ -25,6 +25,7 @@
 #include "test_data_lisp.h"
 #include "test_data_links_register.h"
 #include "test_data_lisp_primitives.h"
+#include "test_data_scheduler.h"
 
 // void setUp(void) {
 // // set stuff up here
@@ -62,6 +63,11 @@ void process()
   RUN_TEST(test_function_lisp_primitive_dread);
   RUN_TEST(test_function_lisp_primitive_awrite);
   RUN_TEST(test_function_lisp_primitive_aread);
+  // test_data_scheduler.h
+  RUN_TEST(test_function_scheduler_ready_queue_benchmark);
+  RUN_TEST(test_function_scheduler_task_fired_before_push);
+  RUN_TEST(test_function_scheduler_remove_and_handles);
+  RUN_TEST(test_function_scheduler_runaway_detach);
 
   UNITY_END();
 }
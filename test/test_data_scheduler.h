@@ -0,0 +1,168 @@
+/*
+ * This is a part of the Uniot project.
+ * Copyright (C) 2016-2024 Uniot <contact@uniot.io>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <Arduino.h>
+#include <unity.h>
+
+#include <TaskScheduler.h>
+
+using namespace uniot;
+
+static constexpr int BENCH_TASKS_COUNT = 128;
+static constexpr int BENCH_ACTIVE_COUNT = 4;
+static constexpr uint32_t BENCH_PERIOD_MS = 10;
+static constexpr uint32_t BENCH_DURATION_MS = 1000;
+
+struct LoopBenchmark
+{
+  uint32_t loops;
+  uint32_t nsPerLoop;
+  int executed;
+};
+
+static LoopBenchmark runLoopBenchmark(bool fullScan)
+{
+  TaskScheduler scheduler;
+  scheduler.setAlwaysFullScan(fullScan);
+  TaskScheduler::TaskPtr tasks[BENCH_TASKS_COUNT];
+  int executed = 0;
+  for (auto i = 0; i < BENCH_TASKS_COUNT; i++)
+  {
+    tasks[i] = TaskScheduler::make([&](SchedulerTask &self, short t) { executed++; });
+    scheduler.push("bench", tasks[i]);
+  }
+  for (auto i = 0; i < BENCH_ACTIVE_COUNT; i++)
+  {
+    tasks[i]->attach(BENCH_PERIOD_MS);
+  }
+
+  uint32_t loops = 0;
+  auto startMs = millis();
+  auto startUs = micros();
+  while (millis() - startMs < BENCH_DURATION_MS)
+  {
+    scheduler.loop();
+    loops++;
+  }
+  auto elapsedUs = micros() - startUs;
+
+  for (auto &task : tasks)
+  {
+    task->detach();
+  }
+
+  return {loops, static_cast<uint32_t>(elapsedUs * 1000ULL / loops), executed};
+}
+
+void test_function_scheduler_ready_queue_benchmark(void)
+{
+  auto queued = runLoopBenchmark(false);
+  auto scanned = runLoopBenchmark(true);
+
+  char msg[128];
+  snprintf(msg, sizeof(msg), "%d tasks (%d active): %lu ns per loop with the ready queue, %lu ns with the full scan",
+           BENCH_TASKS_COUNT, BENCH_ACTIVE_COUNT, (unsigned long)queued.nsPerLoop, (unsigned long)scanned.nsPerLoop);
+  TEST_MESSAGE(msg);
+
+  // both run the same ticks, the idle loops of the ready queue do not touch the tasks at all
+  TEST_ASSERT_INT_WITHIN(BENCH_ACTIVE_COUNT * 2, BENCH_ACTIVE_COUNT * (BENCH_DURATION_MS / BENCH_PERIOD_MS), queued.executed);
+  TEST_ASSERT_INT_WITHIN(BENCH_ACTIVE_COUNT * 2, BENCH_ACTIVE_COUNT * (BENCH_DURATION_MS / BENCH_PERIOD_MS), scanned.executed);
+  TEST_ASSERT_LESS_THAN_UINT32(scanned.nsPerLoop, queued.nsPerLoop);
+}
+
+void test_function_scheduler_task_fired_before_push(void)
+{
+  TaskScheduler scheduler;
+  auto executed = false;
+  auto task = TaskScheduler::make([&](SchedulerTask &self, short t) { executed = true; });
+  task->once(1);
+  delay(5);
+
+  scheduler.push("late", task);
+  scheduler.loop();
+
+  TEST_ASSERT_TRUE(executed);
+}
+
+void test_function_scheduler_remove_and_handles(void)
+{
+  TaskScheduler scheduler;
+  auto first = TaskScheduler::make([](SchedulerTask &self, short t) {});
+  auto second = TaskScheduler::make([](SchedulerTask &self, short t) {});
+
+  auto firstHandle = scheduler.add("first", first);
+  auto secondHandle = scheduler.add("second", second);
+  TEST_ASSERT_EQUAL(firstHandle, scheduler.find("first"));
+  TEST_ASSERT_EQUAL(secondHandle, scheduler.find("second"));
+
+  first->attach(10);
+  TEST_ASSERT_TRUE(scheduler.remove("first"));
+  TEST_ASSERT_FALSE(first->isAttached());
+  TEST_ASSERT_FALSE(scheduler.contains(firstHandle));
+  TEST_ASSERT_EQUAL(TaskScheduler::INVALID_HANDLE, scheduler.find("first"));
+
+  // the slot is reused, but the stale handle must not point to the new task
+  auto third = TaskScheduler::make([](SchedulerTask &self, short t) {});
+  auto thirdHandle = scheduler.add("third", third);
+  TEST_ASSERT_NOT_EQUAL(firstHandle, thirdHandle);
+  TEST_ASSERT_FALSE(scheduler.remove(firstHandle));
+  TEST_ASSERT_TRUE(scheduler.get(thirdHandle) == third);
+  TEST_ASSERT_EQUAL(2, scheduler.size());
+
+  for (auto i = 0; i < 5000; i++)
+  {
+    auto handle = scheduler.add("short_lived", TaskScheduler::make([](SchedulerTask &self, short t) {}));
+    TEST_ASSERT_TRUE(scheduler.remove(handle));
+  }
+  TEST_ASSERT_EQUAL(2, scheduler.size());
+}
+
+void test_function_scheduler_runaway_detach(void)
+{
+  TaskScheduler scheduler;
+  auto runs = 0;
+  const char *runawayName = nullptr;
+  auto runawayHandle = TaskScheduler::INVALID_HANDLE;
+  scheduler.setRunawayCallback([&](const char *name, TaskScheduler::TaskHandle handle) {
+    runawayName = name;
+    runawayHandle = handle;
+  });
+
+  auto task = TaskScheduler::make([&](SchedulerTask &self, short t) {
+    runs++;
+    delay(20);
+  });
+  task->setBudget(5, 3, SchedulerTask::OVERRUN_NOTIFY | SchedulerTask::OVERRUN_DETACH);
+  auto handle = scheduler.add("runaway", task);
+  task->attach(1);
+
+  auto startMs = millis();
+  while (task->isAttached() && millis() - startMs < 1000)
+  {
+    scheduler.loop();
+  }
+
+  TEST_ASSERT_FALSE(task->isAttached());
+  TEST_ASSERT_EQUAL(3, runs);
+  TEST_ASSERT_EQUAL(3, task->getTotalOverruns());
+  TEST_ASSERT_EQUAL(1, scheduler.getRunawayCount());
+  TEST_ASSERT_EQUAL(handle, runawayHandle);
+  TEST_ASSERT_EQUAL_STRING("runaway", runawayName);
+}